@@ -0,0 +1,103 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+static bool json = false;
+static size_t warmup = 3;
+static size_t repetitions = 25;
+static const char* filter = nullptr;
+static size_t reported = 0;
+
+static size_t parse_count(const char* text, size_t max) {
+    size_t count = (size_t)strtoull(text, nullptr, 10);
+    if (count == 0) {
+        count = 1;
+    }
+    return count < max ? count : max;
+}
+
+void bench_start(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        }
+        else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            repetitions = parse_count(argv[++i], BENCH_MAX_REPETITIONS);
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = (size_t)strtoull(argv[++i], nullptr, 10);
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        }
+        else {
+            fprintf(stderr, "unknown argument %s\n", argv[i]);
+        }
+    }
+    if (json) {
+        printf("[\n");
+    }
+    else {
+        printf("%-44s %12s %12s %12s %12s\n", "benchmark", "median ns/v", "p99 ns/v", "Mvalues/s", "MB/s");
+    }
+}
+
+int bench_finish() {
+    if (json) {
+        printf("\n]\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+bool bench_enabled(const char* name) {
+    return filter == nullptr || strstr(name, filter) != nullptr;
+}
+
+size_t bench_warmup() {
+    return warmup;
+}
+
+size_t bench_repetitions() {
+    return repetitions;
+}
+
+uint64_t bench_now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int compare_times(const void* a, const void* b) {
+    uint64_t left = *(const uint64_t*)a;
+    uint64_t right = *(const uint64_t*)b;
+    return (left > right) - (left < right);
+}
+
+void bench_report(const char* name, size_t values, size_t bytes, uint64_t* times, size_t count) {
+    qsort(times, count, sizeof(uint64_t), compare_times);
+    double median = count % 2 == 1 ? (double)times[count / 2] : ((double)times[count / 2 - 1] + (double)times[count / 2]) / 2.0;
+    // nearest rank
+    size_t p99_rank = (count * 99 + 99) / 100;
+    double p99 = (double)times[p99_rank - 1];
+    if (median <= 0.0) {
+        median = 1.0;
+    }
+    double values_per_second = (double)values * 1e9 / median;
+    double bytes_per_second = (double)bytes * 1e9 / median;
+
+    if (json) {
+        printf("%s  {\"name\": \"%s\", \"values\": %zu, \"bytes\": %zu, \"repetitions\": %zu, "
+               "\"median_ns\": %.0f, \"p99_ns\": %.0f, \"ns_per_value\": %.4f, \"p99_ns_per_value\": %.4f, "
+               "\"values_per_second\": %.0f, \"bytes_per_second\": %.0f}",
+            reported == 0 ? "" : ",\n", name, values, bytes, count,
+            median, p99, median / (double)values, p99 / (double)values,
+            values_per_second, bytes_per_second);
+    }
+    else {
+        printf("%-44s %12.3f %12.3f %12.2f %12.2f\n", name, median / (double)values, p99 / (double)values,
+            values_per_second / 1e6, bytes_per_second / 1e6);
+    }
+    fflush(stdout);
+    reported++;
+}
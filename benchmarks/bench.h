@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// A small benchmark harness. Every benchmark runs a few warm-up repetitions and then times every repetition on its own,
+// the median and p99 of the repetitions are reported as a table, or as json with --json for regression tracking.
+// Arguments:
+//    --json              prints the results as a json array
+//    --repetitions <n>   the timed repetitions of every benchmark, 25 by default
+//    --warmup <n>        the untimed repetitions before them, 3 by default
+//    --filter <text>     only runs the benchmarks which have the text in their name
+
+void bench_start(int argc, char** argv);
+// returns the exit code of the program
+int bench_finish();
+
+bool bench_enabled(const char* name);
+size_t bench_warmup();
+size_t bench_repetitions();
+uint64_t bench_now_ns();
+// reports a benchmark from the time of every repetition, values and bytes are the amount a single repetition handles
+void bench_report(const char* name, size_t values, size_t bytes, uint64_t* times, size_t count);
+
+// keeps the compiler from optimizing away a result that is never used
+template<typename T>
+inline void bench_keep(const T& value) {
+    #if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+    #else
+        static volatile T sink;
+        sink = value;
+    #endif
+}
+
+#define BENCH_MAX_REPETITIONS 1000
+
+// Runs `run` for the warm-up and timed repetitions, everything in it is timed
+template<typename F>
+void bench_run(const char* name, size_t values, size_t bytes, F run) {
+    if (!bench_enabled(name)) {
+        return;
+    }
+    for (size_t i = 0; i < bench_warmup(); i++) {
+        run();
+    }
+    uint64_t times[BENCH_MAX_REPETITIONS];
+    size_t repetitions = bench_repetitions();
+    for (size_t i = 0; i < repetitions; i++) {
+        uint64_t start = bench_now_ns();
+        run();
+        times[i] = bench_now_ns() - start;
+    }
+    bench_report(name, values, bytes, times, repetitions);
+}
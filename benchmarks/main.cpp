@@ -0,0 +1,920 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <packet_master.h>
+#include <packet_master_fields.h>
+#include <packet_master_coro.h>
+#include <packet_master_io.h>
+#include <packet_master_log.h>
+#include <packet_master_parallel.h>
+#include "bench.h"
+
+
+void* bench_malloc(size_t size, void* ctx) {
+    (void)ctx;
+    return malloc(size);
+}
+void* bench_realloc(void* ptr, size_t old_size, size_t new_size, void* ctx) {
+    (void)old_size;
+    (void)ctx;
+    return realloc(ptr, new_size);
+}
+void bench_free(void* ptr, size_t size, void* ctx) {
+    (void)size;
+    (void)ctx;
+    free(ptr);
+}
+
+static Allocator allocator = {
+    bench_malloc,
+    bench_realloc,
+    bench_free,
+    NULL
+};
+
+// discards everything, only the serialization cost is measured
+int null_write(void* ctx, uint8_t* data, size_t size) {
+    (void)ctx;
+    (void)data;
+    (void)size;
+    return 0;
+}
+
+#define BENCH_VALUES (1 << 16)
+// the worst case of every value, a header of 3 bits and 8 bytes
+#define BENCH_BUFFER_SIZE (BENCH_VALUES * 10 + 64)
+
+static uint8_t buffer[BENCH_BUFFER_SIZE];
+
+// values with a mix of widths, shifting by the index spreads them over all of the segment counts
+static uint64_t mixed_value(size_t i, uint32_t bits) {
+    uint64_t value = (uint64_t)i * 0x9E3779B97F4A7C15ull;
+    value >>= 64 - bits;
+    return value >> (i % bits);
+}
+
+// Serializes BENCH_VALUES values with serialize and deserializes them back with deserialize
+template<typename T, typename Serialize, typename Deserialize>
+void bench_value(const char* serialize_name, const char* deserialize_name, uint32_t bits, Serialize serialize, Deserialize deserialize) {
+    static T values[BENCH_VALUES];
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        values[i] = (T)mixed_value(i, bits);
+    }
+    Serializer serializer(buffer, sizeof(buffer));
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        serialize(&serializer, values[i]);
+    }
+    serializer.finalize();
+    size_t size = serializer.size();
+
+    bench_run(serialize_name, BENCH_VALUES, size, [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            serialize(&serializer, values[i]);
+        }
+        serializer.finalize();
+    });
+    bench_run(deserialize_name, BENCH_VALUES, size, [&]() {
+        Deserializer deserializer(buffer, size);
+        T checksum = 0;
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            T value;
+            deserialize(&deserializer, &value);
+            checksum += value;
+        }
+        bench_keep(checksum);
+    });
+}
+
+void bench_bool() {
+    bench_value<uint8_t>("bool/serialize", "bool/deserialize", 1,
+        [](Serializer* serializer, uint8_t value) { serializer->serialize_bool(value != 0); },
+        [](Deserializer* deserializer, uint8_t* value) { bool flag; deserializer->deserialize_bool(&flag); *value = flag; });
+}
+
+// every uint type with its default options and with options that have fewer bits or segments
+void bench_uints() {
+    static const PreparedUintOptions uint8_default = uint8_default_options();
+    static const PreparedUintOptions uint8_bits5 = uint8_max_bits(5);
+    static const PreparedUintOptions uint16_default = uint16_default_options();
+    static const PreparedUintOptions uint16_bits12 = uint16_max_bits(12);
+    static const PreparedUintOptions uint32_default = uint32_default_options();
+    static const PreparedUintOptions uint32_bits18 = uint32_max_bits(18);
+    static const PreparedUintOptions uint64_default = uint64_default_options();
+    static const PreparedUintOptions uint64_bits40 = uint64_max_bits(40);
+
+    bench_value<uint8_t>("uint8/default/serialize", "uint8/default/deserialize", 8,
+        [](Serializer* s, uint8_t v) { s->serialize_uint8(v, uint8_default); },
+        [](Deserializer* d, uint8_t* v) { d->deserialize_uint8(uint8_default, v); });
+    bench_value<uint8_t>("uint8/bits:5/serialize", "uint8/bits:5/deserialize", 5,
+        [](Serializer* s, uint8_t v) { s->serialize_uint8(v, uint8_bits5); },
+        [](Deserializer* d, uint8_t* v) { d->deserialize_uint8(uint8_bits5, v); });
+    bench_value<uint16_t>("uint16/default/serialize", "uint16/default/deserialize", 16,
+        [](Serializer* s, uint16_t v) { s->serialize_uint16(v, uint16_default); },
+        [](Deserializer* d, uint16_t* v) { d->deserialize_uint16(uint16_default, v); });
+    bench_value<uint16_t>("uint16/bits:12/serialize", "uint16/bits:12/deserialize", 12,
+        [](Serializer* s, uint16_t v) { s->serialize_uint16(v, uint16_bits12); },
+        [](Deserializer* d, uint16_t* v) { d->deserialize_uint16(uint16_bits12, v); });
+    bench_value<uint32_t>("uint32/default/serialize", "uint32/default/deserialize", 32,
+        [](Serializer* s, uint32_t v) { s->serialize_uint32(v, uint32_default); },
+        [](Deserializer* d, uint32_t* v) { d->deserialize_uint32(uint32_default, v); });
+    bench_value<uint32_t>("uint32/bits:18/serialize", "uint32/bits:18/deserialize", 18,
+        [](Serializer* s, uint32_t v) { s->serialize_uint32(v, uint32_bits18); },
+        [](Deserializer* d, uint32_t* v) { d->deserialize_uint32(uint32_bits18, v); });
+    bench_value<uint64_t>("uint64/default/serialize", "uint64/default/deserialize", 64,
+        [](Serializer* s, uint64_t v) { s->serialize_uint64(v, uint64_default); },
+        [](Deserializer* d, uint64_t* v) { d->deserialize_uint64(uint64_default, v); });
+    bench_value<uint64_t>("uint64/bits:40/serialize", "uint64/bits:40/deserialize", 40,
+        [](Serializer* s, uint64_t v) { s->serialize_uint64(v, uint64_bits40); },
+        [](Deserializer* d, uint64_t* v) { d->deserialize_uint64(uint64_bits40, v); });
+}
+
+// the same options as compile time specs
+void bench_uint_specs() {
+    bench_value<uint16_t>("uint16/spec:16/serialize", "uint16/spec:16/deserialize", 16,
+        [](Serializer* s, uint16_t v) { s->serialize_uint16<UintSpec<16>>(v); },
+        [](Deserializer* d, uint16_t* v) { d->deserialize_uint16<UintSpec<16>>(v); });
+    bench_value<uint32_t>("uint32/spec:32/serialize", "uint32/spec:32/deserialize", 32,
+        [](Serializer* s, uint32_t v) { s->serialize_uint32<UintSpec<32>>(v); },
+        [](Deserializer* d, uint32_t* v) { d->deserialize_uint32<UintSpec<32>>(v); });
+    bench_value<uint32_t>("uint32/spec:18/serialize", "uint32/spec:18/deserialize", 18,
+        [](Serializer* s, uint32_t v) { s->serialize_uint32<UintSpec<18>>(v); },
+        [](Deserializer* d, uint32_t* v) { d->deserialize_uint32<UintSpec<18>>(v); });
+}
+
+void bench_signed() {
+    static const PreparedUintOptions range = int32_range(-100000, 100000);
+    bench_value<uint32_t>("int32/range/serialize", "int32/range/deserialize", 17,
+        [](Serializer* s, uint32_t v) { s->serialize_int32((int32_t)v - 65536, range); },
+        [](Deserializer* d, uint32_t* v) { int32_t value; d->deserialize_int32(range, &value); *v = (uint32_t)value; });
+}
+
+// Opens `open_bytes` bytes with free bits and then fills each of them with a bool.
+// The cost of a bool should not depend on the amount of open bytes.
+void bench_free_bits_queue() {
+    PreparedUintOptions options = uint8_max_bits(7);
+    for (size_t open_bytes = 1; open_bytes <= PACKET_MASTER_MAX_FREE_BYTES; open_bytes *= 2) {
+        char name[64];
+        snprintf(name, sizeof(name), "free_bits_queue/open_bytes:%zu", open_bytes);
+        size_t rounds = BENCH_VALUES / open_bytes;
+        bench_run(name, rounds * open_bytes * 2, rounds * open_bytes, [&]() {
+            Serializer serializer(buffer, sizeof(buffer));
+            for (size_t round = 0; round < rounds; round++) {
+                for (size_t i = 0; i < open_bytes; i++) {
+                    serializer.serialize_uint8((uint8_t)(i & 0x7F), options);
+                }
+                for (size_t i = 0; i < open_bytes; i++) {
+                    serializer.serialize_bool(i & 1);
+                }
+            }
+            serializer.finalize();
+        });
+    }
+}
+
+// A uint32 and a bool per value, the bits of the segment headers and the bools are all moved by the bit core
+void bench_bit_core() {
+    struct HeaderOptions {
+        const char* name;
+        PreparedUintOptions options;
+    };
+    // 4 segments have 2 header bits, 32 segments have 5
+    HeaderOptions header_options[] = {
+        { "headers:2", uint32_default_options() },
+        { "headers:5", prepare_uint_options(UintOptions{ 32, 32 }) },
+    };
+    static uint32_t values[BENCH_VALUES];
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        values[i] = (uint32_t)mixed_value(i, 32);
+    }
+    for (const HeaderOptions& header : header_options) {
+        PreparedUintOptions options = header.options;
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            serializer.serialize_uint32(values[i], options);
+            serializer.serialize_bool(i & 1);
+        }
+        serializer.finalize();
+        size_t size = serializer.size();
+
+        char name[64];
+        snprintf(name, sizeof(name), "bit_core/%s/serialize", header.name);
+        bench_run(name, BENCH_VALUES, size, [&]() {
+            Serializer serializer(buffer, sizeof(buffer));
+            for (size_t i = 0; i < BENCH_VALUES; i++) {
+                serializer.serialize_uint32(values[i], options);
+                serializer.serialize_bool(i & 1);
+            }
+            serializer.finalize();
+        });
+        snprintf(name, sizeof(name), "bit_core/%s/deserialize", header.name);
+        bench_run(name, BENCH_VALUES, size, [&]() {
+            Deserializer deserializer(buffer, size);
+            uint32_t checksum = 0;
+            for (size_t i = 0; i < BENCH_VALUES; i++) {
+                uint32_t value;
+                bool flag;
+                deserializer.deserialize_uint32(options, &value);
+                deserializer.deserialize_bool(&flag);
+                checksum += value + flag;
+            }
+            bench_keep(checksum);
+        });
+    }
+}
+
+// Single segment arrays go through the bulk packing kernels,
+// multi segment arrays compute the encodings of a block of values at once
+void bench_uint32_arrays() {
+    static uint32_t values[BENCH_VALUES];
+    static uint32_t decoded[BENCH_VALUES];
+    const uint32_t bits[] = { 8, 12, 16, 24 };
+    for (size_t b = 0; b < sizeof(bits) / sizeof(bits[0]); b++) {
+        UintOptions single_segment;
+        single_segment.max_bits = bits[b];
+        single_segment.segments_hint = 1;
+        PreparedUintOptions options = prepare_uint_options(single_segment);
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            values[i] = (uint32_t)mixed_value(i, bits[b]);
+        }
+        // single segment values take whole bytes
+        size_t size = (size_t)BENCH_VALUES * ((bits[b] + 7) / 8);
+
+        char name[64];
+        snprintf(name, sizeof(name), "uint32_array/bits:%u/serialize", bits[b]);
+        bench_run(name, BENCH_VALUES, size, [&]() {
+            Serializer serializer(buffer, sizeof(buffer));
+            serializer.serialize_uint32_array(values, BENCH_VALUES, options);
+            serializer.finalize();
+        });
+        snprintf(name, sizeof(name), "uint32_array/bits:%u/deserialize", bits[b]);
+        bench_run(name, BENCH_VALUES, size, [&]() {
+            Deserializer deserializer(buffer, size);
+            deserializer.deserialize_uint32_array(options, decoded, BENCH_VALUES);
+            bench_keep(decoded[BENCH_VALUES - 1]);
+        });
+    }
+
+    PreparedUintOptions options = uint32_default_options();
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        values[i] = (uint32_t)mixed_value(i, 32);
+    }
+    Serializer serializer(buffer, sizeof(buffer));
+    serializer.serialize_uint32_array(values, BENCH_VALUES, options);
+    serializer.finalize();
+    size_t size = serializer.size();
+    bench_run("uint32_array/segmented/serialize", BENCH_VALUES, size, [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        serializer.serialize_uint32_array(values, BENCH_VALUES, options);
+        serializer.finalize();
+    });
+    bench_run("uint32_array/segmented/deserialize", BENCH_VALUES, size, [&]() {
+        Deserializer deserializer(buffer, size);
+        deserializer.deserialize_uint32_array(options, decoded, BENCH_VALUES);
+        bench_keep(decoded[BENCH_VALUES - 1]);
+    });
+}
+
+// Quantizing floats one by one against the SIMD array version
+void bench_quantized_floats() {
+    static constexpr PreparedFloatOptions options = float_quantized_options(-1000.0f, 1000.0f, 0.01f);
+    static float values[BENCH_VALUES];
+    static float decoded[BENCH_VALUES];
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        values[i] = (float)((i * 2654435761u) % 200000) * 0.01f - 1000.0f;
+    }
+    size_t size = (size_t)BENCH_VALUES * 3;
+    bench_run("float_quantized/serialize", BENCH_VALUES, size, [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            serializer.serialize_float_quantized(values[i], options);
+        }
+        serializer.finalize();
+    });
+    bench_run("float_quantized/deserialize", BENCH_VALUES, size, [&]() {
+        Deserializer deserializer(buffer, size);
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            deserializer.deserialize_float_quantized(options, decoded + i);
+        }
+        bench_keep(decoded[BENCH_VALUES - 1]);
+    });
+    bench_run("float_quantized_array/serialize", BENCH_VALUES, size, [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        serializer.serialize_float_quantized_array(values, BENCH_VALUES, options);
+        serializer.finalize();
+    });
+    bench_run("float_quantized_array/deserialize", BENCH_VALUES, size, [&]() {
+        Deserializer deserializer(buffer, size);
+        deserializer.deserialize_float_quantized_array(options, decoded, BENCH_VALUES);
+        bench_keep(decoded[BENCH_VALUES - 1]);
+    });
+}
+
+// Growing a vector from empty with small pushes, the cost includes the reallocations
+void bench_vector_push_many() {
+    const uint8_t chunk[7] = { 1, 2, 3, 4, 5, 6, 7 };
+    const size_t pushes = BENCH_VALUES * 4;
+    bench_run("vector/push_many:7", pushes, pushes * sizeof(chunk), [&]() {
+        Vector<uint8_t> vector(&allocator);
+        for (size_t i = 0; i < pushes; i++) {
+            vector.push_many(chunk, sizeof(chunk));
+        }
+        bench_keep(vector.length());
+    });
+}
+
+// The cost of handing the bytes to the writer with every flush policy
+void bench_flush() {
+    PreparedUintOptions options = uint32_default_options();
+    Writer writer{};
+    writer.write_callback = null_write;
+    struct Policy {
+        const char* name;
+        FlushPolicy policy;
+        size_t threshold;
+    };
+    const Policy policies[] = {
+        { "flush/per_value", FlushPolicy::PerValue, 0 },
+        { "flush/threshold:64", FlushPolicy::Threshold, 64 },
+        { "flush/threshold:4096", FlushPolicy::Threshold, 4096 },
+        { "flush/finalize", FlushPolicy::Finalize, 0 },
+    };
+    Serializer measure(buffer, sizeof(buffer));
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        measure.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+    }
+    measure.finalize();
+    size_t size = measure.size();
+
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        const Policy& policy = policies[p];
+        // the serializer is reused so its buffer is already allocated
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(policy.policy, policy.threshold);
+        bench_run(policy.name, BENCH_VALUES, size, [&]() {
+            for (size_t i = 0; i < BENCH_VALUES; i++) {
+                serializer.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+            }
+            serializer.finalize();
+        });
+    }
+}
+
+// A state where most fields don't change, serialized in full against delta encoded with a baseline
+void bench_delta() {
+    const size_t fields = 16;
+    const size_t states = BENCH_VALUES / fields;
+    uint32_t baseline[fields];
+    uint32_t state[fields];
+    for (size_t i = 0; i < fields; i++) {
+        baseline[i] = (uint32_t)(i * 2654435761u);
+        state[i] = baseline[i];
+    }
+    PreparedUintOptions options = uint32_default_options();
+    size_t sizes[2] = {};
+    for (int delta = 0; delta < 2; delta++) {
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < states; i++) {
+            // one field changes every tick
+            state[i % fields] ^= 1;
+            for (size_t field = 0; field < fields; field++) {
+                if (delta) {
+                    serializer.serialize_uint32_delta(state[field], baseline[field], options);
+                }
+                else {
+                    serializer.serialize_uint32(state[field], options);
+                }
+            }
+            state[i % fields] ^= 1;
+        }
+        serializer.finalize();
+        sizes[delta] = serializer.size();
+    }
+
+    bench_run("delta/full_state", states * fields, sizes[0], [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < states; i++) {
+            state[i % fields] ^= 1;
+            for (size_t field = 0; field < fields; field++) {
+                serializer.serialize_uint32(state[field], options);
+            }
+            state[i % fields] ^= 1;
+        }
+        serializer.finalize();
+    });
+    bench_run("delta/delta_state", states * fields, sizes[1], [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < states; i++) {
+            state[i % fields] ^= 1;
+            for (size_t field = 0; field < fields; field++) {
+                serializer.serialize_uint32_delta(state[field], baseline[field], options);
+            }
+            state[i % fields] ^= 1;
+        }
+        serializer.finalize();
+    });
+}
+
+// Short lived serializers, one per packet, with the heap against an arena which is reset every tick
+void bench_packet_allocators() {
+    const size_t packets = 4096;
+    const size_t packets_per_tick = 64;
+    PreparedUintOptions options = uint32_default_options();
+    Writer writer{};
+    writer.write_callback = null_write;
+    ArenaAllocator arena(1 << 20, true);
+    Allocator arena_allocator = arena.allocator();
+
+    bench_run("packet_allocator/heap", packets, 0, [&]() {
+        for (size_t packet = 0; packet < packets; packet++) {
+            Serializer serializer(&writer, &allocator);
+            serializer.set_flush_policy(FlushPolicy::Finalize);
+            for (size_t i = 0; i < 16; i++) {
+                serializer.serialize_uint32((uint32_t)mixed_value(packet * 16 + i, 32), options);
+            }
+            serializer.finalize();
+        }
+    });
+    bench_run("packet_allocator/arena", packets, 0, [&]() {
+        for (size_t packet = 0; packet < packets; packet++) {
+            if (packet % packets_per_tick == 0) {
+                arena.reset();
+            }
+            Serializer serializer(&writer, &arena_allocator);
+            serializer.set_flush_policy(FlushPolicy::Finalize);
+            for (size_t i = 0; i < 16; i++) {
+                serializer.serialize_uint32((uint32_t)mixed_value(packet * 16 + i, 32), options);
+            }
+            serializer.finalize();
+        }
+    });
+}
+
+#ifdef PACKET_MASTER_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+
+// Packets of a header, a payload and a trailer written to /dev/null, a value is a packet.
+// The payload is copied into the buffer with a plain writer and handed over with writev otherwise.
+void bench_segments() {
+    const size_t packets = 256;
+    static uint8_t payload[16 * 1024];
+    int fd = open("/dev/null", O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+    FdWriter fd_writer(fd);
+    Writer writev_writer = fd_writer.writer();
+    Writer copy_writer = writev_writer;
+    copy_writer.writev_callback = nullptr;
+    const char* names[2] = { "segments/copy", "segments/writev" };
+    Writer* writers[2] = { &copy_writer, &writev_writer };
+    for (int i = 0; i < 2; i++) {
+        Serializer serializer(writers[i], &allocator);
+        bench_run(names[i], packets, packets * (sizeof(payload) + 8), [&]() {
+            for (size_t packet = 0; packet < packets; packet++) {
+                serializer.serialize_uint32((uint32_t)packet, uint32_default_options());
+                serializer.serialize_bool(true);
+                serializer.serialize_bytes(payload, sizeof(payload));
+                serializer.serialize_uint16(0xbeef, uint16_default_options());
+                serializer.finalize();
+            }
+        });
+    }
+    close(fd);
+}
+
+int stdio_write(void* ctx, uint8_t* data, size_t size) {
+    return fwrite(data, 1, size, (FILE*)ctx) == size ? 0 : 1;
+}
+
+struct StdioReader {
+    FILE* file;
+    uint8_t buffer[64];
+};
+uint8_t* stdio_read(void* ctx, size_t size) {
+    StdioReader* reader = (StdioReader*)ctx;
+    if (size > sizeof(reader->buffer) || fread(reader->buffer, 1, size, reader->file) != size) {
+        return nullptr;
+    }
+    return reader->buffer;
+}
+
+// Recording values to a file and replaying them, through stdio against a memory mapping
+void bench_mapped_files() {
+    const char* path = "/tmp/packet_master_bench.bin";
+    PreparedUintOptions options = uint32_default_options();
+    Serializer measure(buffer, sizeof(buffer));
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        measure.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+    }
+    measure.finalize();
+    size_t size = measure.size();
+
+    bench_run("file/stdio_write", BENCH_VALUES, size, [&]() {
+        FILE* file = fopen(path, "wb");
+        Writer writer{};
+        writer.write_callback = stdio_write;
+        writer.ctx = file;
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(FlushPolicy::Threshold, 4096);
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            serializer.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+        }
+        serializer.finalize();
+        fclose(file);
+    });
+    bench_run("file/mapped_write", BENCH_VALUES, size, [&]() {
+        MappedFileWriter file(path, 1 << 20);
+        Writer writer = file.writer();
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(FlushPolicy::Threshold, 4096);
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            serializer.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+        }
+        serializer.finalize();
+    });
+    bench_run("file/stdio_read", BENCH_VALUES, size, [&]() {
+        StdioReader stdio_reader;
+        stdio_reader.file = fopen(path, "rb");
+        Reader reader{};
+        reader.read_callback = stdio_read;
+        reader.ctx = &stdio_reader;
+        Deserializer deserializer(&reader, &allocator);
+        uint32_t value = 0;
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            deserializer.deserialize_uint32(options, &value);
+        }
+        bench_keep(value);
+        fclose(stdio_reader.file);
+    });
+    bench_run("file/mapped_read", BENCH_VALUES, size, [&]() {
+        MappedFileReader file(path);
+        Reader reader = file.reader();
+        Deserializer deserializer(&reader, &allocator);
+        uint32_t value = 0;
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            deserializer.deserialize_uint32(options, &value);
+        }
+        bench_keep(value);
+    });
+    unlink(path);
+}
+
+// Recording values to a file with a write on the serializing thread, against handing the buffers to an io thread
+void bench_async_writer() {
+    const char* path = "/tmp/packet_master_bench.bin";
+    PreparedUintOptions options = uint32_default_options();
+    Serializer measure(buffer, sizeof(buffer));
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        measure.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+    }
+    measure.finalize();
+    size_t size = measure.size();
+
+    bench_run("file/fd_write", BENCH_VALUES, size, [&]() {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        FdWriter file(fd);
+        Writer writer = file.writer();
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(FlushPolicy::Threshold, 4096);
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            serializer.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+        }
+        serializer.finalize();
+        close(fd);
+    });
+    bench_run("file/async_write", BENCH_VALUES, size, [&]() {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        AsyncFdWriter file(fd, &allocator);
+        Writer writer = file.writer();
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(FlushPolicy::Threshold, 4096);
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            serializer.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+        }
+        serializer.finalize();
+        file.close();
+        close(fd);
+    });
+    unlink(path);
+}
+#else
+void bench_segments() {}
+void bench_mapped_files() {}
+void bench_async_writer() {}
+#endif
+
+int vector_write(void* ctx, uint8_t* data, size_t size) {
+    return ((Vector<uint8_t>*)ctx)->push_many(data, size) == nullptr ? 1 : 0;
+}
+
+// Writing packets into a log and jumping around in it, against reading every packet up to the one that is looked for
+void bench_log() {
+    const size_t packets = 1 << 16;
+    const size_t seeks = 1024;
+    Vector<uint8_t> log(&allocator);
+    Writer writer{};
+    writer.write_callback = vector_write;
+    writer.ctx = &log;
+    uint8_t packet[64];
+    Serializer measure(packet, sizeof(packet));
+    for (size_t i = 0; i < 16; i++) {
+        measure.serialize_uint32((uint32_t)mixed_value(i, 32), uint32_default_options());
+    }
+    measure.finalize();
+    size_t packet_size = measure.size();
+
+    bench_run("log/write", packets, packets * packet_size, [&]() {
+        log.clear();
+        LogWriter log_writer(&writer, &allocator);
+        for (size_t i = 0; i < packets; i++) {
+            log_writer.write_packet(packet, packet_size, i * 1000);
+        }
+        log_writer.finish();
+    });
+
+    LogReader reader(log.ptr(), log.length(), &allocator);
+    reader.open();
+    bench_run("log/seek_packet", seeks, 0, [&]() {
+        LogPacket result{};
+        for (size_t i = 0; i < seeks; i++) {
+            reader.seek_packet(mixed_value(i, 16) % packets);
+            reader.next(&result);
+        }
+        bench_keep(result.number);
+    });
+    bench_run("log/seek_timestamp", seeks, 0, [&]() {
+        LogPacket result{};
+        for (size_t i = 0; i < seeks; i++) {
+            reader.seek_timestamp(mixed_value(i, 26) % (packets * 1000));
+            reader.next(&result);
+        }
+        bench_keep(result.number);
+    });
+    bench_run("log/scan", packets, log.length(), [&]() {
+        reader.seek_packet(0);
+        LogPacket result{};
+        while (reader.next(&result).status == ResultStatus::Success) {}
+        bench_keep(result.number);
+    });
+}
+
+// a packet of 16 values for every client
+Result encode_client_packet(Serializer* serializer, size_t index, void* ctx) {
+    (void)ctx;
+    Result result(ResultStatus::Success);
+    for (size_t i = 0; i < 16 && result.status == ResultStatus::Success; i++) {
+        result = serializer->serialize_uint32((uint32_t)mixed_value(index * 16 + i, 32), uint32_default_options());
+    }
+    return result;
+}
+
+// A tick of packets for many clients, one by one on a single thread against a BatchEncoder with more and more threads
+void bench_batch_encoder() {
+    const size_t clients = 4096;
+    Writer writer{};
+    writer.write_callback = null_write;
+    bench_run("batch/sequential", clients, 0, [&]() {
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(FlushPolicy::Finalize);
+        for (size_t i = 0; i < clients; i++) {
+            encode_client_packet(&serializer, i, nullptr);
+            serializer.finalize();
+        }
+    });
+    const size_t thread_counts[] = { 1, 2, 4, 8, 16 };
+    char name[64];
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        BatchEncoder encoder(&allocator, thread_counts[i], 1 << 20);
+        snprintf(name, sizeof(name), "batch/threads:%zu", thread_counts[i]);
+        bench_run(name, clients, 0, [&]() {
+            encoder.encode(clients, encode_client_packet, nullptr);
+        });
+    }
+}
+
+Result decode_client_packet(Deserializer* deserializer, const LogPacket& packet, size_t worker, void* ctx) {
+    (void)packet;
+    (void)worker;
+    (void)ctx;
+    uint32_t value = 0;
+    Result result(ResultStatus::Success);
+    for (size_t i = 0; i < 16 && result.status == ResultStatus::Success; i++) {
+        result = deserializer->deserialize_uint32(uint32_default_options(), &value);
+    }
+    bench_keep(value);
+    return result;
+}
+
+// Decoding every packet of a log, one by one with a LogReader against a LogDecoder with more and more threads
+void bench_log_decoder() {
+    const size_t packets = 1 << 16;
+    Vector<uint8_t> log(&allocator);
+    Writer writer{};
+    writer.write_callback = vector_write;
+    writer.ctx = &log;
+    LogWriter log_writer(&writer, &allocator);
+    uint8_t packet[128];
+    for (size_t i = 0; i < packets; i++) {
+        Serializer serializer(packet, sizeof(packet));
+        encode_client_packet(&serializer, i, nullptr);
+        serializer.finalize();
+        log_writer.write_packet(packet, serializer.size(), i);
+    }
+    log_writer.finish();
+    LogReader reader(log.ptr(), log.length(), &allocator);
+    reader.open();
+
+    bench_run("log_decoder/sequential", packets, log.length(), [&]() {
+        reader.seek_packet(0);
+        LogPacket result;
+        while (reader.next(&result).status == ResultStatus::Success) {
+            Deserializer deserializer(result.data, result.size);
+            decode_client_packet(&deserializer, result, 0, nullptr);
+        }
+    });
+    const size_t thread_counts[] = { 1, 2, 4, 8, 16 };
+    char name[64];
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+        LogDecoder decoder(&allocator, thread_counts[i]);
+        snprintf(name, sizeof(name), "log_decoder/threads:%zu", thread_counts[i]);
+        bench_run(name, packets, log.length(), [&]() {
+            decoder.decode(&reader, decode_client_packet, nullptr);
+        });
+    }
+}
+
+#ifdef PACKET_MASTER_COROUTINES
+DecodeTask decode_stream_values(StreamDeserializer* stream, PreparedUintOptions options, uint32_t* value) {
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        Result result = co_await stream->uint32(options, value);
+        if (result.status != ResultStatus::Success) {
+            co_return result;
+        }
+    }
+    co_return Result(ResultStatus::Success);
+}
+
+// Decoding values while they arrive in pieces of a packet size and smaller, against decoding them once all of them arrived
+void bench_stream_deserializer() {
+    PreparedUintOptions options = uint32_default_options();
+    Serializer serializer(buffer, sizeof(buffer));
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        serializer.serialize_uint32((uint32_t)mixed_value(i, 32), options);
+    }
+    serializer.finalize();
+    size_t size = serializer.size();
+
+    bench_run("stream/memory", BENCH_VALUES, size, [&]() {
+        Deserializer deserializer(buffer, size);
+        uint32_t value = 0;
+        for (size_t i = 0; i < BENCH_VALUES; i++) {
+            deserializer.deserialize_uint32(options, &value);
+        }
+        bench_keep(value);
+    });
+    const size_t chunk_sizes[] = { 1400, 64 };
+    char name[64];
+    for (size_t chunk_size : chunk_sizes) {
+        snprintf(name, sizeof(name), "stream/chunks:%zu", chunk_size);
+        bench_run(name, BENCH_VALUES, size, [&]() {
+            StreamDeserializer stream(&allocator);
+            uint32_t value = 0;
+            DecodeTask task = decode_stream_values(&stream, options, &value);
+            task.start();
+            for (size_t offset = 0; offset < size && !task.done(); offset += chunk_size) {
+                stream.push(buffer + offset, size - offset < chunk_size ? size - offset : chunk_size);
+            }
+            bench_keep(value);
+        });
+    }
+}
+#else
+void bench_stream_deserializer() {}
+#endif
+
+struct BenchState {
+    uint32_t id;
+    uint16_t health;
+    bool alive;
+    int32_t x;
+    int32_t y;
+    uint8_t team;
+};
+PM_FIELDS(BenchState,
+    PM_UINT(id, UintSpec<32>),
+    PM_UINT(health, UintMaxSpec<1000>),
+    PM_BOOL(alive),
+    PM_INT(x, IntRangeSpec<-5000, 5000>),
+    PM_INT(y, IntRangeSpec<-5000, 5000>),
+    PM_UINT(team, UintSpec<3, 1>)
+)
+
+// Generated field code against the same fields written by hand with runtime options, a value is a whole struct
+void bench_fields() {
+    const size_t count = BENCH_VALUES / 4;
+    BenchState state = { 70000, 999, true, -4000, 17, 5 };
+    PreparedUintOptions id_options = uint32_default_options();
+    PreparedUintOptions health_options = uint16_max(1000);
+    PreparedUintOptions position_options = int32_range(-5000, 5000);
+    PreparedUintOptions team_options = uint8_max_bits(3);
+
+    Serializer measure(buffer, sizeof(buffer));
+    for (size_t i = 0; i < count; i++) {
+        state.id = (uint32_t)i;
+        serialize_fields(&measure, state);
+    }
+    measure.finalize();
+    size_t size = measure.size();
+
+    bench_run("fields/by_hand", count, size, [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < count; i++) {
+            state.id = (uint32_t)i;
+            if (serializer.serialize_uint32(state.id, id_options).status != ResultStatus::Success) break;
+            if (serializer.serialize_uint16(state.health, health_options).status != ResultStatus::Success) break;
+            if (serializer.serialize_bool(state.alive).status != ResultStatus::Success) break;
+            if (serializer.serialize_int32(state.x, position_options).status != ResultStatus::Success) break;
+            if (serializer.serialize_int32(state.y, position_options).status != ResultStatus::Success) break;
+            if (serializer.serialize_uint8(state.team, team_options).status != ResultStatus::Success) break;
+        }
+        serializer.finalize();
+    });
+    bench_run("fields/generated", count, size, [&]() {
+        Serializer serializer(buffer, sizeof(buffer));
+        for (size_t i = 0; i < count; i++) {
+            state.id = (uint32_t)i;
+            if (serialize_fields(&serializer, state).status != ResultStatus::Success) break;
+        }
+        serializer.finalize();
+    });
+    bench_run("fields/generated_deserialize", count, size, [&]() {
+        Deserializer deserializer(buffer, size);
+        BenchState result;
+        uint32_t checksum = 0;
+        for (size_t i = 0; i < count; i++) {
+            deserialize_fields(&deserializer, &result);
+            checksum += result.id;
+        }
+        bench_keep(checksum);
+    });
+}
+
+// Measuring packets of structs by serializing them into a scratch buffer against counting their size, a value is a struct
+void bench_size_counter() {
+    const size_t packets = BENCH_VALUES / 64;
+    const size_t states = 16;
+    BenchState state = { 70000, 999, true, -4000, 17, 5 };
+    static uint8_t scratch[1500];
+
+    bench_run("size/scratch_serialize", packets * states, 0, [&]() {
+        size_t total = 0;
+        for (size_t packet = 0; packet < packets; packet++) {
+            Serializer serializer(scratch, sizeof(scratch));
+            for (size_t i = 0; i < states; i++) {
+                state.id = (uint32_t)(packet * states + i);
+                serialize_fields(&serializer, state);
+            }
+            serializer.finalize();
+            total += serializer.size();
+        }
+        bench_keep(total);
+    });
+    bench_run("size/counter", packets * states, 0, [&]() {
+        SizeCounter counter;
+        for (size_t packet = 0; packet < packets; packet++) {
+            for (size_t i = 0; i < states; i++) {
+                state.id = (uint32_t)(packet * states + i);
+                serialize_fields(&counter, state);
+            }
+            counter.finalize();
+        }
+        bench_keep(counter.bytes());
+    });
+}
+
+int main(int argc, char** argv) {
+    bench_start(argc, argv);
+    bench_bool();
+    bench_uints();
+    bench_uint_specs();
+    bench_signed();
+    bench_free_bits_queue();
+    bench_bit_core();
+    bench_uint32_arrays();
+    bench_quantized_floats();
+    bench_vector_push_many();
+    bench_flush();
+    bench_packet_allocators();
+    bench_batch_encoder();
+    bench_segments();
+    bench_mapped_files();
+    bench_async_writer();
+    bench_delta();
+    bench_log();
+    bench_log_decoder();
+    bench_stream_deserializer();
+    bench_fields();
+    bench_size_counter();
+    return bench_finish();
+}
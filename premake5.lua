@@ -5,6 +5,7 @@ startproject "Tests"
 project "Tests"
     kind "ConsoleApp"
     language "C++"
+    cppdialect "C++20"
     targetdir ("bin/%{cfg.buildcfg}/%{prj.name}")
 	objdir ("bin/obj/%{cfg.buildcfg}/%{prj.name}")
 
@@ -24,6 +25,43 @@ project "Tests"
     filter "system:windows"
 		systemversion "latest"
 
+    filter "system:linux"
+        links { "pthread" }
+
+    filter "configurations:Debug"
+        warnings "Extra"
+        debugger "GDB"
+        symbols "On"
+        defines {"DEBUG"}
+    
+    filter "configurations:Release"
+        defines {"NDEBUG"}
+        optimize "On"
+
+project "Benchmarks"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++20"
+    targetdir ("bin/%{cfg.buildcfg}/%{prj.name}")
+	objdir ("bin/obj/%{cfg.buildcfg}/%{prj.name}")
+
+    files {
+        "benchmarks/**.h",
+        "benchmarks/**.cpp",
+        "src/**.h",
+        "src/**.cpp"
+    }
+
+    includedirs {
+        "src/"
+    }
+
+    filter "system:windows"
+		systemversion "latest"
+
+    filter "system:linux"
+        links { "pthread" }
+
     filter "configurations:Debug"
         warnings "Extra"
         debugger "GDB"
@@ -22,6 +22,19 @@ int Writer::write_byte(uint8_t value) {
     return this->write_callback(this->ctx, &value, 1);
 }
 
+int Writer::writev(const WriterSegment* segments, size_t count) {
+    if (this->writev_callback != nullptr) {
+        return this->writev_callback(this->ctx, segments, count);
+    }
+    for (size_t i = 0; i < count; i++) {
+        int result = this->write_callback(this->ctx, (uint8_t*)segments[i].data, segments[i].size);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return 0;
+}
+
 uint8_t* Reader::read(size_t size) {
     return this->read_callback(this->ctx, size);
 }
@@ -36,6 +49,149 @@ void Allocator::free(void* ptr, size_t size) {
     this->free_callback(ptr, size, this->ctx);
 }
 
+#if defined(__linux__) || defined(__APPLE__) || defined(__unix__)
+#define PACKET_MASTER_MMAP
+#include <sys/mman.h>
+#endif
+
+// blocks are aligned like malloc so any type can be stored in them
+#define ARENA_ALIGNMENT 16
+#define ARENA_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+ArenaAllocator::ArenaAllocator(void* memory, size_t size)
+    : m_memory((uint8_t*)memory), m_size(size), m_top(0), m_last(0), m_peak(0), m_owned(false), m_huge_pages(false) {
+    // the blocks are aligned relative to the start of the memory
+    size_t misalignment = align_up((size_t)m_memory, ARENA_ALIGNMENT) - (size_t)m_memory;
+    if (misalignment > m_size) {
+        misalignment = m_size;
+    }
+    m_memory += misalignment;
+    m_size -= misalignment;
+}
+
+ArenaAllocator::ArenaAllocator(size_t size, bool huge_pages)
+    : m_memory(nullptr), m_size(0), m_top(0), m_last(0), m_peak(0), m_owned(true), m_huge_pages(false) {
+    #ifdef PACKET_MASTER_MMAP
+        void* memory = MAP_FAILED;
+        #ifdef MAP_HUGETLB
+        if (huge_pages) {
+            // explicit huge pages have to be reserved by the system, it fails when there are none
+            size_t huge_size = align_up(size, ARENA_HUGE_PAGE_SIZE);
+            memory = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) {
+                size = huge_size;
+                m_huge_pages = true;
+            }
+        }
+        #endif
+        if (memory == MAP_FAILED) {
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                return;
+            }
+            #ifdef MADV_HUGEPAGE
+            if (huge_pages) {
+                // transparent huge pages don't need to be reserved, this is only a hint
+                madvise(memory, size, MADV_HUGEPAGE);
+            }
+            #endif
+        }
+        m_memory = (uint8_t*)memory;
+        m_size = size;
+    #else
+        (void)huge_pages;
+        m_memory = (uint8_t*)malloc(size);
+        if (m_memory != nullptr) {
+            m_size = size;
+        }
+    #endif
+}
+
+ArenaAllocator::~ArenaAllocator() {
+    if (!m_owned || m_memory == nullptr) {
+        return;
+    }
+    #ifdef PACKET_MASTER_MMAP
+        munmap(m_memory, m_size);
+    #else
+        ::free(m_memory);
+    #endif
+}
+
+static void* arena_alloc(size_t size, void* ctx) {
+    return ((ArenaAllocator*)ctx)->alloc(size);
+}
+static void* arena_realloc(void* ptr, size_t old_size, size_t new_size, void* ctx) {
+    return ((ArenaAllocator*)ctx)->realloc(ptr, old_size, new_size);
+}
+static void arena_free(void* ptr, size_t size, void* ctx) {
+    ((ArenaAllocator*)ctx)->free(ptr, size);
+}
+
+Allocator ArenaAllocator::allocator() {
+    Allocator allocator;
+    allocator.alloc_callback = arena_alloc;
+    allocator.realloc_callback = arena_realloc;
+    allocator.free_callback = arena_free;
+    allocator.ctx = this;
+    return allocator;
+}
+
+void ArenaAllocator::reset() {
+    m_top = 0;
+    m_last = 0;
+}
+
+void* ArenaAllocator::alloc(size_t size) {
+    size_t start = align_up(m_top, ARENA_ALIGNMENT);
+    if (start > m_size || size > m_size - start) {
+        return nullptr;
+    }
+    m_last = start;
+    m_top = start + size;
+    if (m_top > m_peak) {
+        m_peak = m_top;
+    }
+    return m_memory + start;
+}
+
+void* ArenaAllocator::realloc(void* ptr, size_t old_size, size_t new_size) {
+    if (ptr == nullptr) {
+        return alloc(new_size);
+    }
+    if ((uint8_t*)ptr == m_memory + m_last && m_last + old_size == m_top) {
+        // the last block grows or shrinks in place
+        if (new_size > m_size - m_last) {
+            return nullptr;
+        }
+        m_top = m_last + new_size;
+        if (m_top > m_peak) {
+            m_peak = m_top;
+        }
+        return ptr;
+    }
+    if (new_size <= old_size) {
+        return ptr;
+    }
+    void* block = alloc(new_size);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    memcpy(block, ptr, old_size);
+    return block;
+}
+
+void ArenaAllocator::free(void* ptr, size_t size) {
+    if (ptr != nullptr && (uint8_t*)ptr == m_memory + m_last && m_last + size == m_top) {
+        // only the last block can be given back, the block before it is not known anymore
+        m_top = m_last;
+    }
+}
+
 
 const char* status_to_string(ResultStatus status) {
     switch (status)
@@ -50,6 +206,14 @@ const char* status_to_string(ResultStatus status) {
         return "write_failed";
     case ResultStatus::ReadFailed:
         return "read_failed";
+    case ResultStatus::BufferFull:
+        return "buffer_full";
+    case ResultStatus::InvalidFormat:
+        return "invalid_format";
+    case ResultStatus::InvalidArgument:
+        return "invalid_argument";
+    case ResultStatus::EndOfInput:
+        return "end_of_input";
     default:
         return "unknown";
     }  
@@ -105,6 +269,15 @@ inline uint32_t bit_shift_left<uint32_t>(uint32_t a, uint32_t b) {
 }
 #endif
 
+// there is no wider type to shift in, so the shift amount is checked
+template<>
+inline uint64_t bit_shift_left<uint64_t>(uint64_t a, uint64_t b) {
+    if (b >= sizeof(a) * BYTE_SIZE) {
+        return 0;
+    }
+    return a << b;
+}
+
 
 int count_leading_zeros_uint_fallback(unsigned int num) {
     int higher_bits = 32;
@@ -123,32 +296,23 @@ int count_leading_zeros_uint_fallback(unsigned int num) {
     return higher_bits - num;
 }
 
-#ifdef _MSC_VER 
-#include <immintrin.h>
-#include <intrin0.inl.h>
-#endif
 
-// TODO: change this function to have a fixed size input and output, uint32_t
-int count_leading_zeros_uint(unsigned int num) {
-    #if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
-        // supported in clang and gcc
-        // handling zero as it is an undefined behaviour for clz
-        if (num == 0) {
-            return sizeof(num) * BYTE_SIZE;
-        }
-        else {
-            return __builtin_clz(num);
-        }
-    #elif defined(_MSC_VER) 
-        if (num == 0) {
-            return sizeof(num) * BYTE_SIZE;
-        }
-        else {
-            return __lzcnt(num);
-        }
-    #else
-        return count_leading_zeros_uint_fallback(num);
-    #endif
+int count_leading_zeros_uint64_fallback(uint64_t num) {
+    uint32_t high = (uint32_t)(num >> 32);
+    if (high != 0) {
+        return count_leading_zeros_uint_fallback(high);
+    }
+    return 32 + count_leading_zeros_uint_fallback((uint32_t)num);
+}
+
+int count_set_bits_uint64_fallback(uint64_t num) {
+    int count = 0;
+    while (num != 0) {
+        // clearing the lowest set bit
+        num &= num - 1;
+        count++;
+    }
+    return count;
 }
 
 uint64_t min(uint64_t a, uint64_t b) {
@@ -194,9 +358,6 @@ uint32_t max(uint32_t a, uint32_t b) {
     }
 }
 
-uint32_t ceil_divide(uint32_t a, uint32_t b) {
-    return (a + b - 1) / b;
-}
 uint8_t ceil_divide(uint8_t a, uint8_t b) {
     return (a + b - 1) / b;
 }
@@ -290,6 +451,20 @@ uint32_t swap_byte_order(uint32_t value){
     #endif
 }
 
+uint64_t swap_byte_order_fallback(uint64_t value) {
+    return ((uint64_t)swap_byte_order_fallback((uint32_t)value) << (BYTE_SIZE * 4)) | (uint64_t)swap_byte_order_fallback((uint32_t)(value >> (BYTE_SIZE * 4)));
+}
+
+uint64_t swap_byte_order(uint64_t value){
+    #if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
+        return __builtin_bswap64(value);
+    #elif defined(_MSC_VER)
+        return (uint64_t)_byteswap_uint64(value);
+    #else
+        return swap_byte_order_fallback(value);
+    #endif
+}
+
 
 uint16_t native_endianness_to_little_endian(uint16_t value) {
     if (detect_endianness() == BigEndian) {
@@ -309,6 +484,15 @@ uint32_t native_endianness_to_little_endian(uint32_t value) {
     }
 }
 
+uint64_t native_endianness_to_little_endian(uint64_t value) {
+    if (detect_endianness() == BigEndian) {
+        return swap_byte_order(value);
+    }
+    else {
+        return value;
+    }
+}
+
 uint16_t little_endian_to_native_endianness(uint16_t value) {
     if (detect_endianness() == BigEndian) {
         return swap_byte_order(value);
@@ -325,15 +509,321 @@ uint32_t little_endian_to_native_endianness(uint32_t value) {
         return value;
     }
 }
-
-uint32_t count_used_bits_uint32(uint32_t value) {
-    return (uint32_t)(sizeof(unsigned int) * BYTE_SIZE - count_leading_zeros_uint((unsigned int)value));
+uint64_t little_endian_to_native_endianness(uint64_t value) {
+    if (detect_endianness() == BigEndian) {
+        return swap_byte_order(value);
+    }
+    else {
+        return value;
+    }
 }
 
+
 uint32_t closest_power_of_two(uint32_t value) {
     return 1 << count_used_bits_uint32(value - 1);
 }
 
+// Bulk packing of single segment values, every value is stored in its lowest `value_bytes` bytes in little endian.
+// The SIMD kernels are picked by the instruction sets enabled at compile time (e.g. -mssse3 or -mavx2),
+// anything they don't handle goes through the scalar loops.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PACKET_MASTER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__) || defined(__AVX2__)
+#define PACKET_MASTER_SSSE3
+#include <tmmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define PACKET_MASTER_AVX2
+#include <immintrin.h>
+#endif
+
+static void pack_uint32_values(const uint32_t* values, size_t count, uint32_t value_bytes, uint8_t* out) {
+    size_t i = 0;
+    if (value_bytes == sizeof(uint32_t) && detect_endianness() == LittleEndian) {
+        memcpy(out, values, count * sizeof(uint32_t));
+        return;
+    }
+    #ifdef PACKET_MASTER_AVX2
+    if (value_bytes == 1) {
+        const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+        // the packs work within 128 bit lanes, the permute puts the 4 byte groups back in order
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        for (; i + 32 <= count; i += 32) {
+            __m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(values + i)), byte_mask);
+            __m256i b = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(values + i + 8)), byte_mask);
+            __m256i c = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(values + i + 16)), byte_mask);
+            __m256i d = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(values + i + 24)), byte_mask);
+            __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_permutevar8x32_epi32(packed, order));
+        }
+    }
+    else if (value_bytes == 2) {
+        for (; i + 16 <= count; i += 16) {
+            // sign extending the low half so the signed saturation keeps it as is
+            __m256i a = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_loadu_si256((const __m256i*)(values + i)), 16), 16);
+            __m256i b = _mm256_srai_epi32(_mm256_slli_epi32(_mm256_loadu_si256((const __m256i*)(values + i + 8)), 16), 16);
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+            _mm256_storeu_si256((__m256i*)(out + i * 2), packed);
+        }
+    }
+    else if (value_bytes == 3) {
+        const __m256i shuffle = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        const __m256i order = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+        // every store writes 32 bytes but only 24 of them belong to these values
+        for (; i + 11 <= count; i += 8) {
+            __m256i packed = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*)(values + i)), shuffle);
+            _mm256_storeu_si256((__m256i*)(out + i * 3), _mm256_permutevar8x32_epi32(packed, order));
+        }
+    }
+    #endif
+    #ifdef PACKET_MASTER_SSE2
+    if (value_bytes == 1) {
+        const __m128i byte_mask = _mm_set1_epi32(0xFF);
+        for (; i + 16 <= count; i += 16) {
+            __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(values + i)), byte_mask);
+            __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(values + i + 4)), byte_mask);
+            __m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i*)(values + i + 8)), byte_mask);
+            __m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i*)(values + i + 12)), byte_mask);
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+        }
+    }
+    else if (value_bytes == 2) {
+        for (; i + 8 <= count; i += 8) {
+            __m128i a = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i*)(values + i)), 16), 16);
+            __m128i b = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128((const __m128i*)(values + i + 4)), 16), 16);
+            _mm_storeu_si128((__m128i*)(out + i * 2), _mm_packs_epi32(a, b));
+        }
+    }
+    #endif
+    #ifdef PACKET_MASTER_SSSE3
+    if (value_bytes == 3) {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        // every store writes 16 bytes but only 12 of them belong to these values
+        for (; i + 6 <= count; i += 4) {
+            __m128i packed = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(values + i)), shuffle);
+            _mm_storeu_si128((__m128i*)(out + i * 3), packed);
+        }
+    }
+    #endif
+    // full width stores, the extra bytes are overwritten by the next values
+    for (; i * value_bytes + sizeof(uint32_t) <= count * value_bytes; i++) {
+        uint32_t little_endian = native_endianness_to_little_endian(values[i]);
+        memcpy(out + i * value_bytes, &little_endian, sizeof(uint32_t));
+    }
+    for (; i < count; i++) {
+        uint32_t little_endian = native_endianness_to_little_endian(values[i]);
+        memcpy(out + i * value_bytes, &little_endian, value_bytes);
+    }
+}
+
+static void unpack_uint32_values(const uint8_t* in, size_t count, uint32_t value_bytes, uint32_t mask, uint32_t* values) {
+    size_t i = 0;
+    #ifdef PACKET_MASTER_AVX2
+    const __m256i value_mask = _mm256_set1_epi32((int)mask);
+    if (value_bytes == 1) {
+        for (; i + 8 <= count; i += 8) {
+            __m256i widened = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(in + i)));
+            _mm256_storeu_si256((__m256i*)(values + i), _mm256_and_si256(widened, value_mask));
+        }
+    }
+    else if (value_bytes == 2) {
+        for (; i + 8 <= count; i += 8) {
+            __m256i widened = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(in + i * 2)));
+            _mm256_storeu_si256((__m256i*)(values + i), _mm256_and_si256(widened, value_mask));
+        }
+    }
+    else if (value_bytes == 3) {
+        // moving 12 bytes into each lane and then spreading them into 4 byte values
+        const __m256i order = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+        const __m256i shuffle = _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        // every load reads 32 bytes but only 24 of them belong to these values
+        for (; i + 11 <= count; i += 8) {
+            __m256i bytes = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(in + i * 3)), order);
+            __m256i widened = _mm256_shuffle_epi8(bytes, shuffle);
+            _mm256_storeu_si256((__m256i*)(values + i), _mm256_and_si256(widened, value_mask));
+        }
+    }
+    else if (value_bytes == 4) {
+        for (; i + 8 <= count; i += 8) {
+            __m256i loaded = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+            _mm256_storeu_si256((__m256i*)(values + i), _mm256_and_si256(loaded, value_mask));
+        }
+    }
+    #endif
+    #ifdef PACKET_MASTER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sse_value_mask = _mm_set1_epi32((int)mask);
+    if (value_bytes == 1) {
+        for (; i + 16 <= count; i += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128((__m128i*)(values + i), _mm_and_si128(_mm_unpacklo_epi16(low, zero), sse_value_mask));
+            _mm_storeu_si128((__m128i*)(values + i + 4), _mm_and_si128(_mm_unpackhi_epi16(low, zero), sse_value_mask));
+            _mm_storeu_si128((__m128i*)(values + i + 8), _mm_and_si128(_mm_unpacklo_epi16(high, zero), sse_value_mask));
+            _mm_storeu_si128((__m128i*)(values + i + 12), _mm_and_si128(_mm_unpackhi_epi16(high, zero), sse_value_mask));
+        }
+    }
+    else if (value_bytes == 2) {
+        for (; i + 8 <= count; i += 8) {
+            __m128i words = _mm_loadu_si128((const __m128i*)(in + i * 2));
+            _mm_storeu_si128((__m128i*)(values + i), _mm_and_si128(_mm_unpacklo_epi16(words, zero), sse_value_mask));
+            _mm_storeu_si128((__m128i*)(values + i + 4), _mm_and_si128(_mm_unpackhi_epi16(words, zero), sse_value_mask));
+        }
+    }
+    else if (value_bytes == 4) {
+        for (; i + 4 <= count; i += 4) {
+            __m128i loaded = _mm_loadu_si128((const __m128i*)(in + i * 4));
+            _mm_storeu_si128((__m128i*)(values + i), _mm_and_si128(loaded, sse_value_mask));
+        }
+    }
+    #endif
+    #ifdef PACKET_MASTER_SSSE3
+    if (value_bytes == 3) {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        // every load reads 16 bytes but only 12 of them belong to these values
+        for (; i + 6 <= count; i += 4) {
+            __m128i widened = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + i * 3)), shuffle);
+            _mm_storeu_si128((__m128i*)(values + i), _mm_and_si128(widened, sse_value_mask));
+        }
+    }
+    #endif
+    // full width loads, the mask removes the bytes of the next values
+    for (; i * value_bytes + sizeof(uint32_t) <= count * value_bytes; i++) {
+        uint32_t little_endian;
+        memcpy(&little_endian, in + i * value_bytes, sizeof(uint32_t));
+        values[i] = little_endian_to_native_endianness(little_endian) & mask;
+    }
+    for (; i < count; i++) {
+        uint32_t little_endian = 0;
+        memcpy(&little_endian, in + i * value_bytes, value_bytes);
+        values[i] = little_endian_to_native_endianness(little_endian) & mask;
+    }
+}
+
+static void pack_uint16_values(const uint16_t* values, size_t count, uint32_t value_bytes, uint8_t* out) {
+    size_t i = 0;
+    if (value_bytes == sizeof(uint16_t) && detect_endianness() == LittleEndian) {
+        memcpy(out, values, count * sizeof(uint16_t));
+        return;
+    }
+    #ifdef PACKET_MASTER_SSE2
+    if (value_bytes == 1) {
+        const __m128i byte_mask = _mm_set1_epi16(0xFF);
+        for (; i + 16 <= count; i += 16) {
+            __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(values + i)), byte_mask);
+            __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(values + i + 8)), byte_mask);
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+        }
+    }
+    #endif
+    for (; i < count; i++) {
+        uint16_t little_endian = native_endianness_to_little_endian(values[i]);
+        memcpy(out + i * value_bytes, &little_endian, value_bytes);
+    }
+}
+
+static void unpack_uint16_values(const uint8_t* in, size_t count, uint32_t value_bytes, uint16_t mask, uint16_t* values) {
+    size_t i = 0;
+    #ifdef PACKET_MASTER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i value_mask = _mm_set1_epi16((short)mask);
+    if (value_bytes == 1) {
+        for (; i + 16 <= count; i += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i*)(in + i));
+            _mm_storeu_si128((__m128i*)(values + i), _mm_and_si128(_mm_unpacklo_epi8(bytes, zero), value_mask));
+            _mm_storeu_si128((__m128i*)(values + i + 8), _mm_and_si128(_mm_unpackhi_epi8(bytes, zero), value_mask));
+        }
+    }
+    else if (value_bytes == 2) {
+        for (; i + 8 <= count; i += 8) {
+            __m128i loaded = _mm_loadu_si128((const __m128i*)(in + i * 2));
+            _mm_storeu_si128((__m128i*)(values + i), _mm_and_si128(loaded, value_mask));
+        }
+    }
+    #endif
+    for (; i < count; i++) {
+        uint16_t little_endian = 0;
+        memcpy(&little_endian, in + i * value_bytes, value_bytes);
+        values[i] = little_endian_to_native_endianness(little_endian) & mask;
+    }
+}
+
+// Quantization of floats to steps in a range, the scalar quantize_float and dequantize_float are in the header.
+// The kernels do the same operations in the same order as the scalar functions so both produce the same steps.
+static void quantize_float_values(const float* values, size_t count, const PreparedFloatOptions& options, uint32_t* steps) {
+    size_t i = 0;
+    #ifdef PACKET_MASTER_AVX2
+    {
+        const __m256 min_value = _mm256_set1_ps(options.min);
+        const __m256 max_value = _mm256_set1_ps(options.max);
+        const __m256 scale = _mm256_set1_ps(options.scale);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256i max_step = _mm256_set1_epi32((int)options.max_step);
+        for (; i + 8 <= count; i += 8) {
+            __m256 clamped = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(values + i), min_value), max_value);
+            __m256 scaled = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(clamped, min_value), scale), half);
+            __m256i step = _mm256_min_epi32(_mm256_cvttps_epi32(scaled), max_step);
+            _mm256_storeu_si256((__m256i*)(steps + i), step);
+        }
+    }
+    #endif
+    #ifdef PACKET_MASTER_SSE2
+    {
+        const __m128 min_value = _mm_set1_ps(options.min);
+        const __m128 max_value = _mm_set1_ps(options.max);
+        const __m128 scale = _mm_set1_ps(options.scale);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i max_step = _mm_set1_epi32((int)options.max_step);
+        for (; i + 4 <= count; i += 4) {
+            __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(values + i), min_value), max_value);
+            __m128 scaled = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(clamped, min_value), scale), half);
+            __m128i step = _mm_cvttps_epi32(scaled);
+            // there is no 32 bit min before SSE4.1, the steps are below 2^31 so the signed compare works
+            __m128i above = _mm_cmpgt_epi32(step, max_step);
+            step = _mm_or_si128(_mm_and_si128(above, max_step), _mm_andnot_si128(above, step));
+            _mm_storeu_si128((__m128i*)(steps + i), step);
+        }
+    }
+    #endif
+    for (; i < count; i++) {
+        steps[i] = quantize_float(values[i], options);
+    }
+}
+
+static void dequantize_float_values(const uint32_t* steps, size_t count, const PreparedFloatOptions& options, float* values) {
+    size_t i = 0;
+    #ifdef PACKET_MASTER_AVX2
+    {
+        const __m256 min_value = _mm256_set1_ps(options.min);
+        const __m256 step_size = _mm256_set1_ps(options.step_size);
+        for (; i + 8 <= count; i += 8) {
+            __m256 step = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(steps + i)));
+            _mm256_storeu_ps(values + i, _mm256_add_ps(min_value, _mm256_mul_ps(step, step_size)));
+        }
+    }
+    #endif
+    #ifdef PACKET_MASTER_SSE2
+    {
+        const __m128 min_value = _mm_set1_ps(options.min);
+        const __m128 step_size = _mm_set1_ps(options.step_size);
+        for (; i + 4 <= count; i += 4) {
+            __m128 step = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(steps + i)));
+            _mm_storeu_ps(values + i, _mm_add_ps(min_value, _mm_mul_ps(step, step_size)));
+        }
+    }
+    #endif
+    for (; i < count; i++) {
+        values[i] = dequantize_float(steps[i], options);
+    }
+}
+
 PreparedUintOptions uint8_default_options() {
     UintOptions options;
     options.max_bits = sizeof(uint8_t) * BYTE_SIZE;
@@ -383,6 +873,54 @@ PreparedUintOptions uint32_max(uint32_t number) {
     return uint32_max_bits(count_used_bits_uint32(number));
 }
 
+PreparedUintOptions uint64_default_options() {
+    UintOptions options;
+    options.max_bits = sizeof(uint64_t) * BYTE_SIZE;
+    options.segments_hint = 0; // default behaviour
+    return prepare_uint_options(options);
+}
+PreparedUintOptions uint64_max_bits(uint32_t bits) {
+    UintOptions options;
+    options.max_bits = bits;
+    options.segments_hint = 0; // default behaviour
+    return prepare_uint_options(options);
+}
+PreparedUintOptions uint64_max(uint64_t number) {
+    return uint64_max_bits(count_used_bits_uint64(number));
+}
+
+PreparedUintOptions int8_default_options() {
+    return uint8_default_options();
+}
+PreparedUintOptions int8_range(int8_t min, int8_t max) {
+    assert(min <= max);
+    return uint8_max_bits(int_range_bits_constexpr(min, max));
+}
+
+PreparedUintOptions int16_default_options() {
+    return uint16_default_options();
+}
+PreparedUintOptions int16_range(int16_t min, int16_t max) {
+    assert(min <= max);
+    return uint16_max_bits(int_range_bits_constexpr(min, max));
+}
+
+PreparedUintOptions int32_default_options() {
+    return uint32_default_options();
+}
+PreparedUintOptions int32_range(int32_t min, int32_t max) {
+    assert(min <= max);
+    return uint32_max_bits(int_range_bits_constexpr(min, max));
+}
+
+PreparedUintOptions int64_default_options() {
+    return uint64_default_options();
+}
+PreparedUintOptions int64_range(int64_t min, int64_t max) {
+    assert(min <= max);
+    return uint64_max_bits(int_range_bits_constexpr(min, max));
+}
+
 PreparedUintOptions prepare_uint_options(UintOptions options) {
     PreparedUintOptions result;
     result.max_bits = options.max_bits;
@@ -399,7 +937,13 @@ PreparedUintOptions prepare_uint_options(UintOptions options) {
 }
 
 Serializer::Serializer(Writer* writer, Allocator* allocator) 
-    : m_writer(writer), m_start_index(0), m_buffer(allocator), m_free_bits(allocator) {
+    : m_writer(writer), m_start_index(0), m_flushed_count(0), m_flush_policy(FlushPolicy::PerValue), m_flush_threshold(0), m_buffer(allocator), m_free_bits(),
+    m_pending_bits(0), m_pending_count(0), m_free_bit_count(0), m_segments() {
+}
+
+Serializer::Serializer(uint8_t* buffer, size_t capacity)
+    : m_writer(nullptr), m_start_index(0), m_flushed_count(0), m_flush_policy(FlushPolicy::Finalize), m_flush_threshold(0), m_buffer(buffer, capacity), m_free_bits(),
+    m_pending_bits(0), m_pending_count(0), m_free_bit_count(0), m_segments() {
 }
 
 Serializer::~Serializer() {}
@@ -409,378 +953,1109 @@ Result Serializer::serialize_uint8(uint8_t value, PreparedUintOptions options) {
     uint32_t used_bits = count_used_bits_uint32((uint32_t)value);
     assert(used_bits <= options.max_bits);
 
-    uint32_t used_big_segments = min(options.big_segment_count, ceil_divide(used_bits, options.big_segment_size));
-    uint32_t used_segments = used_big_segments;
-    uint32_t used_bits_by_big_segments = used_big_segments * options.big_segment_size;
-    uint32_t final_used_bits = used_bits_by_big_segments;
-    if (used_bits_by_big_segments < used_bits) {
-        uint32_t used_small_segments = ceil_divide(used_bits - used_bits_by_big_segments, options.small_segment_size);
-        used_segments += used_small_segments;
-        final_used_bits += used_small_segments * options.small_segment_size;
-    }
-
-    Result result = push_bits(used_segments - 1, options.segments_storage_size);
+    UintEncoding encoding = encode_uint(used_bits, options);
+    assert(encoding.used_bits <= sizeof(uint8_t) * BYTE_SIZE);
+    Result result = push_uint((uint64_t)value, encoding.used_segments - 1, options.segments_storage_size, encoding.used_bits);
     if (result.status != ResultStatus::Success) {
         return result;
     }
-
-    assert(final_used_bits <= sizeof(uint8_t) * BYTE_SIZE);
-    if (m_buffer.push(value) == nullptr) {
-        return Result(ResultStatus::MemoryAllocationFailed);
-    }
-
-    uint32_t free_bits_start = final_used_bits % BYTE_SIZE;
-    if (free_bits_start > 0) {
-        SerializerFreeBits free_bits;
-        free_bits.start = free_bits_start;
-        free_bits.end = BYTE_SIZE;
-        free_bits.index = m_buffer.length() - 1 + m_start_index;
-        if (m_free_bits.push(free_bits) == nullptr) {
-            return Result(ResultStatus::MemoryAllocationFailed);
-        }
-    }
-    return flush_buffer();
+    return flush_if_needed();
 }
 
 Result Serializer::serialize_uint16(uint16_t value, PreparedUintOptions options) {
     assert(options.max_bits <= sizeof(value) * BYTE_SIZE);
-    uint32_t used_bits = max(count_used_bits_uint32((uint32_t)value), 1);
+    uint32_t used_bits = count_used_bits_uint32((uint32_t)value);
     assert(used_bits <= options.max_bits);
 
-    uint32_t used_big_segments = min(options.big_segment_count, ceil_divide(used_bits, options.big_segment_size));
-    uint32_t used_segments = used_big_segments;
-    uint32_t used_bits_by_big_segments = used_big_segments * options.big_segment_size;
-    uint32_t final_used_bits = used_bits_by_big_segments;
-    if (used_bits_by_big_segments < used_bits) {
-        uint32_t used_small_segments = ceil_divide(used_bits - used_bits_by_big_segments, options.small_segment_size);
-        used_segments += used_small_segments;
-        final_used_bits += used_small_segments * options.small_segment_size;
-    }
-
-    Result result = push_bits(used_segments - 1, options.segments_storage_size);
+    UintEncoding encoding = encode_uint(used_bits, options);
+    Result result = push_uint((uint64_t)value, encoding.used_segments - 1, options.segments_storage_size, encoding.used_bits);
     if (result.status != ResultStatus::Success) {
         return result;
     }
-
-    uint32_t used_bytes = ceil_divide(final_used_bits, BYTE_SIZE);
-    uint16_t little_endian = native_endianness_to_little_endian(value);
-    if (m_buffer.push_many((uint8_t*)&little_endian, (size_t)used_bytes) == nullptr) {
-        return Result(ResultStatus::MemoryAllocationFailed);
-    }
-
-    uint32_t free_bits_start = final_used_bits % BYTE_SIZE;
-    if (free_bits_start > 0) {
-        SerializerFreeBits free_bits;
-        free_bits.start = free_bits_start;
-        free_bits.end = BYTE_SIZE;
-        free_bits.index = m_buffer.length() - 1 + m_start_index;
-        if (m_free_bits.push(free_bits) == nullptr) {
-            return Result(ResultStatus::MemoryAllocationFailed);
-        }
-    }
-    return flush_buffer();
+    return flush_if_needed();
 }
 
 Result Serializer::serialize_uint32(uint32_t value, PreparedUintOptions options) {
     assert(options.max_bits <= sizeof(value) * BYTE_SIZE);
-    uint32_t used_bits = max(count_used_bits_uint32(value), 1);
+    uint32_t used_bits = count_used_bits_uint32(value);
     assert(used_bits <= options.max_bits);
 
-    uint32_t used_big_segments = min(options.big_segment_count, ceil_divide(used_bits, options.big_segment_size));
-    uint32_t used_segments = used_big_segments;
-    uint32_t used_bits_by_big_segments = used_big_segments * options.big_segment_size;
-    uint32_t final_used_bits = used_bits_by_big_segments;
-    if (used_bits_by_big_segments < used_bits) {
-        uint32_t used_small_segments = ceil_divide(used_bits - used_bits_by_big_segments, options.small_segment_size);
-        used_segments += used_small_segments;
-        final_used_bits += used_small_segments * options.small_segment_size;
+    UintEncoding encoding = encode_uint(used_bits, options);
+    Result result = push_uint((uint64_t)value, encoding.used_segments - 1, options.segments_storage_size, encoding.used_bits);
+    if (result.status != ResultStatus::Success) {
+        return result;
     }
+    return flush_if_needed();
+}
+
+Result Serializer::serialize_uint64(uint64_t value, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(value) * BYTE_SIZE);
+    uint32_t used_bits = count_used_bits_uint64(value);
+    assert(used_bits <= options.max_bits);
 
-    Result result = push_bits(used_segments - 1, options.segments_storage_size);
+    UintEncoding encoding = encode_uint(used_bits, options);
+    Result result = push_uint(value, encoding.used_segments - 1, options.segments_storage_size, encoding.used_bits);
     if (result.status != ResultStatus::Success) {
         return result;
     }
+    return flush_if_needed();
+}
 
-    uint32_t used_bytes = ceil_divide(final_used_bits, BYTE_SIZE);
-    uint32_t little_endian = native_endianness_to_little_endian(value);
-    if (m_buffer.push_many((uint8_t*)&little_endian, (size_t)used_bytes) == nullptr) {
-        return Result(ResultStatus::MemoryAllocationFailed);
-    }
+Result Serializer::serialize_int8(int8_t value, PreparedUintOptions options) {
+    return serialize_uint8(zigzag_encode_int8(value), options);
+}
 
-    uint32_t free_bits_start = final_used_bits % BYTE_SIZE;
-    if (free_bits_start > 0) {
-        SerializerFreeBits free_bits;
-        free_bits.start = free_bits_start;
-        free_bits.end = BYTE_SIZE;
-        free_bits.index = m_buffer.length() - 1 + m_start_index;
-        if (m_free_bits.push(free_bits) == nullptr) {
-            return Result(ResultStatus::MemoryAllocationFailed);
-        }
-    }
-    return flush_buffer();
+Result Serializer::serialize_int16(int16_t value, PreparedUintOptions options) {
+    return serialize_uint16(zigzag_encode_int16(value), options);
+}
+
+Result Serializer::serialize_int32(int32_t value, PreparedUintOptions options) {
+    return serialize_uint32(zigzag_encode_int32(value), options);
+}
+
+Result Serializer::serialize_int64(int64_t value, PreparedUintOptions options) {
+    return serialize_uint64(zigzag_encode_int64(value), options);
 }
 
 Result Serializer::serialize_bool(bool value) {
     return push_bit((uint8_t)value);
 }
 
-Result Serializer::finalize() {
-    m_free_bits.clear();
-    Result result = flush_buffer();
-    m_start_index = 0;
-    return result;
+// Smaller bytes are copied into the buffer, a segment costs more than copying them
+#define MIN_SEGMENT_SIZE 64
+
+Result Serializer::serialize_bytes(const uint8_t* bytes, size_t size) {
+    PACKET_MASTER_STAT(m_stats.values++);
+    PACKET_MASTER_STAT(m_stats.bits += size * BYTE_SIZE);
+    if (size >= MIN_SEGMENT_SIZE && m_writer != nullptr && m_writer->writev_callback != nullptr && !m_segments.full()) {
+        SerializerSegment segment{};
+        segment.index = m_start_index + m_buffer.length();
+        segment.data = bytes;
+        segment.size = size;
+        m_segments.push(segment);
+    }
+    else if (size > 0 && m_buffer.push_many(bytes, size) == nullptr) {
+        return buffer_push_error();
+    }
+    return flush_if_needed();
 }
 
-void Serializer::reset() {
+// The amount of values which have their encoding computed together before being written
+#define SEGMENTED_BLOCK_SIZE 16
+
+static void build_segment_table(const PreparedUintOptions& options, SegmentTable* table) {
+    for (uint32_t value_bits = 0; value_bits <= sizeof(uint32_t) * BYTE_SIZE; value_bits++) {
+        UintEncoding encoding = encode_uint(value_bits, options);
+        table->entries[value_bits] = (encoding.used_segments - 1) | (encoding.used_bits << 16);
+    }
+}
+
+// Looks up the encoding of a block of values, the amount of used bits is counted with a branchless binary search
+// which works in SIMD registers (there is no vector lzcnt before AVX-512)
+static void encode_uint32_block(const uint32_t* values, size_t count, const SegmentTable* table, uint32_t* entries) {
+    size_t i = 0;
+    #ifdef PACKET_MASTER_AVX2
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 8 <= count; i += 8) {
+        __m256i value = _mm256_loadu_si256((const __m256i*)(values + i));
+        __m256i used_bits = zero;
+        #define PACKET_MASTER_USED_BITS_STEP(shift) do {\
+            __m256i high = _mm256_srli_epi32(value, shift);\
+            __m256i has_high = _mm256_xor_si256(_mm256_cmpeq_epi32(high, zero), _mm256_set1_epi32(-1));\
+            used_bits = _mm256_add_epi32(used_bits, _mm256_and_si256(has_high, _mm256_set1_epi32(shift)));\
+            value = _mm256_blendv_epi8(value, high, has_high);\
+        } while (0)
+        PACKET_MASTER_USED_BITS_STEP(16);
+        PACKET_MASTER_USED_BITS_STEP(8);
+        PACKET_MASTER_USED_BITS_STEP(4);
+        PACKET_MASTER_USED_BITS_STEP(2);
+        PACKET_MASTER_USED_BITS_STEP(1);
+        #undef PACKET_MASTER_USED_BITS_STEP
+        // the last remaining bit, 0 or 1
+        used_bits = _mm256_add_epi32(used_bits, value);
+        __m256i encoded = _mm256_i32gather_epi32((const int*)table->entries, used_bits, 4);
+        _mm256_storeu_si256((__m256i*)(entries + i), encoded);
+    }
+    #endif
+    #ifdef PACKET_MASTER_SSE2
+    const __m128i sse_zero = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128i value = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i used_bits = sse_zero;
+        #define PACKET_MASTER_USED_BITS_STEP(shift) do {\
+            __m128i high = _mm_srli_epi32(value, shift);\
+            __m128i no_high = _mm_cmpeq_epi32(high, sse_zero);\
+            used_bits = _mm_add_epi32(used_bits, _mm_andnot_si128(no_high, _mm_set1_epi32(shift)));\
+            value = _mm_or_si128(_mm_and_si128(no_high, value), _mm_andnot_si128(no_high, high));\
+        } while (0)
+        PACKET_MASTER_USED_BITS_STEP(16);
+        PACKET_MASTER_USED_BITS_STEP(8);
+        PACKET_MASTER_USED_BITS_STEP(4);
+        PACKET_MASTER_USED_BITS_STEP(2);
+        PACKET_MASTER_USED_BITS_STEP(1);
+        #undef PACKET_MASTER_USED_BITS_STEP
+        used_bits = _mm_add_epi32(used_bits, value);
+        uint32_t counts[4];
+        _mm_storeu_si128((__m128i*)counts, used_bits);
+        entries[i] = table->entries[counts[0]];
+        entries[i + 1] = table->entries[counts[1]];
+        entries[i + 2] = table->entries[counts[2]];
+        entries[i + 3] = table->entries[counts[3]];
+    }
+    #endif
+    for (; i < count; i++) {
+        entries[i] = table->entries[count_used_bits_uint32(values[i])];
+    }
+}
+
+Result Serializer::push_segmented_uint32_values(const uint32_t* values, size_t count, PreparedUintOptions options, const SegmentTable* table) {
+    uint32_t entries[SEGMENTED_BLOCK_SIZE];
+    for (size_t block = 0; block < count; block += SEGMENTED_BLOCK_SIZE) {
+        size_t block_count = min((size_t)SEGMENTED_BLOCK_SIZE, count - block);
+        encode_uint32_block(values + block, block_count, table, entries);
+        for (size_t i = 0; i < block_count; i++) {
+            Result result = push_uint((uint64_t)values[block + i], entries[i] & 0xFFFF, options.segments_storage_size, entries[i] >> 16);
+            if (result.status != ResultStatus::Success) {
+                return result;
+            }
+        }
+    }
+    return Result(ResultStatus::Success);
+}
+
+Result Serializer::serialize_uint8_array(const uint8_t* values, size_t count, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(uint8_t) * BYTE_SIZE);
+    if (options.segments_storage_size != 0) {
+        SegmentTable table;
+        build_segment_table(options, &table);
+        // widening a block at a time so the values can share the uint32 path
+        uint32_t widened[SEGMENTED_BLOCK_SIZE];
+        for (size_t block = 0; block < count; block += SEGMENTED_BLOCK_SIZE) {
+            size_t block_count = min((size_t)SEGMENTED_BLOCK_SIZE, count - block);
+            for (size_t i = 0; i < block_count; i++) {
+                widened[i] = values[block + i];
+            }
+            Result result = push_segmented_uint32_values(widened, block_count, options, &table);
+            if (result.status != ResultStatus::Success) {
+                return result;
+            }
+        }
+        return flush_if_needed();
+    }
+    uint8_t* bytes = push_array_bytes(count, 1);
+    if (bytes == nullptr) {
+        return buffer_push_error();
+    }
+    memcpy(bytes, values, count);
+    push_array_free_bits(bytes - m_buffer.ptr() + m_start_index, count, 1, options.max_bits);
+    return flush_if_needed();
+}
+
+Result Serializer::serialize_uint16_array(const uint16_t* values, size_t count, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(uint16_t) * BYTE_SIZE);
+    if (options.segments_storage_size != 0) {
+        SegmentTable table;
+        build_segment_table(options, &table);
+        // widening a block at a time so the values can share the uint32 path
+        uint32_t widened[SEGMENTED_BLOCK_SIZE];
+        for (size_t block = 0; block < count; block += SEGMENTED_BLOCK_SIZE) {
+            size_t block_count = min((size_t)SEGMENTED_BLOCK_SIZE, count - block);
+            for (size_t i = 0; i < block_count; i++) {
+                widened[i] = values[block + i];
+            }
+            Result result = push_segmented_uint32_values(widened, block_count, options, &table);
+            if (result.status != ResultStatus::Success) {
+                return result;
+            }
+        }
+        return flush_if_needed();
+    }
+    uint32_t value_bytes = ceil_divide(options.max_bits, BYTE_SIZE);
+    uint8_t* bytes = push_array_bytes(count, value_bytes);
+    if (bytes == nullptr) {
+        return buffer_push_error();
+    }
+    pack_uint16_values(values, count, value_bytes, bytes);
+    push_array_free_bits(bytes - m_buffer.ptr() + m_start_index, count, value_bytes, options.max_bits);
+    return flush_if_needed();
+}
+
+Result Serializer::serialize_uint32_array(const uint32_t* values, size_t count, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(uint32_t) * BYTE_SIZE);
+    if (options.segments_storage_size != 0) {
+        SegmentTable table;
+        build_segment_table(options, &table);
+        Result result = push_segmented_uint32_values(values, count, options, &table);
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+        return flush_if_needed();
+    }
+    uint32_t value_bytes = ceil_divide(options.max_bits, BYTE_SIZE);
+    uint8_t* bytes = push_array_bytes(count, value_bytes);
+    if (bytes == nullptr) {
+        return buffer_push_error();
+    }
+    pack_uint32_values(values, count, value_bytes, bytes);
+    push_array_free_bits(bytes - m_buffer.ptr() + m_start_index, count, value_bytes, options.max_bits);
+    return flush_if_needed();
+}
+
+Result Serializer::serialize_float_quantized(float value, float min, float max, float precision) {
+    return serialize_float_quantized(value, float_quantized_options(min, max, precision));
+}
+
+Result Serializer::serialize_float_quantized(float value, PreparedFloatOptions options) {
+    return serialize_uint32(quantize_float(value, options), options.uint_options);
+}
+
+// The amount of floats which are quantized together before being packed
+#define FLOAT_ARRAY_BLOCK_SIZE 256
+
+Result Serializer::serialize_float_quantized_array(const float* values, size_t count, PreparedFloatOptions options) {
+    uint32_t steps[FLOAT_ARRAY_BLOCK_SIZE];
+    for (size_t i = 0; i < count; i += FLOAT_ARRAY_BLOCK_SIZE) {
+        size_t block_count = min(count - i, (size_t)FLOAT_ARRAY_BLOCK_SIZE);
+        quantize_float_values(values + i, block_count, options, steps);
+        Result result = serialize_uint32_array(steps, block_count, options.uint_options);
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+    }
+    return Result(ResultStatus::Success);
+}
+
+Result Serializer::serialize_uint8_delta(uint8_t value, uint8_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_uint8);
+}
+
+Result Serializer::serialize_uint16_delta(uint16_t value, uint16_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_uint16);
+}
+
+Result Serializer::serialize_uint32_delta(uint32_t value, uint32_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_uint32);
+}
+
+Result Serializer::serialize_uint64_delta(uint64_t value, uint64_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_uint64);
+}
+
+Result Serializer::serialize_int8_delta(int8_t value, int8_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_int8);
+}
+
+Result Serializer::serialize_int16_delta(int16_t value, int16_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_int16);
+}
+
+Result Serializer::serialize_int32_delta(int32_t value, int32_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_int32);
+}
+
+Result Serializer::serialize_int64_delta(int64_t value, int64_t baseline, PreparedUintOptions options) {
+    return serialize_delta(value, baseline, options, &Serializer::serialize_int64);
+}
+
+Result Serializer::serialize_float_quantized_delta(float value, float baseline, PreparedFloatOptions options) {
+    return serialize_delta(quantize_float(value, options), quantize_float(baseline, options), options.uint_options, &Serializer::serialize_uint32);
+}
+
+Result Serializer::finalize() {
+    place_pending_bits();
+    #ifdef PACKET_MASTER_STATS
+    while (SerializerFreeBits* free_bits = m_free_bits.first()) {
+        m_stats.padding_bits += BYTE_SIZE - free_bits->start;
+        m_free_bits.pop();
+    }
+    if (m_writer == nullptr) {
+        m_stats.bytes += m_buffer.length();
+    }
+    #endif
     m_free_bits.clear();
+    m_free_bit_count = 0;
+    Result result = flush_buffer();
+    if (result.status == ResultStatus::Success) {
+        // the indexes of the queued segments are relative to it until they are written
+        m_start_index = 0;
+    }
+    return result;
+}
+
+void Serializer::reset() {
+    m_free_bits.clear();
+    m_pending_bits = 0;
+    m_pending_count = 0;
+    m_free_bit_count = 0;
+    m_segments.clear();
     m_buffer.clear();
     m_start_index = 0;
+    m_flushed_count = 0;
+}
+
+void Serializer::set_flush_policy(FlushPolicy policy, size_t threshold) {
+    m_flush_policy = policy;
+    m_flush_threshold = threshold;
+}
+
+SerializerStats Serializer::stats() const {
+    #ifdef PACKET_MASTER_STATS
+    SerializerStats stats = m_stats;
+    stats.reallocations = m_buffer.reallocations() - m_reallocations_start;
+    return stats;
+    #else
+    return SerializerStats{};
+    #endif
+}
+
+void Serializer::reset_stats() {
+    #ifdef PACKET_MASTER_STATS
+    m_stats = {};
+    m_reallocations_start = m_buffer.reallocations();
+    #endif
 }
 
 Result Serializer::push_bit(uint8_t value) {
-    SerializerFreeBits* free_bits = nullptr;
-    Result result = get_free_bits(&free_bits);
+    PACKET_MASTER_STAT(m_stats.values++);
+    PACKET_MASTER_STAT(m_stats.bits++);
+    if (m_pending_count == sizeof(m_pending_bits) * BYTE_SIZE) {
+        place_pending_bits();
+    }
+    if (m_free_bit_count == m_pending_count) {
+        Result result = open_free_bytes(1);
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+    }
+    m_pending_bits |= (uint64_t)(value & 1) << m_pending_count;
+    m_pending_count++;
+    // when the bytes are written as they are done, a byte this bit filled is written right away
+    if (m_writer != nullptr && m_flush_policy != FlushPolicy::Finalize && place_pending_bits()) {
+        return flush_if_needed();
+    }
+    return Result(ResultStatus::Success);
+}
+
+// Writes the segments header and then the used bytes of the value, the free bits of the last byte are kept for later
+Result Serializer::push_uint(uint64_t value, uint32_t segments_header, uint32_t segments_storage_size, uint32_t used_bits) {
+    Result result = push_bits(segments_header, segments_storage_size);
     if (result.status != ResultStatus::Success) {
         return result;
     }
-    uint8_t mask = BIT_MASK(free_bits->start, value, uint8_t);
-    size_t byte_index = free_bits->index - m_start_index;
-    m_buffer[byte_index] |= mask;
-    free_bits->start++;
-    // if this byte is full then we can remove it and flush the buffer until the next free bits index
-    if (free_bits->start >= free_bits->end) {
-        if (!m_free_bits.remove(0)) {
-            return Result(ResultStatus::MemoryOperationFailed);
-        }
-        return flush_buffer();
+    return push_value_bytes(value, used_bits);
+}
+
+Result Serializer::push_value_bytes(uint64_t value, uint32_t used_bits) {
+    PACKET_MASTER_STAT(m_stats.values++);
+    PACKET_MASTER_STAT(m_stats.bits += used_bits);
+    size_t used_bytes = (used_bits + BYTE_SIZE - 1) / BYTE_SIZE;
+    uint64_t little_endian = native_endianness_to_little_endian(value);
+    if (m_buffer.push_many((uint8_t*)&little_endian, used_bytes) == nullptr) {
+        return buffer_push_error();
+    }
+
+    uint32_t free_bits_start = used_bits % BYTE_SIZE;
+    if (free_bits_start > 0) {
+        push_free_bits(m_buffer.length() - 1 + m_start_index, free_bits_start);
     }
     return Result(ResultStatus::Success);
 }
 
+// The bits wait in the pending register, the bytes they go into are opened right away so the bytes of the next values come after them.
+// The buffer is not flushed here, the caller flushes after the whole value is written.
 Result Serializer::push_bits(uint32_t value, size_t count) {
     assert(count <= sizeof(uint32_t) * BYTE_SIZE);
-    while (count > 0) {
-        SerializerFreeBits* free_bits = nullptr; 
-        Result result = get_free_bits(&free_bits);
+    if (count == 0) {
+        return Result(ResultStatus::Success);
+    }
+    PACKET_MASTER_STAT(m_stats.bits += count);
+    if (m_pending_count + count > sizeof(m_pending_bits) * BYTE_SIZE) {
+        place_pending_bits();
+    }
+    size_t unclaimed = m_free_bit_count - m_pending_count;
+    if (unclaimed < count) {
+        Result result = open_free_bytes(count - unclaimed);
         if (result.status != ResultStatus::Success) {
             return result;
         }
+    }
+    m_pending_bits |= (uint64_t)(value & BIT_MASK(0, (uint32_t)count, uint32_t)) << m_pending_count;
+    m_pending_count += (uint32_t)count;
+    return Result(ResultStatus::Success);
+}
 
-        size_t write_count = min(free_bits->end - free_bits->start, count);
-        uint8_t data = (uint8_t)(value & BIT_MASK(0, (uint32_t)write_count, uint32_t));
-        m_buffer[free_bits->index - m_start_index] |= data << free_bits->start;
-        free_bits->start += write_count;
-        value >>= write_count;
-        count -= write_count;
-
-        assert(free_bits->end >= free_bits->start);
-        if (free_bits->start >= free_bits->end) {
-            if (!m_free_bits.remove(0)) {
-                return Result(ResultStatus::MemoryOperationFailed);
-            }
-            Result result = flush_buffer();
-            if (result.status != ResultStatus::Success) {
-                return result;
-            }
+Result Serializer::open_free_bytes(size_t bit_count) {
+    for (size_t i = 0; i < bit_count; i += BYTE_SIZE) {
+        if (m_free_bits.full()) {
+            // the bytes the pending bits fill leave the queue, the rest have unclaimed bits so there is room after it
+            place_pending_bits();
         }
+        SerializerFreeBits free_bits;
+        free_bits.index = (uint32_t)(m_buffer.length() + m_start_index);
+        free_bits.start = 0;
+        if (m_buffer.push(0) == nullptr) {
+            return buffer_push_error();
+        }
+        m_free_bits.push(free_bits);
+        m_free_bit_count += BYTE_SIZE;
+        PACKET_MASTER_STAT(m_stats.free_bits_high_water = max((uint64_t)m_free_bits.length(), m_stats.free_bits_high_water));
     }
     return Result(ResultStatus::Success);
 }
 
-Result Serializer::flush_buffer() {
+bool Serializer::place_pending_bits() {
+    bool filled = false;
+    while (m_pending_count > 0) {
+        SerializerFreeBits* free_bits = m_free_bits.first();
+        assert(free_bits != nullptr);
+        uint32_t write_count = min((uint32_t)(BYTE_SIZE - free_bits->start), m_pending_count);
+        // the bits past the byte are cut off, the ones past the pending bits are zeros
+        m_buffer[free_bits->index - m_start_index] |= (uint8_t)(m_pending_bits << free_bits->start);
+        free_bits->start += (uint8_t)write_count;
+        m_pending_bits >>= write_count;
+        m_pending_count -= write_count;
+        m_free_bit_count -= write_count;
+        if (free_bits->start >= BYTE_SIZE) {
+            m_free_bits.pop();
+            filled = true;
+        }
+    }
+    return filled;
+}
+
+size_t Serializer::flushable_length() {
+    place_pending_bits();
     SerializerFreeBits* free_bits = m_free_bits.first();
     if (free_bits == nullptr) {
-        // flushing the entire buffer
-        int write_result = m_writer->write(m_buffer.ptr(), m_buffer.length());
-        if (write_result != 0) {
-            Result result{};
-            result.status = ResultStatus::WriteFailed;
-            result.error_info.write_error = write_result;
-            return result;
+        return m_buffer.length();
+    }
+    // the bytes starting at the first byte with free bits may still change
+    return free_bits->index - m_start_index;
+}
+
+Result Serializer::flush_if_needed() {
+    if (m_writer == nullptr) {
+        // the output stays in the fixed buffer
+        return Result(ResultStatus::Success);
+    }
+    switch (m_flush_policy) {
+    case FlushPolicy::PerValue:
+        return flush_buffer();
+    case FlushPolicy::Threshold:
+        if (flushable_length() - m_flushed_count >= m_flush_threshold) {
+            return flush_buffer();
         }
+        return Result(ResultStatus::Success);
+    case FlushPolicy::Finalize:
+    default:
+        return Result(ResultStatus::Success);
+    }
+}
+
+Result Serializer::flush_buffer() {
+    if (m_writer == nullptr) {
+        return Result(ResultStatus::Success);
+    }
+    PACKET_MASTER_STAT(m_stats.flushes++);
+    size_t end = flushable_length();
+    assert(end >= m_flushed_count);
+    size_t count = end - m_flushed_count;
+    int write_result = 0;
+    // the segments stay queued until they are written, a failed write is tried again with them
+    size_t written_segments = 0;
+    SerializerSegment* segment = m_segments.first();
+    if (segment != nullptr && segment->index - m_start_index <= end) {
+        // the buffered bytes between the segments and the segments themselves are written with a single call
+        WriterSegment segments[PACKET_MASTER_MAX_SEGMENTS * 2 + 1];
+        size_t segment_count = 0;
+        size_t position = m_flushed_count;
+        while (written_segments < m_segments.length() && m_segments[written_segments].index - m_start_index <= end) {
+            segment = &m_segments[written_segments];
+            size_t segment_position = segment->index - m_start_index;
+            if (segment_position > position) {
+                segments[segment_count++] = WriterSegment{ m_buffer.ptr() + position, segment_position - position };
+                position = segment_position;
+            }
+            segments[segment_count++] = WriterSegment{ segment->data, segment->size };
+            PACKET_MASTER_STAT(m_stats.bytes += segment->size);
+            written_segments++;
+        }
+        if (end > position) {
+            segments[segment_count++] = WriterSegment{ m_buffer.ptr() + position, end - position };
+        }
+        PACKET_MASTER_STAT(m_stats.writes++);
+        PACKET_MASTER_STAT(m_stats.bytes += count);
+        write_result = m_writer->writev(segments, segment_count);
+    }
+    else if (count > 0) {
+        PACKET_MASTER_STAT(m_stats.writes++);
+        PACKET_MASTER_STAT(m_stats.bytes += count);
+        write_result = m_writer->write(m_buffer.ptr() + m_flushed_count, count);
+    }
+    if (write_result != 0) {
+        Result result{};
+        result.status = ResultStatus::WriteFailed;
+        result.error_info.write_error = write_result;
+        return result;
+    }
+    for (size_t i = 0; i < written_segments; i++) {
+        m_segments.pop();
+    }
+    m_flushed_count = end;
+
+    if (m_flushed_count == m_buffer.length()) {
         m_start_index += m_buffer.length();
         m_buffer.clear();
+        m_flushed_count = 0;
     }
-    else {
-        // flushing until the free_bits index
-        size_t count = free_bits->index - m_start_index;
-        if (count > 0) {
-            int write_result = m_writer->write(m_buffer.ptr(), count);
-            if (write_result != 0) {
-                Result result{};
-                result.status = ResultStatus::WriteFailed;
-                result.error_info.write_error = write_result;
-                return result;
-            }
-            if (!m_buffer.remove_many(0, count)) {
-                return Result(ResultStatus::MemoryOperationFailed);
-            }
-            m_start_index = free_bits->index;
+    else if (m_flushed_count * 2 >= m_buffer.length()) {
+        // the written bytes are only removed once they are at least half of the buffer
+        // so the remaining bytes are moved a constant amount of times on average
+        if (!m_buffer.remove_many(0, m_flushed_count)) {
+            return Result(ResultStatus::MemoryOperationFailed);
         }
+        m_start_index += m_flushed_count;
+        m_flushed_count = 0;
     }
     return Result(ResultStatus::Success);
 }
 
-Result Serializer::get_free_bits(SerializerFreeBits** out_free_bits) {
-   SerializerFreeBits* free_bits = m_free_bits.first();
-   if (free_bits == nullptr) {
-        SerializerFreeBits value{};
-        value.start = 0;
-        value.end = BYTE_SIZE;
-        value.index = m_buffer.length() + m_start_index;
-        uint8_t* pushed = m_buffer.push(0);
-        free_bits = m_free_bits.push(value);
-        if (free_bits == nullptr || pushed == nullptr) {
-            return Result(ResultStatus::MemoryAllocationFailed);
-        }
+uint8_t* Serializer::push_array_bytes(size_t count, uint32_t value_bytes) {
+    return m_buffer.extend(count * value_bytes);
+}
+
+void Serializer::push_array_free_bits(size_t byte_index, size_t count, uint32_t value_bytes, uint32_t max_bits) {
+    PACKET_MASTER_STAT(m_stats.values += count);
+    PACKET_MASTER_STAT(m_stats.bits += count * max_bits);
+    uint32_t free_bits_start = max_bits % BYTE_SIZE;
+    if (free_bits_start == 0) {
+        return;
+    }
+    // only the last values can still be in the queue, the older ones would be closed by the newer ones
+    size_t first = count > m_free_bits.capacity() ? count - m_free_bits.capacity() : 0;
+    PACKET_MASTER_STAT(m_stats.padding_bits += first * (BYTE_SIZE - free_bits_start));
+    for (size_t i = first; i < count; i++) {
+        push_free_bits(byte_index + i * value_bytes + value_bytes - 1, free_bits_start);
+    }
+}
+
+Result Serializer::buffer_push_error() const {
+    if (m_buffer.fixed()) {
+        return Result(ResultStatus::BufferFull);
     }
-    *out_free_bits = free_bits;
+    return Result(ResultStatus::MemoryAllocationFailed);
+}
+
+void Serializer::push_free_bits(size_t byte_index, uint32_t start) {
+    assert(byte_index <= UINT32_MAX);
+    if (m_free_bits.full()) {
+        // the pending bits may go into the oldest byte
+        place_pending_bits();
+    }
+    if (m_free_bits.full()) {
+        // closing the oldest byte, the rest of its bits are left as padding
+        PACKET_MASTER_STAT(m_stats.padding_bits += BYTE_SIZE - m_free_bits.first()->start);
+        m_free_bit_count -= BYTE_SIZE - m_free_bits.first()->start;
+        m_free_bits.pop();
+    }
+    SerializerFreeBits free_bits;
+    free_bits.index = (uint32_t)byte_index;
+    free_bits.start = (uint8_t)start;
+    m_free_bits.push(free_bits);
+    m_free_bit_count += BYTE_SIZE - start;
+    PACKET_MASTER_STAT(m_stats.free_bits_high_water = max((uint64_t)m_free_bits.length(), m_stats.free_bits_high_water));
+}
+
+
+SizeCounter::SizeCounter() : m_free_bits(), m_bytes(0), m_bits(0) {}
+
+Result SizeCounter::serialize_uint8(uint8_t value, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(value) * BYTE_SIZE);
+    push_uint(count_used_bits_uint32((uint32_t)value), options);
+    return Result(ResultStatus::Success);
+}
+
+Result SizeCounter::serialize_uint16(uint16_t value, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(value) * BYTE_SIZE);
+    push_uint(count_used_bits_uint32((uint32_t)value), options);
     return Result(ResultStatus::Success);
 }
 
+Result SizeCounter::serialize_uint32(uint32_t value, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(value) * BYTE_SIZE);
+    push_uint(count_used_bits_uint32(value), options);
+    return Result(ResultStatus::Success);
+}
 
+Result SizeCounter::serialize_uint64(uint64_t value, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(value) * BYTE_SIZE);
+    push_uint(count_used_bits_uint64(value), options);
+    return Result(ResultStatus::Success);
+}
 
-Deserializer::Deserializer(Reader* reader, Allocator* allocator) : m_reader(reader), m_allocator(allocator), m_free_bits(allocator) {}
+Result SizeCounter::serialize_int8(int8_t value, PreparedUintOptions options) {
+    return serialize_uint8(zigzag_encode_int8(value), options);
+}
 
-Deserializer::~Deserializer() {}
+Result SizeCounter::serialize_int16(int16_t value, PreparedUintOptions options) {
+    return serialize_uint16(zigzag_encode_int16(value), options);
+}
 
-Result Deserializer::deserialize_uint8(PreparedUintOptions options, uint8_t* value) {
-    *value = 0;
-    uint32_t used_segments;
-    Result result = read_bits(options.segments_storage_size, &used_segments);
-    used_segments += 1;
-    if (result.status != ResultStatus::Success) {
-        return result;
+Result SizeCounter::serialize_int32(int32_t value, PreparedUintOptions options) {
+    return serialize_uint32(zigzag_encode_int32(value), options);
+}
+
+Result SizeCounter::serialize_int64(int64_t value, PreparedUintOptions options) {
+    return serialize_uint64(zigzag_encode_int64(value), options);
+}
+
+Result SizeCounter::serialize_bool(bool value) {
+    (void)value;
+    push_bit();
+    return Result(ResultStatus::Success);
+}
+
+// An array of single segment values is as many bytes as its values and the free bits of the last ones
+void SizeCounter::push_array(size_t count, PreparedUintOptions options) {
+    uint32_t value_bytes = ceil_divide(options.max_bits, BYTE_SIZE);
+    m_bytes += count * value_bytes;
+    m_bits += count * options.max_bits;
+    uint32_t free_bits_start = options.max_bits % BYTE_SIZE;
+    if (free_bits_start == 0) {
+        return;
     }
-    
-    uint32_t used_bits;
-    if (used_segments > options.big_segment_count) {
-        uint32_t used_small_segments = used_segments - options.big_segment_count;
-        used_bits = options.big_segment_count * options.big_segment_size + used_small_segments * options.small_segment_size;
+    size_t first = count > m_free_bits.capacity() ? count - m_free_bits.capacity() : 0;
+    for (size_t i = first; i < count; i++) {
+        push_free_bits(free_bits_start);
     }
-    else {
-        used_bits = used_segments * options.big_segment_size;
+}
+
+Result SizeCounter::serialize_uint8_array(const uint8_t* values, size_t count, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(uint8_t) * BYTE_SIZE);
+    if (options.segments_storage_size == 0) {
+        push_array(count, options);
+        return Result(ResultStatus::Success);
+    }
+    for (size_t i = 0; i < count; i++) {
+        push_uint(count_used_bits_uint32(values[i]), options);
     }
-    
-    uint32_t used_bytes = ceil_divide(used_bits, BYTE_SIZE);
-    assert(used_bytes == 1); // for uint8_t
+    return Result(ResultStatus::Success);
+}
 
-    uint8_t* byte = m_reader->read((size_t)used_bytes);
-    if (byte == nullptr) {
-        return Result(ResultStatus::ReadFailed);
+Result SizeCounter::serialize_uint16_array(const uint16_t* values, size_t count, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(uint16_t) * BYTE_SIZE);
+    if (options.segments_storage_size == 0) {
+        push_array(count, options);
+        return Result(ResultStatus::Success);
     }
-    *value = *byte & BIT_MASK(0, used_bits, uint8_t);
-    uint32_t free_bits_start = used_bits % BYTE_SIZE;
-    if (free_bits_start > 0) {
-        DeserializerFreeBits free_bits;
-        free_bits.start = free_bits_start;
-        free_bits.end = BYTE_SIZE;
-        free_bits.byte = *byte;
-        if (m_free_bits.push(free_bits) == nullptr) {
-            return Result(ResultStatus::MemoryAllocationFailed);
-        }
+    for (size_t i = 0; i < count; i++) {
+        push_uint(count_used_bits_uint32(values[i]), options);
     }
     return Result(ResultStatus::Success);
 }
 
+Result SizeCounter::serialize_uint32_array(const uint32_t* values, size_t count, PreparedUintOptions options) {
+    assert(options.max_bits <= sizeof(uint32_t) * BYTE_SIZE);
+    if (options.segments_storage_size == 0) {
+        push_array(count, options);
+        return Result(ResultStatus::Success);
+    }
+    for (size_t i = 0; i < count; i++) {
+        push_uint(count_used_bits_uint32(values[i]), options);
+    }
+    return Result(ResultStatus::Success);
+}
+
+Result SizeCounter::serialize_float_quantized(float value, float min, float max, float precision) {
+    return serialize_float_quantized(value, float_quantized_options(min, max, precision));
+}
+
+Result SizeCounter::serialize_float_quantized(float value, PreparedFloatOptions options) {
+    if (options.uint_options.segment_count == 1) {
+        // every step takes the same bits
+        push_value_bytes(options.uint_options.max_bits);
+        return Result(ResultStatus::Success);
+    }
+    return serialize_uint32(quantize_float(value, options), options.uint_options);
+}
+
+Result SizeCounter::serialize_float_quantized_array(const float* values, size_t count, PreparedFloatOptions options) {
+    if (options.uint_options.segments_storage_size == 0) {
+        push_array(count, options.uint_options);
+        return Result(ResultStatus::Success);
+    }
+    for (size_t i = 0; i < count; i++) {
+        push_uint(count_used_bits_uint32(quantize_float(values[i], options)), options.uint_options);
+    }
+    return Result(ResultStatus::Success);
+}
+
+Result SizeCounter::serialize_uint8_delta(uint8_t value, uint8_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_uint8);
+}
+
+Result SizeCounter::serialize_uint16_delta(uint16_t value, uint16_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_uint16);
+}
+
+Result SizeCounter::serialize_uint32_delta(uint32_t value, uint32_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_uint32);
+}
+
+Result SizeCounter::serialize_uint64_delta(uint64_t value, uint64_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_uint64);
+}
+
+Result SizeCounter::serialize_int8_delta(int8_t value, int8_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_int8);
+}
+
+Result SizeCounter::serialize_int16_delta(int16_t value, int16_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_int16);
+}
+
+Result SizeCounter::serialize_int32_delta(int32_t value, int32_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_int32);
+}
+
+Result SizeCounter::serialize_int64_delta(int64_t value, int64_t baseline, PreparedUintOptions options) {
+    return count_delta(value, baseline, options, &SizeCounter::serialize_int64);
+}
+
+Result SizeCounter::serialize_float_quantized_delta(float value, float baseline, PreparedFloatOptions options) {
+    return count_delta(quantize_float(value, options), quantize_float(baseline, options), options.uint_options, &SizeCounter::serialize_uint32);
+}
+
+Result SizeCounter::serialize_bytes(const uint8_t* bytes, size_t size) {
+    (void)bytes;
+    m_bytes += size;
+    m_bits += (uint64_t)size * BYTE_SIZE;
+    return Result(ResultStatus::Success);
+}
+
+Result SizeCounter::finalize() {
+    m_free_bits.clear();
+    return Result(ResultStatus::Success);
+}
+
+void SizeCounter::reset() {
+    m_free_bits.clear();
+    m_bytes = 0;
+    m_bits = 0;
+}
+
+
+
+Deserializer::Deserializer(Reader* reader, Allocator* allocator)
+    : m_reader(reader), m_allocator(allocator), m_data(nullptr), m_size(0), m_offset(0), m_free_bits(),
+    m_loaded_bits(0), m_loaded_ends(0), m_loaded_count(0) {}
+
+Deserializer::Deserializer(const uint8_t* data, size_t size)
+    : m_reader(nullptr), m_allocator(nullptr), m_data(data), m_size(size), m_offset(0), m_free_bits(),
+    m_loaded_bits(0), m_loaded_ends(0), m_loaded_count(0) {}
+
+Deserializer::~Deserializer() {}
+
+Result Deserializer::deserialize_uint8(PreparedUintOptions options, uint8_t* value) {
+    assert(options.max_bits <= sizeof(*value) * BYTE_SIZE);
+    uint64_t result_value;
+    Result result = read_uint(options, &result_value);
+    *value = (uint8_t)result_value;
+    return result;
+}
+
 Result Deserializer::deserialize_uint16(PreparedUintOptions options, uint16_t* value) {
-    *value = 0;
-    uint32_t used_segments;
-    Result result = read_bits(options.segments_storage_size, &used_segments);
-    used_segments += 1;
-    if (result.status != ResultStatus::Success) {
-        return result;
+    assert(options.max_bits <= sizeof(*value) * BYTE_SIZE);
+    uint64_t result_value;
+    Result result = read_uint(options, &result_value);
+    *value = (uint16_t)result_value;
+    return result;
+}
+
+Result Deserializer::deserialize_uint32(PreparedUintOptions options, uint32_t* value) {
+    assert(options.max_bits <= sizeof(*value) * BYTE_SIZE);
+    uint64_t result_value;
+    Result result = read_uint(options, &result_value);
+    *value = (uint32_t)result_value;
+    return result;
+}
+
+Result Deserializer::deserialize_uint64(PreparedUintOptions options, uint64_t* value) {
+    assert(options.max_bits <= sizeof(*value) * BYTE_SIZE);
+    return read_uint(options, value);
+}
+
+Result Deserializer::deserialize_int8(PreparedUintOptions options, int8_t* value) {
+    uint8_t zigzag;
+    Result result = deserialize_uint8(options, &zigzag);
+    *value = zigzag_decode_int8(zigzag);
+    return result;
+}
+
+Result Deserializer::deserialize_int16(PreparedUintOptions options, int16_t* value) {
+    uint16_t zigzag;
+    Result result = deserialize_uint16(options, &zigzag);
+    *value = zigzag_decode_int16(zigzag);
+    return result;
+}
+
+Result Deserializer::deserialize_int32(PreparedUintOptions options, int32_t* value) {
+    uint32_t zigzag;
+    Result result = deserialize_uint32(options, &zigzag);
+    *value = zigzag_decode_int32(zigzag);
+    return result;
+}
+
+Result Deserializer::deserialize_int64(PreparedUintOptions options, int64_t* value) {
+    uint64_t zigzag;
+    Result result = deserialize_uint64(options, &zigzag);
+    *value = zigzag_decode_int64(zigzag);
+    return result;
+}
+
+Result Deserializer::deserialize_bool(bool* value) {
+    return read_bit((uint8_t*)value);
+}
+
+Result Deserializer::deserialize_uint8_array(PreparedUintOptions options, uint8_t* values, size_t count) {
+    if (options.segments_storage_size != 0) {
+        for (size_t i = 0; i < count; i++) {
+            Result result = deserialize_uint8(options, values + i);
+            if (result.status != ResultStatus::Success) {
+                return result;
+            }
+        }
+        return Result(ResultStatus::Success);
+    }
+    const uint8_t* bytes = read_bytes(count);
+    if (bytes == nullptr) {
+        return Result(ResultStatus::ReadFailed);
     }
-    
-    uint32_t used_bits;
-    if (used_segments > options.big_segment_count) {
-        uint32_t used_small_segments = used_segments - options.big_segment_count;
-        used_bits = options.big_segment_count * options.big_segment_size + used_small_segments * options.small_segment_size;
+    uint8_t mask = BIT_MASK(0, options.max_bits, uint8_t);
+    for (size_t i = 0; i < count; i++) {
+        values[i] = bytes[i] & mask;
     }
-    else {
-        used_bits = used_segments * options.big_segment_size;
+    push_array_free_bits(bytes, count, 1, options.max_bits);
+    return Result(ResultStatus::Success);
+}
+
+Result Deserializer::deserialize_uint16_array(PreparedUintOptions options, uint16_t* values, size_t count) {
+    if (options.segments_storage_size != 0) {
+        for (size_t i = 0; i < count; i++) {
+            Result result = deserialize_uint16(options, values + i);
+            if (result.status != ResultStatus::Success) {
+                return result;
+            }
+        }
+        return Result(ResultStatus::Success);
     }
-    
-    uint32_t used_bytes = ceil_divide(used_bits, BYTE_SIZE);
-    uint8_t* byte = m_reader->read((size_t)used_bytes);
-    if (byte == nullptr) {
+    uint32_t value_bytes = ceil_divide(options.max_bits, BYTE_SIZE);
+    const uint8_t* bytes = read_bytes(count * value_bytes);
+    if (bytes == nullptr) {
         return Result(ResultStatus::ReadFailed);
     }
-    uint16_t little_endian = *(uint16_t*)byte & BIT_MASK(0, used_bits, uint16_t);
-    *value = little_endian_to_native_endianness(little_endian);
-    uint32_t free_bits_start = used_bits % BYTE_SIZE;
-    if (free_bits_start > 0) {
-        DeserializerFreeBits free_bits;
-        free_bits.start = free_bits_start;
-        free_bits.end = BYTE_SIZE;
-        free_bits.byte = *byte;
-        if (m_free_bits.push(free_bits) == nullptr) {
-            return Result(ResultStatus::MemoryAllocationFailed);
+    unpack_uint16_values(bytes, count, value_bytes, BIT_MASK(0, options.max_bits, uint16_t), values);
+    push_array_free_bits(bytes, count, value_bytes, options.max_bits);
+    return Result(ResultStatus::Success);
+}
+
+Result Deserializer::deserialize_uint32_array(PreparedUintOptions options, uint32_t* values, size_t count) {
+    if (options.segments_storage_size != 0) {
+        for (size_t i = 0; i < count; i++) {
+            Result result = deserialize_uint32(options, values + i);
+            if (result.status != ResultStatus::Success) {
+                return result;
+            }
         }
+        return Result(ResultStatus::Success);
+    }
+    uint32_t value_bytes = ceil_divide(options.max_bits, BYTE_SIZE);
+    const uint8_t* bytes = read_bytes(count * value_bytes);
+    if (bytes == nullptr) {
+        return Result(ResultStatus::ReadFailed);
     }
+    unpack_uint32_values(bytes, count, value_bytes, BIT_MASK(0, options.max_bits, uint32_t), values);
+    push_array_free_bits(bytes, count, value_bytes, options.max_bits);
     return Result(ResultStatus::Success);
 }
 
-Result Deserializer::deserialize_uint32(PreparedUintOptions options, uint32_t* value) {
-    *value = 0;
-    uint32_t used_segments;
-    Result result = read_bits(options.segments_storage_size, &used_segments);
-    used_segments += 1;
+Result Deserializer::deserialize_float_quantized(float min, float max, float precision, float* value) {
+    return deserialize_float_quantized(float_quantized_options(min, max, precision), value);
+}
+
+Result Deserializer::deserialize_float_quantized(PreparedFloatOptions options, float* value) {
+    uint32_t step;
+    Result result = deserialize_uint32(options.uint_options, &step);
     if (result.status != ResultStatus::Success) {
+        *value = 0.0f;
         return result;
     }
-    
+    *value = dequantize_float(step, options);
+    return result;
+}
 
-    uint32_t used_bits;
-    if (used_segments > options.big_segment_count) {
-        uint32_t used_small_segments = used_segments - options.big_segment_count;
-        used_bits = options.big_segment_count * options.big_segment_size + used_small_segments * options.small_segment_size;
+Result Deserializer::deserialize_float_quantized_array(PreparedFloatOptions options, float* values, size_t count) {
+    uint32_t steps[FLOAT_ARRAY_BLOCK_SIZE];
+    for (size_t i = 0; i < count; i += FLOAT_ARRAY_BLOCK_SIZE) {
+        size_t block_count = min(count - i, (size_t)FLOAT_ARRAY_BLOCK_SIZE);
+        Result result = deserialize_uint32_array(options.uint_options, steps, block_count);
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+        dequantize_float_values(steps, block_count, options, values + i);
     }
-    else {
-        used_bits = used_segments * options.big_segment_size;
+    return Result(ResultStatus::Success);
+}
+
+Result Deserializer::deserialize_uint8_delta(PreparedUintOptions options, uint8_t baseline, uint8_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_uint8);
+}
+
+Result Deserializer::deserialize_uint16_delta(PreparedUintOptions options, uint16_t baseline, uint16_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_uint16);
+}
+
+Result Deserializer::deserialize_uint32_delta(PreparedUintOptions options, uint32_t baseline, uint32_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_uint32);
+}
+
+Result Deserializer::deserialize_uint64_delta(PreparedUintOptions options, uint64_t baseline, uint64_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_uint64);
+}
+
+Result Deserializer::deserialize_int8_delta(PreparedUintOptions options, int8_t baseline, int8_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_int8);
+}
+
+Result Deserializer::deserialize_int16_delta(PreparedUintOptions options, int16_t baseline, int16_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_int16);
+}
+
+Result Deserializer::deserialize_int32_delta(PreparedUintOptions options, int32_t baseline, int32_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_int32);
+}
+
+Result Deserializer::deserialize_int64_delta(PreparedUintOptions options, int64_t baseline, int64_t* value) {
+    return deserialize_delta(options, baseline, value, &Deserializer::deserialize_int64);
+}
+
+Result Deserializer::deserialize_float_quantized_delta(PreparedFloatOptions options, float baseline, float* value) {
+    uint32_t step;
+    Result result = deserialize_delta(options.uint_options, quantize_float(baseline, options), &step, &Deserializer::deserialize_uint32);
+    if (result.status != ResultStatus::Success) {
+        *value = 0.0f;
+        return result;
     }
-    
-    uint32_t used_bytes = ceil_divide(used_bits, BYTE_SIZE);
-    uint8_t* byte = m_reader->read((size_t)used_bytes);
-    if (byte == nullptr) {
-        return Result(ResultStatus::ReadFailed);
+    *value = dequantize_float(step, options);
+    return result;
+}
+
+Result Deserializer::deserialize_bytes(uint8_t* bytes, size_t size) {
+    PACKET_MASTER_STAT(m_stats.values++);
+    PACKET_MASTER_STAT(m_stats.bits += size * BYTE_SIZE);
+    if (size == 0) {
+        return Result(ResultStatus::Success);
     }
-    uint32_t little_endian = *(uint32_t*)byte & BIT_MASK(0, used_bits, uint32_t);
-    *value = little_endian_to_native_endianness(little_endian);
-    uint32_t free_bits_start = used_bits % BYTE_SIZE;
-    if (free_bits_start > 0) {
-        DeserializerFreeBits free_bits;
-        free_bits.start = free_bits_start;
-        free_bits.end = BYTE_SIZE;
-        free_bits.byte = *byte;
-        if (m_free_bits.push(free_bits) == nullptr) {
-            return Result(ResultStatus::MemoryAllocationFailed);
-        }
+    const uint8_t* input = read_bytes(size);
+    if (input == nullptr) {
+        return Result(ResultStatus::ReadFailed);
     }
+    memcpy(bytes, input, size);
     return Result(ResultStatus::Success);
 }
 
-Result Deserializer::deserialize_bool(bool* value) {
-    return read_bit((uint8_t*)value);
+DeserializerStats Deserializer::stats() const {
+    #ifdef PACKET_MASTER_STATS
+    return m_stats;
+    #else
+    return DeserializerStats{};
+    #endif
+}
+
+void Deserializer::reset_stats() {
+    #ifdef PACKET_MASTER_STATS
+    m_stats = {};
+    #endif
 }
 
 void Deserializer::reset() {
     m_free_bits.clear();
+    m_loaded_bits = 0;
+    m_loaded_ends = 0;
+    m_loaded_count = 0;
+    m_offset = 0;
+}
+
+DeserializerCheckpoint Deserializer::checkpoint() const {
+    DeserializerCheckpoint checkpoint;
+    checkpoint.free_bits = m_free_bits;
+    checkpoint.loaded_bits = m_loaded_bits;
+    checkpoint.loaded_ends = m_loaded_ends;
+    checkpoint.loaded_count = m_loaded_count;
+    checkpoint.offset = m_offset;
+#ifdef PACKET_MASTER_STATS
+    checkpoint.stats = m_stats;
+#endif
+    return checkpoint;
+}
+
+void Deserializer::rewind(const DeserializerCheckpoint& checkpoint) {
+    m_free_bits = checkpoint.free_bits;
+    m_loaded_bits = checkpoint.loaded_bits;
+    m_loaded_ends = checkpoint.loaded_ends;
+    m_loaded_count = checkpoint.loaded_count;
+    m_offset = checkpoint.offset;
+#ifdef PACKET_MASTER_STATS
+    m_stats = checkpoint.stats;
+#endif
 }
 
 Result Deserializer::read_bit(uint8_t* value) {
     *value = 0;
-    DeserializerFreeBits* free_bits; 
-    Result result = get_free_bits(&free_bits);
+    PACKET_MASTER_STAT(m_stats.values++);
+    PACKET_MASTER_STAT(m_stats.bits++);
+    if (m_loaded_count == 0) {
+        Result result = load_free_bits(1);
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+    }
+    *value = (uint8_t)(m_loaded_bits & 1);
+    m_loaded_bits >>= 1;
+    m_loaded_ends >>= 1;
+    m_loaded_count--;
+    return Result(ResultStatus::Success);
+}
+
+// Reads the segments header and then the used bytes of the value, the value is 0 on failure
+Result Deserializer::read_uint(PreparedUintOptions options, uint64_t* value) {
+    *value = 0;
+    uint32_t segments_header;
+    Result result = read_bits(options.segments_storage_size, &segments_header);
     if (result.status != ResultStatus::Success) {
         return result;
     }
-    *value = (free_bits->byte & BIT_MASK(free_bits->start, 1, uint8_t)) >> free_bits->start;
-    free_bits->start++;
-    if (free_bits->start >= free_bits->end) {
-        if (!m_free_bits.remove(0)) {
-            return Result(ResultStatus::MemoryOperationFailed);
-        }
+    return read_value_bytes(decode_used_bits(segments_header + 1, options), value);
+}
+
+Result Deserializer::read_value_bytes(uint32_t used_bits, uint64_t* value) {
+    *value = 0;
+    PACKET_MASTER_STAT(m_stats.values++);
+    PACKET_MASTER_STAT(m_stats.bits += used_bits);
+    size_t used_bytes = (used_bits + BYTE_SIZE - 1) / BYTE_SIZE;
+    const uint8_t* bytes = read_bytes(used_bytes);
+    if (bytes == nullptr) {
+        return Result(ResultStatus::ReadFailed);
+    }
+    // copying only the used bytes, the rest of the input may not exist
+    uint64_t little_endian = 0;
+    memcpy(&little_endian, bytes, used_bytes);
+    *value = little_endian_to_native_endianness(little_endian) & BIT_MASK(0, (uint64_t)used_bits, uint64_t);
+
+    uint32_t free_bits_start = used_bits % BYTE_SIZE;
+    if (free_bits_start > 0) {
+        // the free bits are in the last byte of the value
+        push_free_bits(bytes[used_bytes - 1], free_bits_start);
     }
     return Result(ResultStatus::Success);
 }
@@ -788,46 +2063,89 @@ Result Deserializer::read_bit(uint8_t* value) {
 Result Deserializer::read_bits(size_t count, uint32_t* value) {
     assert(count <= sizeof(uint32_t) * BYTE_SIZE);
     *value = 0;
-    size_t index = 0;
-    while (count > 0) {
-        DeserializerFreeBits* free_bits = nullptr; 
-        Result result = get_free_bits(&free_bits);
-        if (free_bits == nullptr) {
-            assert(result.status != ResultStatus::Success);
+    if (count == 0) {
+        return Result(ResultStatus::Success);
+    }
+    PACKET_MASTER_STAT(m_stats.bits += count);
+    if (m_loaded_count < count) {
+        Result result = load_free_bits(count);
+        if (result.status != ResultStatus::Success) {
             return result;
         }
-        size_t read_count = min(free_bits->end - free_bits->start, count);
-        uint32_t data = (free_bits->byte & BIT_MASK(free_bits->start, read_count, uint32_t)) >> free_bits->start;
-        *value |= data << index;
-        index += read_count;
-        count -= read_count;
-        free_bits->start += (uint8_t)read_count;
-        if (free_bits->start >= free_bits->end) {
-            if (!m_free_bits.remove(0)) {
-                assert(false);
-                return Result(ResultStatus::MemoryOperationFailed);
-            }
-        }
     }
+    *value = (uint32_t)(m_loaded_bits & BIT_MASK(0, (uint64_t)count, uint64_t));
+    m_loaded_bits >>= count;
+    m_loaded_ends >>= count;
+    m_loaded_count -= (uint32_t)count;
     return Result(ResultStatus::Success);
 }
 
-Result Deserializer::get_free_bits(DeserializerFreeBits** out_free_bits) {
+Result Deserializer::load_free_bits(size_t count) {
+    // taking as many bytes of the queue as fit, so the next values read from the register as well
     DeserializerFreeBits* free_bits = m_free_bits.first();
-    if (free_bits == NULL) {
-        uint8_t* byte = m_reader->read(1);
-        if (byte == NULL) {
-            return Result(ResultStatus::ReadFailed);
+    while (free_bits != nullptr && m_loaded_count + (BYTE_SIZE - free_bits->start) <= sizeof(m_loaded_bits) * BYTE_SIZE) {
+        uint32_t free_count = BYTE_SIZE - free_bits->start;
+        m_loaded_bits |= (uint64_t)(free_bits->byte >> free_bits->start) << m_loaded_count;
+        m_loaded_ends |= (uint64_t)1 << (m_loaded_count + free_count - 1);
+        m_loaded_count += free_count;
+        m_free_bits.pop();
+        free_bits = m_free_bits.first();
+    }
+    if (m_loaded_count >= count) {
+        return Result(ResultStatus::Success);
+    }
+
+    // there are no more free bits so the rest comes from new bytes, the serializer opened them at this point
+    assert(free_bits == nullptr);
+    size_t byte_count = (count - m_loaded_count + BYTE_SIZE - 1) / BYTE_SIZE;
+    const uint8_t* bytes = read_bytes(byte_count);
+    if (bytes == nullptr) {
+        return Result(ResultStatus::ReadFailed);
+    }
+    for (size_t i = 0; i < byte_count; i++) {
+        m_loaded_bits |= (uint64_t)bytes[i] << m_loaded_count;
+        m_loaded_count += BYTE_SIZE;
+        m_loaded_ends |= (uint64_t)1 << (m_loaded_count - 1);
+    }
+    return Result(ResultStatus::Success);
+}
+
+void Deserializer::push_free_bits(uint8_t byte, uint32_t start) {
+    // the bytes in the register are older than the ones in the queue
+    uint32_t loaded_bytes = (uint32_t)count_set_bits_uint64(m_loaded_ends);
+    if (loaded_bytes + m_free_bits.length() >= m_free_bits.capacity()) {
+        // the serializer closed the oldest byte at this point as well
+        if (loaded_bytes > 0) {
+            uint32_t oldest_count = count_used_bits_uint64(m_loaded_ends & (~m_loaded_ends + 1));
+            PACKET_MASTER_STAT(m_stats.padding_bits += oldest_count);
+            m_loaded_bits >>= oldest_count;
+            m_loaded_ends >>= oldest_count;
+            m_loaded_count -= oldest_count;
+            loaded_bytes--;
         }
-        DeserializerFreeBits value{};
-        value.start = 0;
-        value.end = BYTE_SIZE;
-        value.byte = *byte;
-        free_bits = m_free_bits.push(value);
-        if (free_bits == NULL) {
-            return Result(ResultStatus::MemoryAllocationFailed);
+        else {
+            PACKET_MASTER_STAT(m_stats.padding_bits += BYTE_SIZE - m_free_bits.first()->start);
+            m_free_bits.pop();
         }
     }
-    *out_free_bits = free_bits;
-    return Result(ResultStatus::Success);
+    DeserializerFreeBits free_bits;
+    free_bits.byte = byte;
+    free_bits.start = (uint8_t)start;
+    m_free_bits.push(free_bits);
+    PACKET_MASTER_STAT(m_stats.free_bits_high_water = max((uint64_t)(loaded_bytes + m_free_bits.length()), m_stats.free_bits_high_water));
 }
+
+
+void Deserializer::push_array_free_bits(const uint8_t* bytes, size_t count, uint32_t value_bytes, uint32_t max_bits) {
+    PACKET_MASTER_STAT(m_stats.values += count);
+    PACKET_MASTER_STAT(m_stats.bits += count * max_bits);
+    uint32_t free_bits_start = max_bits % BYTE_SIZE;
+    if (free_bits_start == 0) {
+        return;
+    }
+    size_t first = count > m_free_bits.capacity() ? count - m_free_bits.capacity() : 0;
+    PACKET_MASTER_STAT(m_stats.padding_bits += first * (BYTE_SIZE - free_bits_start));
+    for (size_t i = first; i < count; i++) {
+        push_free_bits(bytes[i * value_bytes + value_bytes - 1], free_bits_start);
+    }
+}
\ No newline at end of file
@@ -5,14 +5,26 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+// A piece of output handed to Writer::writev, like an iovec
+struct WriterSegment {
+    const uint8_t* data;
+    size_t size;
+};
+
 // A writer interface to write output data in a generic way.
 // The write method should return NULL on success or any other number on failure.
+// writev_callback is optional, it writes several segments in order with a single call (e.g. with writev)
+// and lets the serializer hand over the bytes of serialize_bytes without copying them.
+// The fields start as nullptr, so a Writer that only sets write_callback never has a garbage writev_callback.
 struct Writer {
-    int(*write_callback)(void*,uint8_t*,size_t);
-    void* ctx;
+    int(*write_callback)(void*,uint8_t*,size_t) = nullptr;
+    void* ctx = nullptr;
+    int(*writev_callback)(void*,const WriterSegment*,size_t) = nullptr;
 
     int write(uint8_t* value, size_t size);
     int write_byte(uint8_t value);
+    // calls write for every segment when there is no writev_callback
+    int writev(const WriterSegment* segments, size_t count);
 };
 
 // A reader interface to read data in a generic way.
@@ -45,20 +57,96 @@ struct Allocator{
     void free(void* ptr, size_t size);
 };
 
+// A bump allocator over a single block of memory, for memory that only lives for a packet or a tick.
+// Memory is given back all at once with reset, freeing a block only gives it back when it is the last one.
+// The last block grows and shrinks in place, so a single growing Vector (like a serializer buffer) never copies.
+// Allocations fail once the block is full, the arena never falls back to the heap.
+class ArenaAllocator {
+    public:
+        // Uses the given memory, which is not freed by the arena
+        ArenaAllocator(void* memory, size_t size);
+        // Maps the memory with mmap, huge pages are used when requested and available (Linux)
+        // and there is a fallback to normal pages. capacity() is 0 when the memory can't be mapped.
+        // On systems without mmap the memory comes from malloc.
+        ArenaAllocator(size_t size, bool huge_pages);
+        ~ArenaAllocator();
+        ArenaAllocator(const ArenaAllocator&) = delete;
+
+        // An allocator which allocates from this arena, the arena must outlive it
+        Allocator allocator();
+
+        // Gives back all of the memory, everything allocated before is invalid after it
+        void reset();
+
+        inline size_t used() const { return m_top; }
+        inline size_t capacity() const { return m_size; }
+        // the most memory that was used at once since the arena was created
+        inline size_t peak() const { return m_peak; }
+        // true when the memory is backed by huge pages
+        inline bool huge_pages() const { return m_huge_pages; }
+
+        void* alloc(size_t size);
+        void* realloc(void* ptr, size_t old_size, size_t new_size);
+        void free(void* ptr, size_t size);
+    private:
+        uint8_t* m_memory;
+        size_t m_size;
+        // the end of the used memory and the start of the last block
+        size_t m_top;
+        size_t m_last;
+        size_t m_peak;
+        bool m_owned;
+        bool m_huge_pages;
+};
+
+// The max amount of bytes with free bits that can be waiting to be filled at once.
+// When a new byte with free bits is added to a full queue, the oldest byte is closed and its free bits are left as padding.
+// Must be a power of 2 and identical on the serializing and deserializing side.
+// Changing it changes the output of the packets which have more open bytes at once than the old or the new value.
+#ifndef PACKET_MASTER_MAX_FREE_BYTES
+#define PACKET_MASTER_MAX_FREE_BYTES 64
+#endif
+
+// The bytes of serialize_bytes which can wait to be written without being copied into the buffer, must be a power of 2.
+// After that they are copied.
+#ifndef PACKET_MASTER_MAX_SEGMENTS
+#define PACKET_MASTER_MAX_SEGMENTS 16
+#endif
+
+// The bytes a serializer keeps in the object itself before it allocates its buffer,
+// a packet which fits in them (and is flushed by finalize) does not allocate memory. 0 always allocates.
+#ifndef PACKET_MASTER_INLINE_BUFFER_SIZE
+#define PACKET_MASTER_INLINE_BUFFER_SIZE 64
+#endif
+
+// Define PACKET_MASTER_STATS for the whole build to count what the serializers and deserializers do, see SerializerStats.
+// Without it the counters are compiled out and stats() returns zeros.
+#ifdef PACKET_MASTER_STATS
+#define PACKET_MASTER_STAT(statement) statement
+#else
+#define PACKET_MASTER_STAT(statement)
+#endif
+
 // Internal
-// a reference to a byte in the buffer which contains some free bits
+// a reference to a byte in the buffer which contains some free bits, the free bits always reach the end of the byte
 struct SerializerFreeBits{
+    uint32_t index;
+    uint8_t start;
+};
+
+// Internal
+// bytes of serialize_bytes which are written straight from the caller's memory, they go before the buffer byte at index
+struct SerializerSegment {
     size_t index;
-    size_t start;
-    size_t end;
+    const uint8_t* data;
+    size_t size;
 };
 
 // Internal
-// a byte with some free bits in it for read
+// a byte with some free bits in it for read, the free bits always reach the end of the byte
 struct DeserializerFreeBits {
-    size_t start;
-    size_t end;
     uint8_t byte;
+    uint8_t start;
 };
 
 
@@ -71,7 +159,15 @@ enum class ResultStatus {
     // Indicates that output has failed to be written into the writer, error code in write_error
     WriteFailed,
     // Indicates that input has failed to be read from the reader
-    ReadFailed
+    ReadFailed,
+    // Indicates that there is no space left in the fixed output buffer
+    BufferFull,
+    // Indicates that the input is not in the expected format, e.g. a corrupt log
+    InvalidFormat,
+    // Indicates that an argument is out of range, e.g. a packet which doesn't exist
+    InvalidArgument,
+    // Indicates that there is nothing left to read
+    EndOfInput
 };
 const char* status_to_string(ResultStatus status);
 
@@ -97,52 +193,65 @@ size_t max(size_t a, size_t b);
 
 #include <string.h>
 
+// Internal
+// the inline elements of a Vector, empty when there are none so it takes no space as a base class
+template<typename T, size_t Capacity>
+struct VectorInlineStorage {
+    inline T* inline_data() { return m_inline; }
+    T m_inline[Capacity];
+};
 template<typename T>
-class Vector {
+struct VectorInlineStorage<T, 0> {
+    inline T* inline_data() { return nullptr; }
+};
+
+// A growable array, the first InlineCapacity elements are stored in the object itself
+// and the allocator is only used once it grows past them.
+template<typename T, size_t InlineCapacity = 0>
+class Vector : private VectorInlineStorage<T, InlineCapacity> {
     public:
-        Vector(Allocator* allocator) : m_data(nullptr), m_length(0), m_capacity(0), m_allocator(allocator) {}
+        Vector(Allocator* allocator) : m_data(this->inline_data()), m_length(0), m_capacity(InlineCapacity), m_allocator(allocator) {}
+        // uses the given memory without ever allocating, pushing past the capacity fails
+        Vector(T* data, size_t capacity) : m_data(data), m_length(0), m_capacity(capacity), m_allocator(nullptr) {}
         ~Vector() {
-            m_allocator->free(m_data, m_capacity * sizeof(T));
+            if (m_allocator != nullptr && m_data != nullptr && !is_inline()) {
+                m_allocator->free(m_data, m_capacity * sizeof(T));
+            }
         }
+        // the data may point into the vector itself, a copy would point into the original
         Vector(const Vector&) = delete;
+        Vector& operator=(const Vector&) = delete;
 
         // returns nullptr on failure
         T* push(T value) {
             if (m_capacity <= m_length) {
-                size_t old_capacity = m_capacity;
-                m_capacity = max(m_capacity * 2, m_length + 1);
-                if (m_data == nullptr) {
-                    m_data = (T*)m_allocator->alloc(m_capacity * sizeof(T));
-                    if (m_data == nullptr) {
-                        return nullptr;
-                    }
-                }
-                else {
-                    T* data = (T*)m_allocator->realloc(m_data, old_capacity * sizeof(T), m_capacity * sizeof(T));
-                    if (data == nullptr) {
-                        return nullptr;
-                    }
-                    m_data = data;
+                if (!grow(m_length + 1)) {
+                    return nullptr;
                 }
             }
             m_data[m_length] = value;
             return m_data + (m_length++);
         }
 
-        T* push_many(T* data, size_t count) {
+        T* push_many(const T* data, size_t count) {
+            T* res = extend(count);
+            if (res == nullptr) {
+                return nullptr;
+            }
+            memcpy(res, data, count * sizeof(T));
+            return res;
+        }
+
+        // adds count uninitialized elements to the end, returns a pointer to the first one or nullptr on failure
+        T* extend(size_t count) {
             if (count > m_capacity - m_length) {
-                // expand
-                size_t old_capacity = m_capacity;
-                m_capacity = max(m_capacity * 2, m_length + count);
-                m_data = (T*)m_allocator->realloc(m_data, old_capacity * sizeof(T), m_capacity * sizeof(T));
-                if (m_data == nullptr) {
+                if (!grow(m_length + count)) {
                     return nullptr;
                 }
                 #ifdef NDEBUG
                     memset(m_data + m_length + count, 0, (m_capacity - m_length - count) * sizeof(T));
                 #endif
             }
-            memcpy(m_data + m_length, data, count * sizeof(T));
             T* res = m_data + m_length;
             m_length += count;
             return res;
@@ -161,8 +270,8 @@ class Vector {
         }
 
         bool remove_many(size_t index, size_t count) {
-            assert(index + count < m_length);
-            if (index + count < m_length - 1) {
+            assert(index + count <= m_length);
+            if (index + count < m_length) {
                 size_t right = m_length - index - count;
                 void* move_res = memmove(m_data + index, m_data + index + count, right * sizeof(T));
                 m_length -= count;
@@ -191,16 +300,178 @@ class Vector {
         inline T* ptr() const { return m_data; }
         inline size_t length() const { return m_length; }
         inline size_t capacity() const { return m_capacity; }
+        // true when the vector uses fixed memory and can't grow
+        inline bool fixed() const { return m_allocator == nullptr; }
+        // true when the elements are still stored in the object itself
+        inline bool is_inline() const { return InlineCapacity > 0 && m_data == const_cast<Vector*>(this)->inline_data(); }
+        #ifdef PACKET_MASTER_STATS
+        // the amount of times the memory was allocated or reallocated to grow
+        inline size_t reallocations() const { return m_reallocations; }
+        #endif
     private:
+        // grows to at least min_capacity, the inline elements are copied to allocated memory the first time
+        bool grow(size_t min_capacity) {
+            if (m_allocator == nullptr) {
+                return false;
+            }
+            size_t capacity = max(m_capacity * 2, min_capacity);
+            T* data;
+            if (m_data == nullptr || is_inline()) {
+                data = (T*)m_allocator->alloc(capacity * sizeof(T));
+                if (data != nullptr && m_length > 0) {
+                    memcpy(data, m_data, m_length * sizeof(T));
+                }
+            }
+            else {
+                data = (T*)m_allocator->realloc(m_data, m_capacity * sizeof(T), capacity * sizeof(T));
+            }
+            if (data == nullptr) {
+                return false;
+            }
+            PACKET_MASTER_STAT(m_reallocations++);
+            m_data = data;
+            m_capacity = capacity;
+            return true;
+        }
+
         T* m_data;
         size_t m_length;
         size_t m_capacity;
         Allocator* m_allocator;
+        #ifdef PACKET_MASTER_STATS
+        size_t m_reallocations = 0;
+        #endif
+};
+
+// A fixed capacity FIFO queue stored inline, it never allocates memory
+// The capacity must be a power of 2
+template<typename T, size_t Capacity>
+class RingQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "RingQueue capacity must be a power of 2");
+    public:
+        RingQueue() : m_head(0), m_length(0) {}
+
+        // returns nullptr when the queue is full
+        T* push(T value) {
+            if (m_length == Capacity) {
+                return nullptr;
+            }
+            T* slot = m_data + ((m_head + m_length) & (Capacity - 1));
+            *slot = value;
+            m_length++;
+            return slot;
+        }
+
+        // removes the oldest element
+        void pop() {
+            assert(m_length > 0);
+            m_head = (m_head + 1) & (Capacity - 1);
+            m_length--;
+        }
+
+        void clear() {
+            m_head = 0;
+            m_length = 0;
+        }
+
+        // the oldest element, nullptr when the queue is empty
+        T* first() {
+            if (m_length > 0) {
+                return m_data + m_head;
+            }
+            return nullptr;
+        }
+
+        // the element at the given position from the oldest one
+        T& operator[](size_t index) {
+            assert(index < m_length);
+            return m_data[(m_head + index) & (Capacity - 1)];
+        }
+
+        inline size_t length() const { return m_length; }
+        inline bool full() const { return m_length == Capacity; }
+        static constexpr size_t capacity() { return Capacity; }
+    private:
+        T m_data[Capacity];
+        size_t m_head;
+        size_t m_length;
 };
 
 
 int count_leading_zeros_uint_fallback(unsigned int num);
-int count_leading_zeros_uint(unsigned int num);
+
+#ifdef _MSC_VER 
+#include <immintrin.h>
+#include <intrin0.inl.h>
+#endif
+
+// TODO: change this function to have a fixed size input and output, uint32_t
+inline int count_leading_zeros_uint(unsigned int num) {
+    #if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
+        // supported in clang and gcc
+        // handling zero as it is an undefined behaviour for clz
+        if (num == 0) {
+            return sizeof(num) * 8;
+        }
+        else {
+            return __builtin_clz(num);
+        }
+    #elif defined(_MSC_VER) 
+        if (num == 0) {
+            return sizeof(num) * 8;
+        }
+        else {
+            return __lzcnt(num);
+        }
+    #else
+        return count_leading_zeros_uint_fallback(num);
+    #endif
+}
+
+int count_leading_zeros_uint64_fallback(uint64_t num);
+
+inline int count_leading_zeros_uint64(uint64_t num) {
+    #if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
+        // handling zero as it is an undefined behaviour for clz
+        if (num == 0) {
+            return sizeof(num) * 8;
+        }
+        else {
+            return __builtin_clzll((unsigned long long)num);
+        }
+    #elif defined(_MSC_VER) && defined(_M_X64)
+        if (num == 0) {
+            return sizeof(num) * 8;
+        }
+        else {
+            return (int)__lzcnt64(num);
+        }
+    #else
+        return count_leading_zeros_uint64_fallback(num);
+    #endif
+}
+
+inline uint32_t count_used_bits_uint32(uint32_t value) {
+    return (uint32_t)(sizeof(unsigned int) * 8 - count_leading_zeros_uint((unsigned int)value));
+}
+
+inline uint32_t count_used_bits_uint64(uint64_t value) {
+    return (uint32_t)(sizeof(uint64_t) * 8 - count_leading_zeros_uint64(value));
+}
+
+int count_set_bits_uint64_fallback(uint64_t num);
+
+inline int count_set_bits_uint64(uint64_t num) {
+    #if defined(__GNUC__) || defined(__GNUG__) || defined(__clang__)
+        return __builtin_popcountll((unsigned long long)num);
+    #else
+        return count_set_bits_uint64_fallback(num);
+    #endif
+}
+
+inline uint32_t ceil_divide(uint32_t a, uint32_t b) {
+    return (a + b - 1) / b;
+}
 
 struct UintOptions {
     // max amount of bits of the number
@@ -243,15 +514,266 @@ PreparedUintOptions uint32_max_bits(uint32_t bits);
 // Note: the serializer will not validate the input to make sure the number is below the max
 PreparedUintOptions uint32_max(uint32_t number);
 
+// The default options for uint64, 8 segment 64 max bits
+PreparedUintOptions uint64_default_options();
+// Specify the max amount of bits. the number should not exceed the max amount of bits
+PreparedUintOptions uint64_max_bits(uint32_t bits);
+// Specify a max number for the serialized value
+// Note: the serializer will not validate the input to make sure the number is below the max
+PreparedUintOptions uint64_max(uint64_t number);
+
+// Signed values are zigzag mapped onto unsigned values so small negative values stay small,
+// the options of the mapped value are the same as the options of the unsigned type with the same size.
+// The default options for int8, same as uint8_default_options
+PreparedUintOptions int8_default_options();
+// Specify the range of the serialized value, the bits are the bits of the biggest mapped value in the range
+// Note: the serializer will not validate the input to make sure the number is in the range
+PreparedUintOptions int8_range(int8_t min, int8_t max);
+
+// The default options for int16, same as uint16_default_options
+PreparedUintOptions int16_default_options();
+// Specify the range of the serialized value, the bits are the bits of the biggest mapped value in the range
+// Note: the serializer will not validate the input to make sure the number is in the range
+PreparedUintOptions int16_range(int16_t min, int16_t max);
+
+// The default options for int32, same as uint32_default_options
+PreparedUintOptions int32_default_options();
+// Specify the range of the serialized value, the bits are the bits of the biggest mapped value in the range
+// Note: the serializer will not validate the input to make sure the number is in the range
+PreparedUintOptions int32_range(int32_t min, int32_t max);
+
+// The default options for int64, same as uint64_default_options
+PreparedUintOptions int64_default_options();
+// Specify the range of the serialized value, the bits are the bits of the biggest mapped value in the range
+// Note: the serializer will not validate the input to make sure the number is in the range
+PreparedUintOptions int64_range(int64_t min, int64_t max);
+
 // Prepares uint options to save some computation at serialization/deserialization time
 // valid options are:
 //    - max_bits need to be less than or equal to the size of the number in bits
 //    - segment_hint need to be less than or equal to the size of the number in bits
 PreparedUintOptions prepare_uint_options(UintOptions options);
 
+// Internal
+// constexpr versions of the option helpers, used to prepare options at compile time
+constexpr uint32_t count_used_bits_constexpr(uint64_t value) {
+    uint32_t bits = 0;
+    while (value != 0) {
+        bits++;
+        value >>= 1;
+    }
+    return bits;
+}
+constexpr PreparedUintOptions prepare_uint_options_constexpr(uint32_t max_bits, uint32_t segments_hint) {
+    PreparedUintOptions result{};
+    result.max_bits = max_bits;
+    uint32_t segments = segments_hint == 0 ? (max_bits + 7) / 8 : segments_hint;
+    // rounding up to the closest power of 2
+    result.segment_count = (uint32_t)1 << count_used_bits_constexpr(segments - 1);
+    result.small_segment_size = max_bits / result.segment_count;
+    result.big_segment_size = result.small_segment_size + 1;
+    result.big_segment_count = max_bits % result.segment_count;
+    result.segments_storage_size = count_used_bits_constexpr(result.segment_count - 1);
+    return result;
+}
+
+// Uint options known at compile time, passed as a template argument to the serialize/deserialize methods
+// so all of the segment math that only depends on the options is folded by the compiler.
+// MaxBits and SegmentsHint are the same as in UintOptions
+template<uint32_t MaxBits, uint32_t SegmentsHint = 0>
+struct UintSpec {
+    static_assert(MaxBits > 0 && MaxBits <= 64, "MaxBits must be between 1 and 64");
+    static_assert(SegmentsHint <= MaxBits, "SegmentsHint must not be bigger than MaxBits");
+    static constexpr PreparedUintOptions options = prepare_uint_options_constexpr(MaxBits, SegmentsHint);
+};
+
+// Compile time options for values up to Max, like uintN_max
+// Note: the serializer will not validate the input to make sure the number is below the max
+template<uint64_t Max>
+using UintMaxSpec = UintSpec<count_used_bits_constexpr(Max)>;
+
+// Internal
+// zigzag mapping: 0 -> 0, -1 -> 1, 1 -> 2, -2 -> 3 ...
+// the sign is spread with an arithmetic shift so the mapping has no branches
+constexpr uint32_t zigzag_encode_int32(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+constexpr uint64_t zigzag_encode_int64(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+constexpr int32_t zigzag_decode_int32(uint32_t value) {
+    return (int32_t)((value >> 1) ^ (0u - (value & 1)));
+}
+constexpr int64_t zigzag_decode_int64(uint64_t value) {
+    return (int64_t)((value >> 1) ^ ((uint64_t)0 - (value & 1)));
+}
+// the mapped values of the smaller types fit in the unsigned type with the same size
+constexpr uint8_t zigzag_encode_int8(int8_t value) { return (uint8_t)zigzag_encode_int32(value); }
+constexpr uint16_t zigzag_encode_int16(int16_t value) { return (uint16_t)zigzag_encode_int32(value); }
+constexpr int8_t zigzag_decode_int8(uint8_t value) { return (int8_t)zigzag_decode_int32(value); }
+constexpr int16_t zigzag_decode_int16(uint16_t value) { return (int16_t)zigzag_decode_int32(value); }
+
+// the bits of the biggest mapped value in the range, at least 1
+constexpr uint32_t int_range_bits_constexpr(int64_t min, int64_t max) {
+    uint64_t biggest = zigzag_encode_int64(min) > zigzag_encode_int64(max) ? zigzag_encode_int64(min) : zigzag_encode_int64(max);
+    return count_used_bits_constexpr(biggest | 1);
+}
+
+// Compile time options for signed values in the range [Min, Max], like intN_range
+// Note: the serializer will not validate the input to make sure the number is in the range
+template<int64_t Min, int64_t Max>
+using IntRangeSpec = UintSpec<int_range_bits_constexpr(Min, Max)>;
+
+// Options of a float quantized to whole steps in the range [min, max],
+// the step is serialized as a single segment uint with the bits of the biggest step
+struct PreparedFloatOptions {
+    float min;
+    float max;
+    // the steps per unit and the size of a single step
+    float scale;
+    float step_size;
+    uint32_t max_step;
+    PreparedUintOptions uint_options;
+};
+
+// Prepares the options of a float in the range [min, max] which is kept within precision / 2 of its value,
+// e.g. float_quantized_options(-1000.0f, 1000.0f, 0.01f) takes 18 bits.
+// It is constexpr so constant options are computed at compile time.
+// valid options are:
+//    - min is smaller than max
+//    - (max - min) / precision is below 2^31, floats have 24 bits of precision so it is best to stay below 2^24
+constexpr PreparedFloatOptions float_quantized_options(float min, float max, float precision) {
+    PreparedFloatOptions result{};
+    result.min = min;
+    result.max = max;
+    float steps = (max - min) / precision;
+    // rounding up so a step is never bigger than the precision
+    uint32_t max_step = (uint32_t)steps;
+    if ((float)max_step < steps || max_step == 0) {
+        max_step++;
+    }
+    result.max_step = max_step;
+    result.scale = (float)max_step / (max - min);
+    result.step_size = (max - min) / (float)max_step;
+    result.uint_options = prepare_uint_options_constexpr(count_used_bits_constexpr(max_step), 1);
+    return result;
+}
+
+// Internal
+// the step of a float, values outside of the range are clamped to it
+inline uint32_t quantize_float(float value, const PreparedFloatOptions& options) {
+    // a NaN becomes min like in maxps
+    float clamped = value > options.min ? value : options.min;
+    clamped = clamped < options.max ? clamped : options.max;
+    uint32_t step = (uint32_t)((clamped - options.min) * options.scale + 0.5f);
+    return step < options.max_step ? step : options.max_step;
+}
+inline float dequantize_float(uint32_t step, const PreparedFloatOptions& options) {
+    return options.min + (float)step * options.step_size;
+}
+
+// Internal
+// the amount of segments a value uses and the bits they take, which is the value bits rounded up to whole segments
+struct UintEncoding {
+    uint32_t used_segments;
+    uint32_t used_bits;
+};
+
+// Internal
+inline UintEncoding encode_uint(uint32_t value_bits, const PreparedUintOptions& options) {
+    // zero is written with the first segment like a one bit value
+    if (value_bits == 0) {
+        value_bits = 1;
+    }
+    UintEncoding encoding;
+    uint32_t used_big_segments = ceil_divide(value_bits, options.big_segment_size);
+    if (used_big_segments > options.big_segment_count) {
+        used_big_segments = options.big_segment_count;
+    }
+    encoding.used_segments = used_big_segments;
+    uint32_t used_bits_by_big_segments = used_big_segments * options.big_segment_size;
+    encoding.used_bits = used_bits_by_big_segments;
+    if (used_bits_by_big_segments < value_bits) {
+        uint32_t used_small_segments = ceil_divide(value_bits - used_bits_by_big_segments, options.small_segment_size);
+        encoding.used_segments += used_small_segments;
+        encoding.used_bits += used_small_segments * options.small_segment_size;
+    }
+    return encoding;
+}
+
+// Internal
+// the amount of bits used by a value with the given amount of segments
+inline uint32_t decode_used_bits(uint32_t used_segments, const PreparedUintOptions& options) {
+    if (used_segments > options.big_segment_count) {
+        uint32_t used_small_segments = used_segments - options.big_segment_count;
+        return options.big_segment_count * options.big_segment_size + used_small_segments * options.small_segment_size;
+    }
+    else {
+        return used_segments * options.big_segment_size;
+    }
+}
+
+// Decides when the serializer hands the buffered bytes to the writer.
+// Bytes are only written once they can't change anymore, before that they wait in the buffer.
+enum class FlushPolicy {
+    // write after every value, the writer is called at least once per value
+    PerValue = 0,
+    // write once at least a threshold of bytes is ready to be written
+    Threshold,
+    // write only when calling finalize
+    Finalize
+};
+
+// Internal
+// the encoding of a uint32 for every amount of used bits (0 to 32) with some options
+// every entry is the segments header in the low 16 bits and the used bits after rounding to segments in the high 16 bits
+struct SegmentTable {
+    uint32_t entries[33];
+};
+
+// Counters of a serializer since it was created or since reset_stats, only counted with PACKET_MASTER_STATS
+struct SerializerStats {
+    // values written, bools and the changed bits of deltas included
+    uint64_t values;
+    // bits of values, segment headers and bools
+    uint64_t bits;
+    // bytes of output handed to the writer, or finalized in the fixed buffer
+    uint64_t bytes;
+    // calls to the writer
+    uint64_t writes;
+    // times the buffer was flushed, including flushes with nothing to write
+    uint64_t flushes;
+    // free bits that were never filled and are left as padding
+    uint64_t padding_bits;
+    // the most bytes with free bits that waited to be filled at once
+    uint64_t free_bits_high_water;
+    // times the buffer allocated memory to grow
+    uint64_t reallocations;
+};
+
+// Counters of a deserializer since it was created or since reset_stats, only counted with PACKET_MASTER_STATS
+struct DeserializerStats {
+    // values read, bools and the changed bits of deltas included
+    uint64_t values;
+    // bits of values, segment headers and bools
+    uint64_t bits;
+    // bytes consumed from the reader or the memory
+    uint64_t bytes;
+    // calls to the reader
+    uint64_t reads;
+    // free bits that were skipped as padding
+    uint64_t padding_bits;
+    // the most bytes with free bits that waited to be read at once
+    uint64_t free_bits_high_water;
+};
+
 class Serializer {
     public:
         Serializer(Writer* writer, Allocator* allocator);
+        // Serializes straight into the given buffer without a writer and without allocating memory.
+        // The output is available in the buffer after finalize, size() returns its length.
+        // Fails with ResultStatus::BufferFull when the buffer has no space left.
+        Serializer(uint8_t* buffer, size_t capacity);
         ~Serializer();
 
         // serialize uint8_t with max amount of bits specified in order to reduce the required storage space
@@ -264,32 +786,349 @@ class Serializer {
         // NOTE: passing a value with more bits than the max bits is an undefined behaviour, this is not a validator
         Result serialize_uint32(uint32_t value, PreparedUintOptions options);
 
+        // serialize uint64_t with max amount of bits specified in order to reduce the required storage space
+        // NOTE: passing a value with more bits than the max bits is an undefined behaviour, this is not a validator
+        Result serialize_uint64(uint64_t value, PreparedUintOptions options);
+
+        // serialize with options known at compile time, e.g. serialize_uint16<UintSpec<10>>(value)
+        template<typename Spec>
+        Result serialize_uint8(uint8_t value) { return serialize_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result serialize_uint16(uint16_t value) { return serialize_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result serialize_uint32(uint32_t value) { return serialize_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result serialize_uint64(uint64_t value) { return serialize_uint_spec<Spec>(value); }
+
+        // serialize signed values, they are zigzag mapped and serialized as the unsigned type with the same size
+        // use the intN_range options to limit the bits
+        Result serialize_int8(int8_t value, PreparedUintOptions options);
+        Result serialize_int16(int16_t value, PreparedUintOptions options);
+        Result serialize_int32(int32_t value, PreparedUintOptions options);
+        Result serialize_int64(int64_t value, PreparedUintOptions options);
+
+        // serialize signed values with options known at compile time, e.g. serialize_int16<IntRangeSpec<-500, 500>>(value)
+        template<typename Spec>
+        Result serialize_int8(int8_t value) { return serialize_uint_spec<Spec>(zigzag_encode_int8(value)); }
+        template<typename Spec>
+        Result serialize_int16(int16_t value) { return serialize_uint_spec<Spec>(zigzag_encode_int16(value)); }
+        template<typename Spec>
+        Result serialize_int32(int32_t value) { return serialize_uint_spec<Spec>(zigzag_encode_int32(value)); }
+        template<typename Spec>
+        Result serialize_int64(int64_t value) { return serialize_uint_spec<Spec>(zigzag_encode_int64(value)); }
+
         // serializes a boolean value
         Result serialize_bool(bool value);
 
+        // serialize an array of values that share the same options, the output is identical to serializing them one by one
+        // arrays with a single segment (no segment headers) are packed in bulk with SIMD when it is available
+        Result serialize_uint8_array(const uint8_t* values, size_t count, PreparedUintOptions options);
+        Result serialize_uint16_array(const uint16_t* values, size_t count, PreparedUintOptions options);
+        Result serialize_uint32_array(const uint32_t* values, size_t count, PreparedUintOptions options);
+
+        // serialize a float quantized to the closest step in the range, values outside of the range are clamped to it
+        // prefer the options overload with constant options, this one prepares the options on every call
+        Result serialize_float_quantized(float value, float min, float max, float precision);
+        Result serialize_float_quantized(float value, PreparedFloatOptions options);
+        // serialize an array of floats with the same options, the output is identical to serializing them one by one
+        // the values are quantized with SIMD when it is available and packed like serialize_uint32_array
+        Result serialize_float_quantized_array(const float* values, size_t count, PreparedFloatOptions options);
+
+        // Delta encoding against a baseline known to both sides, e.g. the last state the receiver acknowledged.
+        // A value equal to the baseline is a single 0 bit, any other value is a 1 bit followed by the value itself.
+        Result serialize_uint8_delta(uint8_t value, uint8_t baseline, PreparedUintOptions options);
+        Result serialize_uint16_delta(uint16_t value, uint16_t baseline, PreparedUintOptions options);
+        Result serialize_uint32_delta(uint32_t value, uint32_t baseline, PreparedUintOptions options);
+        Result serialize_uint64_delta(uint64_t value, uint64_t baseline, PreparedUintOptions options);
+        Result serialize_int8_delta(int8_t value, int8_t baseline, PreparedUintOptions options);
+        Result serialize_int16_delta(int16_t value, int16_t baseline, PreparedUintOptions options);
+        Result serialize_int32_delta(int32_t value, int32_t baseline, PreparedUintOptions options);
+        Result serialize_int64_delta(int64_t value, int64_t baseline, PreparedUintOptions options);
+        // floats are compared after quantization, a value within the same step as the baseline is unchanged
+        Result serialize_float_quantized_delta(float value, float baseline, PreparedFloatOptions options);
+
+        // serializes raw bytes, e.g. an already serialized payload, the size is not serialized.
+        // With a writev_callback big enough bytes are not copied but handed to the writer together with the buffer,
+        // so they have to stay valid until they are flushed (finalize at the latest).
+        Result serialize_bytes(const uint8_t* bytes, size_t size);
+
         // flushes the buffers and resets the serializer
         // after calling this method it is possible to reuse the same instance of the serializer
         Result finalize();
         // Resets the serializer so it can be used again, preventing memory allocations
         void reset();
+
+        // Sets when the buffered bytes are written, the default is FlushPolicy::PerValue
+        // the threshold is the amount of bytes that are ready to be written and is only used with FlushPolicy::Threshold
+        void set_flush_policy(FlushPolicy policy, size_t threshold = 0);
+
+        // The amount of bytes serialized into the fixed buffer, only meaningful when constructed with a buffer
+        inline size_t size() const { return m_buffer.length(); }
+
+        // A copy of the counters, all zeros without PACKET_MASTER_STATS
+        SerializerStats stats() const;
+        void reset_stats();
     private:
         Result push_bit(uint8_t value);
+        // pushes the changed bit and then the value with the given method only when it changed
+        template<typename T, typename Options>
+        inline Result serialize_delta(T value, T baseline, Options options, Result (Serializer::*serialize)(T, Options)) {
+            bool changed = value != baseline;
+            Result result = push_bit(changed);
+            if (result.status != ResultStatus::Success || !changed) {
+                return result;
+            }
+            return (this->*serialize)(value, options);
+        }
         Result push_bits(uint32_t value, size_t count);
+        Result push_uint(uint64_t value, uint32_t segments_header, uint32_t segments_storage_size, uint32_t used_bits);
+        // writes the used bytes of a value, the free bits of the last byte are kept for later
+        Result push_value_bytes(uint64_t value, uint32_t used_bits);
+
+        template<typename Spec, typename T>
+        inline Result serialize_uint_spec(T value) {
+            constexpr PreparedUintOptions options = Spec::options;
+            static_assert(options.max_bits <= sizeof(T) * 8, "the spec has more bits than the type");
+            assert(count_used_bits_uint64((uint64_t)value) <= options.max_bits);
+            Result result;
+            if constexpr (options.segment_count == 1) {
+                // no segments header and the value always takes max_bits
+                result = push_value_bytes((uint64_t)value, options.max_bits);
+            }
+            else {
+                uint32_t used_bits;
+                if constexpr (sizeof(T) > sizeof(uint32_t)) {
+                    used_bits = count_used_bits_uint64((uint64_t)value);
+                }
+                else {
+                    used_bits = count_used_bits_uint32((uint32_t)value);
+                }
+                UintEncoding encoding = encode_uint(used_bits, options);
+                result = push_uint((uint64_t)value, encoding.used_segments - 1, options.segments_storage_size, encoding.used_bits);
+            }
+            if (result.status != ResultStatus::Success) {
+                return result;
+            }
+            return flush_if_needed();
+        }
+        // serializes values with a segments header, computing the encoding of a block of values at once
+        Result push_segmented_uint32_values(const uint32_t* values, size_t count, PreparedUintOptions options, const SegmentTable* table);
+        // appends bytes for an array of single segment values, returns nullptr on failure
+        uint8_t* push_array_bytes(size_t count, uint32_t value_bytes);
+        // adds the free bits of an array of single segment values starting at byte_index
+        void push_array_free_bits(size_t byte_index, size_t count, uint32_t value_bytes, uint32_t max_bits);
 
+        // writes all the bytes that can't change anymore
         Result flush_buffer();
+        // flushes the buffer if the flush policy requires it
+        Result flush_if_needed();
+        // the amount of bytes at the start of the buffer that can't change anymore
+        size_t flushable_length();
+        // the error of a failed push into the buffer
+        Result buffer_push_error() const;
 
-        Result get_free_bits(SerializerFreeBits** result);
+        // opens zeroed bytes at the end of the buffer for the pending bits that don't fit in the free bits of the queue
+        Result open_free_bytes(size_t bit_count);
+        // writes the pending bits into the bytes at the start of the queue, returns true when a byte was filled
+        bool place_pending_bits();
+        void push_free_bits(size_t byte_index, uint32_t start);
     private:
         Writer* m_writer;
         // Allocator* m_allocator;
+        // the index in the output of the first byte in the buffer
         size_t m_start_index;
-        Vector<uint8_t> m_buffer;
-        Vector<SerializerFreeBits> m_free_bits;
+        // the amount of bytes at the start of the buffer which were already written
+        size_t m_flushed_count;
+        FlushPolicy m_flush_policy;
+        size_t m_flush_threshold;
+        Vector<uint8_t, PACKET_MASTER_INLINE_BUFFER_SIZE> m_buffer;
+        RingQueue<SerializerFreeBits, PACKET_MASTER_MAX_FREE_BYTES> m_free_bits;
+        // the bits of segments headers and bools go into the free bits of the queue in order, they wait here
+        // and are written into the bytes all at once when the register is full or the bytes are needed
+        uint64_t m_pending_bits;
+        uint32_t m_pending_count;
+        // the free bits of every byte in the queue, the pending bits take the first of them
+        uint32_t m_free_bit_count;
+        // bytes of serialize_bytes waiting to be written without a copy
+        RingQueue<SerializerSegment, PACKET_MASTER_MAX_SEGMENTS> m_segments;
+        #ifdef PACKET_MASTER_STATS
+        SerializerStats m_stats = {};
+        // the reallocations of the buffer are counted by the buffer itself
+        size_t m_reallocations_start = 0;
+        #endif
+};
+
+// Measures the output of a Serializer without producing it, e.g. to check that a packet fits the MTU or to size a buffer.
+// It has the same serialize methods and packs the bits the same way, filling the free bits of earlier bytes included,
+// so bytes() is exactly what a serializer outputs for the same values. It needs no Writer or Allocator and never fails.
+// Values with a single segment take the same space whatever they are, so they are counted without looking at them.
+class SizeCounter {
+    public:
+        SizeCounter();
+
+        Result serialize_uint8(uint8_t value, PreparedUintOptions options);
+        Result serialize_uint16(uint16_t value, PreparedUintOptions options);
+        Result serialize_uint32(uint32_t value, PreparedUintOptions options);
+        Result serialize_uint64(uint64_t value, PreparedUintOptions options);
+
+        template<typename Spec>
+        Result serialize_uint8(uint8_t value) { return count_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result serialize_uint16(uint16_t value) { return count_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result serialize_uint32(uint32_t value) { return count_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result serialize_uint64(uint64_t value) { return count_uint_spec<Spec>(value); }
+
+        Result serialize_int8(int8_t value, PreparedUintOptions options);
+        Result serialize_int16(int16_t value, PreparedUintOptions options);
+        Result serialize_int32(int32_t value, PreparedUintOptions options);
+        Result serialize_int64(int64_t value, PreparedUintOptions options);
+
+        template<typename Spec>
+        Result serialize_int8(int8_t value) { return count_uint_spec<Spec>(zigzag_encode_int8(value)); }
+        template<typename Spec>
+        Result serialize_int16(int16_t value) { return count_uint_spec<Spec>(zigzag_encode_int16(value)); }
+        template<typename Spec>
+        Result serialize_int32(int32_t value) { return count_uint_spec<Spec>(zigzag_encode_int32(value)); }
+        template<typename Spec>
+        Result serialize_int64(int64_t value) { return count_uint_spec<Spec>(zigzag_encode_int64(value)); }
+
+        Result serialize_bool(bool value);
+
+        Result serialize_uint8_array(const uint8_t* values, size_t count, PreparedUintOptions options);
+        Result serialize_uint16_array(const uint16_t* values, size_t count, PreparedUintOptions options);
+        Result serialize_uint32_array(const uint32_t* values, size_t count, PreparedUintOptions options);
+
+        Result serialize_float_quantized(float value, float min, float max, float precision);
+        Result serialize_float_quantized(float value, PreparedFloatOptions options);
+        Result serialize_float_quantized_array(const float* values, size_t count, PreparedFloatOptions options);
+
+        Result serialize_uint8_delta(uint8_t value, uint8_t baseline, PreparedUintOptions options);
+        Result serialize_uint16_delta(uint16_t value, uint16_t baseline, PreparedUintOptions options);
+        Result serialize_uint32_delta(uint32_t value, uint32_t baseline, PreparedUintOptions options);
+        Result serialize_uint64_delta(uint64_t value, uint64_t baseline, PreparedUintOptions options);
+        Result serialize_int8_delta(int8_t value, int8_t baseline, PreparedUintOptions options);
+        Result serialize_int16_delta(int16_t value, int16_t baseline, PreparedUintOptions options);
+        Result serialize_int32_delta(int32_t value, int32_t baseline, PreparedUintOptions options);
+        Result serialize_int64_delta(int64_t value, int64_t baseline, PreparedUintOptions options);
+        Result serialize_float_quantized_delta(float value, float baseline, PreparedFloatOptions options);
+
+        Result serialize_bytes(const uint8_t* bytes, size_t size);
+
+        // Ends the packet like Serializer::finalize, the free bits left are padding.
+        // The counts go on, so the packets of a batch can be measured together.
+        Result finalize();
+        // Starts counting from zero
+        void reset();
+
+        // the bytes a serializer outputs for the values so far
+        inline size_t bytes() const { return m_bytes; }
+        // the bits of the values, segments headers and bools, without the padding
+        inline uint64_t bits() const { return m_bits; }
+    private:
+        // the same as the methods of Serializer, only the start of every byte with free bits is kept
+        inline void push_bit() {
+            m_bits++;
+            uint8_t* start = m_free_bits.first();
+            if (start == nullptr) {
+                m_bytes++;
+                start = m_free_bits.push(0);
+            }
+            (*start)++;
+            if (*start >= 8) {
+                m_free_bits.pop();
+            }
+        }
+        inline void push_bits(uint32_t count) {
+            m_bits += count;
+            uint8_t* start = m_free_bits.first();
+            while (count > 0 && start != nullptr) {
+                uint32_t write_count = (uint32_t)(8 - *start) < count ? (uint32_t)(8 - *start) : count;
+                *start += (uint8_t)write_count;
+                count -= write_count;
+                if (*start >= 8) {
+                    m_free_bits.pop();
+                    start = m_free_bits.first();
+                }
+            }
+            if (count > 0) {
+                m_bytes += (count + 8 - 1) / 8;
+                push_free_bits(count % 8);
+            }
+        }
+        inline void push_value_bytes(uint32_t used_bits) {
+            m_bits += used_bits;
+            m_bytes += (used_bits + 8 - 1) / 8;
+            push_free_bits(used_bits % 8);
+        }
+        inline void push_free_bits(uint32_t start) {
+            if (start == 0) {
+                return;
+            }
+            if (m_free_bits.full()) {
+                m_free_bits.pop();
+            }
+            m_free_bits.push((uint8_t)start);
+        }
+        // a value with its used bits counted already
+        inline void push_uint(uint32_t used_bits, const PreparedUintOptions& options) {
+            if (options.segment_count == 1) {
+                push_value_bytes(options.max_bits);
+                return;
+            }
+            UintEncoding encoding = encode_uint(used_bits, options);
+            push_bits(options.segments_storage_size);
+            push_value_bytes(encoding.used_bits);
+        }
+        void push_array(size_t count, PreparedUintOptions options);
+
+        template<typename Spec, typename T>
+        inline Result count_uint_spec(T value) {
+            constexpr PreparedUintOptions options = Spec::options;
+            static_assert(options.max_bits <= sizeof(T) * 8, "the spec has more bits than the type");
+            if constexpr (options.segment_count == 1) {
+                push_value_bytes(options.max_bits);
+            }
+            else {
+                push_uint(count_used_bits_uint64((uint64_t)value), options);
+            }
+            return Result(ResultStatus::Success);
+        }
+        template<typename T, typename Options>
+        inline Result count_delta(T value, T baseline, Options options, Result (SizeCounter::*serialize)(T, Options)) {
+            bool changed = value != baseline;
+            push_bit();
+            if (!changed) {
+                return Result(ResultStatus::Success);
+            }
+            return (this->*serialize)(value, options);
+        }
+
+        RingQueue<uint8_t, PACKET_MASTER_MAX_FREE_BYTES> m_free_bits;
+        size_t m_bytes;
+        uint64_t m_bits;
+};
+
+// The state of a deserializer at a point between two values, see Deserializer::checkpoint
+struct DeserializerCheckpoint {
+    RingQueue<DeserializerFreeBits, PACKET_MASTER_MAX_FREE_BYTES> free_bits;
+    uint64_t loaded_bits;
+    uint64_t loaded_ends;
+    uint32_t loaded_count;
+    size_t offset;
+#ifdef PACKET_MASTER_STATS
+    // the values deserialized again after a rewind are not counted twice
+    DeserializerStats stats;
+#endif
 };
 
 class Deserializer {
     public:
         Deserializer(Reader* reader, Allocator* allocator);
+        // Deserializes straight from memory that already holds the whole input, without a reader.
+        // The memory must stay valid while the deserializer is used.
+        Deserializer(const uint8_t* data, size_t size);
         ~Deserializer();
 
         // deserialize uint8_t with max amount of bits specified. returns 0 on failure with an error in the result
@@ -302,18 +1141,165 @@ class Deserializer {
         // deserialize uint32_t with max amount of bits specified in order to reduce the required storage space
         Result deserialize_uint32(PreparedUintOptions options, uint32_t* value);
 
+        // deserialize uint64_t with max amount of bits specified in order to reduce the required storage space
+        Result deserialize_uint64(PreparedUintOptions options, uint64_t* value);
+
+        // deserialize with options known at compile time, e.g. deserialize_uint16<UintSpec<10>>(&value)
+        template<typename Spec>
+        Result deserialize_uint8(uint8_t* value) { return deserialize_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result deserialize_uint16(uint16_t* value) { return deserialize_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result deserialize_uint32(uint32_t* value) { return deserialize_uint_spec<Spec>(value); }
+        template<typename Spec>
+        Result deserialize_uint64(uint64_t* value) { return deserialize_uint_spec<Spec>(value); }
+
+        // deserialize signed values serialized by serialize_intN
+        Result deserialize_int8(PreparedUintOptions options, int8_t* value);
+        Result deserialize_int16(PreparedUintOptions options, int16_t* value);
+        Result deserialize_int32(PreparedUintOptions options, int32_t* value);
+        Result deserialize_int64(PreparedUintOptions options, int64_t* value);
+
+        // deserialize signed values with options known at compile time, e.g. deserialize_int16<IntRangeSpec<-500, 500>>(&value)
+        template<typename Spec>
+        Result deserialize_int8(int8_t* value) { return deserialize_int_spec<Spec, uint8_t>(value, zigzag_decode_int8); }
+        template<typename Spec>
+        Result deserialize_int16(int16_t* value) { return deserialize_int_spec<Spec, uint16_t>(value, zigzag_decode_int16); }
+        template<typename Spec>
+        Result deserialize_int32(int32_t* value) { return deserialize_int_spec<Spec, uint32_t>(value, zigzag_decode_int32); }
+        template<typename Spec>
+        Result deserialize_int64(int64_t* value) { return deserialize_int_spec<Spec, uint64_t>(value, zigzag_decode_int64); }
+
         // Deserialize bool, returns false on failure with an error in the result
         Result deserialize_bool(bool* value);
 
+        // deserialize an array of values that share the same options, serialized by serialize_uintN_array or one by one
+        Result deserialize_uint8_array(PreparedUintOptions options, uint8_t* values, size_t count);
+        Result deserialize_uint16_array(PreparedUintOptions options, uint16_t* values, size_t count);
+        Result deserialize_uint32_array(PreparedUintOptions options, uint32_t* values, size_t count);
+
+        // deserialize a float serialized by serialize_float_quantized with the same options
+        Result deserialize_float_quantized(float min, float max, float precision, float* value);
+        Result deserialize_float_quantized(PreparedFloatOptions options, float* value);
+        Result deserialize_float_quantized_array(PreparedFloatOptions options, float* values, size_t count);
+
+        // deserialize values serialized by serialize_xxx_delta with the same baseline, an unchanged value is set to the baseline
+        Result deserialize_uint8_delta(PreparedUintOptions options, uint8_t baseline, uint8_t* value);
+        Result deserialize_uint16_delta(PreparedUintOptions options, uint16_t baseline, uint16_t* value);
+        Result deserialize_uint32_delta(PreparedUintOptions options, uint32_t baseline, uint32_t* value);
+        Result deserialize_uint64_delta(PreparedUintOptions options, uint64_t baseline, uint64_t* value);
+        Result deserialize_int8_delta(PreparedUintOptions options, int8_t baseline, int8_t* value);
+        Result deserialize_int16_delta(PreparedUintOptions options, int16_t baseline, int16_t* value);
+        Result deserialize_int32_delta(PreparedUintOptions options, int32_t baseline, int32_t* value);
+        Result deserialize_int64_delta(PreparedUintOptions options, int64_t baseline, int64_t* value);
+        // the baseline is quantized as well, so an unchanged value is the same as the deserialized baseline
+        Result deserialize_float_quantized_delta(PreparedFloatOptions options, float baseline, float* value);
+
+        // deserialize raw bytes serialized by serialize_bytes, the size is not serialized so it has to be known
+        Result deserialize_bytes(uint8_t* bytes, size_t size);
+
         // Resets the deserializer so it can be used again, preventing memory allocations
+        // when deserializing from memory it starts again from the beginning
         void reset();
+
+        // The amount of bytes consumed from the memory, only meaningful when constructed with memory
+        inline size_t offset() const { return m_offset; }
+
+        // Saves the state between two values, rewinding to it undoes the values deserialized after it, e.g. one that failed
+        // because its bytes were not received yet. With a reader, the reader has to go back to the same position by itself.
+        DeserializerCheckpoint checkpoint() const;
+        void rewind(const DeserializerCheckpoint& checkpoint);
+
+        // A copy of the counters, all zeros without PACKET_MASTER_STATS
+        DeserializerStats stats() const;
+        void reset_stats();
     private:
+        // returns nullptr when there are not enough bytes left
+        inline const uint8_t* read_bytes(size_t count) {
+            if (m_reader == nullptr) {
+                if (count > m_size - m_offset) {
+                    return nullptr;
+                }
+                const uint8_t* bytes = m_data + m_offset;
+                m_offset += count;
+                PACKET_MASTER_STAT(m_stats.bytes += count);
+                return bytes;
+            }
+            PACKET_MASTER_STAT(m_stats.bytes += count);
+            PACKET_MASTER_STAT(m_stats.reads++);
+            return m_reader->read(count);
+        }
+
         Result read_bit(uint8_t* value);
         Result read_bits(size_t count, uint32_t* bits);
+        // moves the free bits of the queue into the loaded register until it has at least count bits,
+        // new bytes are read only when the queue is empty
+        Result load_free_bits(size_t count);
+        Result read_uint(PreparedUintOptions options, uint64_t* value);
+        // reads the used bytes of a value, the value is 0 on failure
+        Result read_value_bytes(uint32_t used_bits, uint64_t* value);
 
-        Result get_free_bits(DeserializerFreeBits** out_free_bits);
+        template<typename Spec, typename T>
+        inline Result deserialize_uint_spec(T* value) {
+            constexpr PreparedUintOptions options = Spec::options;
+            static_assert(options.max_bits <= sizeof(T) * 8, "the spec has more bits than the type");
+            uint64_t result_value;
+            Result result;
+            if constexpr (options.segment_count == 1) {
+                result = read_value_bytes(options.max_bits, &result_value);
+            }
+            else {
+                uint32_t segments_header;
+                result = read_bits(options.segments_storage_size, &segments_header);
+                if (result.status != ResultStatus::Success) {
+                    *value = 0;
+                    return result;
+                }
+                result = read_value_bytes(decode_used_bits((uint32_t)segments_header + 1, options), &result_value);
+            }
+            *value = (T)result_value;
+            return result;
+        }
+        template<typename Spec, typename U, typename T>
+        inline Result deserialize_int_spec(T* value, T (*decode)(U)) {
+            U zigzag;
+            Result result = deserialize_uint_spec<Spec>(&zigzag);
+            *value = decode(zigzag);
+            return result;
+        }
+        // adds the free bits of an array of single segment values
+        void push_array_free_bits(const uint8_t* bytes, size_t count, uint32_t value_bytes, uint32_t max_bits);
+
+        // reads the changed bit and then the value with the given method only when it changed
+        template<typename T, typename Options>
+        inline Result deserialize_delta(Options options, T baseline, T* value, Result (Deserializer::*deserialize)(Options, T*)) {
+            uint8_t changed;
+            Result result = read_bit(&changed);
+            if (result.status != ResultStatus::Success) {
+                *value = 0;
+                return result;
+            }
+            if (!changed) {
+                *value = baseline;
+                return result;
+            }
+            return (this->*deserialize)(options, value);
+        }
+        void push_free_bits(uint8_t byte, uint32_t start);
     private:
         Reader* m_reader;
         Allocator* m_allocator;
-        Vector<DeserializerFreeBits> m_free_bits;
+        // the memory input, used when there is no reader
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_offset;
+        RingQueue<DeserializerFreeBits, PACKET_MASTER_MAX_FREE_BYTES> m_free_bits;
+        // the free bits of the oldest bytes are moved out of the queue into this register and read from it,
+        // a set bit in m_loaded_ends is the last bit of a byte, so the bytes in the register can still be closed
+        uint64_t m_loaded_bits;
+        uint64_t m_loaded_ends;
+        uint32_t m_loaded_count;
+        #ifdef PACKET_MASTER_STATS
+        DeserializerStats m_stats = {};
+        #endif
 };
\ No newline at end of file
@@ -0,0 +1,189 @@
+#include "packet_master_coro.h"
+
+#ifdef PACKET_MASTER_COROUTINES
+
+#include <exception>
+#include <new>
+#include <stdint.h>
+
+// The allocator of a frame is kept in front of it, aligned like the frame itself
+#define FRAME_HEADER_SIZE __STDCPP_DEFAULT_NEW_ALIGNMENT__
+
+void* DecodeTask::alloc_frame(size_t size, StreamDeserializer* stream) noexcept {
+    Allocator* allocator = stream != nullptr ? stream->allocator() : nullptr;
+    uint8_t* memory;
+    if (allocator != nullptr) {
+        memory = (uint8_t*)allocator->alloc(size + FRAME_HEADER_SIZE);
+    }
+    else {
+        memory = (uint8_t*)::operator new(size + FRAME_HEADER_SIZE, std::nothrow);
+    }
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    *(Allocator**)memory = allocator;
+    return memory + FRAME_HEADER_SIZE;
+}
+
+void DecodeTask::promise_type::operator delete(void* frame, size_t size) noexcept {
+    uint8_t* memory = (uint8_t*)frame - FRAME_HEADER_SIZE;
+    Allocator* allocator = *(Allocator**)memory;
+    if (allocator != nullptr) {
+        allocator->free(memory, size + FRAME_HEADER_SIZE);
+    }
+    else {
+        ::operator delete(memory);
+    }
+}
+
+void DecodeTask::promise_type::unhandled_exception() {
+    // nothing in this library throws, a decode function which does is a bug
+    std::terminate();
+}
+
+std::coroutine_handle<> DecodeTask::FinalAwaiter::await_suspend(Handle handle) noexcept {
+    std::coroutine_handle<> continuation = handle.promise().continuation;
+    if (continuation) {
+        return continuation;
+    }
+    return std::noop_coroutine();
+}
+
+DecodeTask& DecodeTask::operator=(DecodeTask&& other) {
+    if (this != &other) {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+        m_handle = other.m_handle;
+        other.m_handle = Handle();
+    }
+    return *this;
+}
+
+DecodeTask::~DecodeTask() {
+    if (m_handle) {
+        m_handle.destroy();
+    }
+}
+
+void DecodeTask::start() {
+    if (m_handle && !m_handle.done()) {
+        m_handle.resume();
+    }
+}
+
+Result DecodeTask::result() const {
+    if (!m_handle) {
+        return Result(ResultStatus::MemoryAllocationFailed);
+    }
+    return m_handle.promise().result;
+}
+
+std::coroutine_handle<> DecodeTask::await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    m_handle.promise().continuation = awaiting;
+    return m_handle;
+}
+
+StreamDeserializer::StreamDeserializer(Allocator* allocator)
+    : m_allocator(allocator), m_reader{read_callback, this}, m_deserializer(&m_reader, allocator), m_window(allocator), m_window_offset(0),
+    m_chunk(nullptr), m_chunk_size(0), m_chunk_offset(0), m_waiting(nullptr), m_closed(false) {}
+
+Result StreamDeserializer::push(const uint8_t* data, size_t size) {
+    if (m_closed) {
+        return Result(ResultStatus::InvalidArgument);
+    }
+    m_chunk = data;
+    m_chunk_size = size;
+    m_chunk_offset = 0;
+    StreamWait* waiting = m_waiting;
+    if (waiting != nullptr && try_value(waiting)) {
+        // the task runs until it waits for the next value or it is done
+        m_waiting = nullptr;
+        waiting->handle.resume();
+    }
+
+    // keeping the bytes that weren't consumed, the chunk is not valid after the push
+    if (m_window_offset > 0) {
+        m_window.remove_many(0, m_window_offset);
+        m_window_offset = 0;
+    }
+    Result result = Result(ResultStatus::Success);
+    if (m_chunk_offset < m_chunk_size && m_window.push_many(m_chunk + m_chunk_offset, m_chunk_size - m_chunk_offset) == nullptr) {
+        result = Result(ResultStatus::MemoryAllocationFailed);
+    }
+    m_chunk = nullptr;
+    m_chunk_size = 0;
+    m_chunk_offset = 0;
+    return result;
+}
+
+void StreamDeserializer::close() {
+    m_closed = true;
+    StreamWait* waiting = m_waiting;
+    if (waiting != nullptr) {
+        m_waiting = nullptr;
+        try_value(waiting);
+        waiting->handle.resume();
+    }
+}
+
+void StreamDeserializer::end_packet() {
+    m_deserializer.reset();
+}
+
+// Reads from the window while it has bytes and from the chunk after it.
+// A read across the end of the window moves the bytes it needs from the chunk to the window.
+uint8_t* StreamDeserializer::read_callback(void* ctx, size_t size) {
+    StreamDeserializer* self = (StreamDeserializer*)ctx;
+    size_t window_left = self->m_window.length() - self->m_window_offset;
+    if (window_left > 0) {
+        if (window_left < size) {
+            size_t missing = size - window_left;
+            if (missing > self->m_chunk_size - self->m_chunk_offset) {
+                return nullptr;
+            }
+            if (self->m_window.push_many(self->m_chunk + self->m_chunk_offset, missing) == nullptr) {
+                return nullptr;
+            }
+            self->m_chunk_offset += missing;
+        }
+        uint8_t* bytes = self->m_window.ptr() + self->m_window_offset;
+        self->m_window_offset += size;
+        return bytes;
+    }
+    if (size > self->m_chunk_size - self->m_chunk_offset) {
+        return nullptr;
+    }
+    // the deserializer only reads from the bytes
+    uint8_t* bytes = (uint8_t*)self->m_chunk + self->m_chunk_offset;
+    self->m_chunk_offset += size;
+    return bytes;
+}
+
+bool StreamDeserializer::try_value(StreamWait* wait) {
+    if (wait->max_bytes <= buffered()) {
+        // every byte the value can need is here
+        wait->result = wait->deserialize(wait, &m_deserializer);
+        return true;
+    }
+    DeserializerCheckpoint checkpoint = m_deserializer.checkpoint();
+    size_t window_offset = m_window_offset;
+    size_t window_length = m_window.length();
+    size_t chunk_offset = m_chunk_offset;
+    wait->result = wait->deserialize(wait, &m_deserializer);
+    if (wait->result.status != ResultStatus::ReadFailed || m_closed) {
+        return true;
+    }
+    // going back to the start of the value, the bytes moved to the window stay there and are read from it again
+    m_deserializer.rewind(checkpoint);
+    m_window_offset = window_offset;
+    m_chunk_offset = chunk_offset + (m_window.length() - window_length);
+    return false;
+}
+
+void StreamDeserializer::wait(StreamWait* wait, std::coroutine_handle<> awaiting) {
+    wait->handle = awaiting;
+    m_waiting = wait;
+}
+
+#endif
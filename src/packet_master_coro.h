@@ -0,0 +1,219 @@
+#pragma once
+
+#include "packet_master.h"
+
+// Decoding of packets while their bytes are still being received, with C++20 coroutines.
+// A decode function is a coroutine which co_awaits every value from a StreamDeserializer, when the bytes of a value
+// were not received yet it suspends and push resumes it with the next bytes. The bytes are decoded straight from the
+// buffers passed to push, only the bytes left over at the end of a buffer are copied until the next one arrives.
+//
+//     DecodeTask decode_move(StreamDeserializer* stream, Move* move) {
+//         Result result = co_await stream->uint32(uint32_default_options(), &move->tick);
+//         if (result.status != ResultStatus::Success) {
+//             co_return result;
+//         }
+//         co_return co_await stream->float_quantized(position_options, &move->x);
+//     }
+//
+//     DecodeTask task = decode_move(&stream, &move);
+//     task.start();
+//     while (!task.done()) { stream.push(received, received_size); }
+//
+// Only available when the compiler supports coroutines (e.g. -std=c++20), PACKET_MASTER_COROUTINES is defined then.
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define PACKET_MASTER_COROUTINES
+
+#include <coroutine>
+
+class StreamDeserializer;
+
+// A decoding coroutine, it starts suspended and is destroyed with the task.
+// Awaiting a task from another one runs it as a part of the other one, e.g. a decode function for every struct.
+class DecodeTask {
+    public:
+        struct promise_type;
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            // continues the task which awaited this one
+            std::coroutine_handle<> await_suspend(Handle handle) noexcept;
+            void await_resume() const noexcept {}
+        };
+
+        struct promise_type {
+            Result result = Result(ResultStatus::Success);
+            std::coroutine_handle<> continuation;
+
+            // the frame is allocated with the allocator of the stream when it is the first argument of the coroutine,
+            // the rest of the arguments are ignored.
+            // GCC can't match a template operator new with the delete below, without optimizations it warns with
+            // -Wmismatched-new-delete at every coroutine. The frames are freed correctly, the warning can be ignored around them.
+            template<typename... Args>
+            static void* operator new(size_t size, StreamDeserializer* stream, const Args&...) noexcept { return alloc_frame(size, stream); }
+            static void* operator new(size_t size) noexcept { return alloc_frame(size, nullptr); }
+            static void operator delete(void* frame, size_t size) noexcept;
+            // a frame that failed to allocate is a done task with ResultStatus::MemoryAllocationFailed
+            static DecodeTask get_return_object_on_allocation_failure() { return DecodeTask(); }
+
+            DecodeTask get_return_object() { return DecodeTask(Handle::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void return_value(Result value) { result = value; }
+            void unhandled_exception();
+        };
+
+        DecodeTask() : m_handle() {}
+        DecodeTask(DecodeTask&& other) : m_handle(other.m_handle) { other.m_handle = Handle(); }
+        DecodeTask& operator=(DecodeTask&& other);
+        DecodeTask(const DecodeTask&) = delete;
+        ~DecodeTask();
+
+        // Runs the task until it needs bytes which were not pushed yet, or until it is done
+        void start();
+        inline bool done() const { return !m_handle || m_handle.done(); }
+        // The result the task returned, only meaningful once it is done
+        Result result() const;
+
+        // awaiting a task runs it and returns its result
+        bool await_ready() const noexcept { return !m_handle; }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept;
+        Result await_resume() const { return result(); }
+    private:
+        explicit DecodeTask(Handle handle) : m_handle(handle) {}
+        static void* alloc_frame(size_t size, StreamDeserializer* stream) noexcept;
+
+        Handle m_handle;
+};
+
+// Internal, a value waiting for its bytes
+struct StreamWait {
+    // deserializes the value, called again from the start when it failed because of missing bytes
+    Result (*deserialize)(StreamWait*, Deserializer*);
+    // the most bytes the value can read, there is no need to save a checkpoint when they are all received
+    size_t max_bytes;
+    Result result;
+    std::coroutine_handle<> handle;
+};
+
+// The value of a co_await, deserialize(deserializer) deserializes it with a Deserializer method
+template<typename F>
+struct StreamValue : StreamWait {
+    StreamValue(StreamDeserializer* stream, size_t max_bytes, F function) : stream(stream), function(function) {
+        this->deserialize = call;
+        this->max_bytes = max_bytes;
+        this->result = Result(ResultStatus::Success);
+    }
+    static Result call(StreamWait* wait, Deserializer* deserializer) {
+        return ((StreamValue*)wait)->function(deserializer);
+    }
+
+    StreamDeserializer* stream;
+    F function;
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<> awaiting);
+    Result await_resume() const { return result; }
+};
+
+// The most bytes a value with the options reads, the segments header and then the used bytes
+constexpr size_t uint_max_bytes(PreparedUintOptions options) {
+    return (options.segments_storage_size + 7) / 8 + (options.max_bits + 7) / 8;
+}
+
+class StreamDeserializer {
+    public:
+        StreamDeserializer(Allocator* allocator);
+        StreamDeserializer(const StreamDeserializer&) = delete;
+
+        // Hands received bytes to the value waiting for them and resumes its task, which runs until it needs more.
+        // The bytes only have to stay valid during the call, the ones the task didn't consume are copied.
+        // Fails with ResultStatus::MemoryAllocationFailed when they can't be copied, or ResultStatus::InvalidArgument after close.
+        Result push(const uint8_t* data, size_t size);
+        // No more bytes will come, the waiting value fails with ResultStatus::ReadFailed
+        void close();
+        // The next packet starts at a byte boundary, the free bits left in the packet before it are dropped
+        void end_packet();
+
+        // A value deserialized with a Deserializer method, e.g. co_await stream->value(8, [&](Deserializer* deserializer) {...}).
+        // max_bytes are the most bytes the method can read, SIZE_MAX when it is not known.
+        template<typename F>
+        StreamValue<F> value(size_t max_bytes, F deserialize) {
+            return StreamValue<F>(this, max_bytes, deserialize);
+        }
+
+        inline auto uint8(PreparedUintOptions options, uint8_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_uint8(options, value); });
+        }
+        inline auto uint16(PreparedUintOptions options, uint16_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_uint16(options, value); });
+        }
+        inline auto uint32(PreparedUintOptions options, uint32_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_uint32(options, value); });
+        }
+        inline auto uint64(PreparedUintOptions options, uint64_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_uint64(options, value); });
+        }
+        inline auto int8(PreparedUintOptions options, int8_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_int8(options, value); });
+        }
+        inline auto int16(PreparedUintOptions options, int16_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_int16(options, value); });
+        }
+        inline auto int32(PreparedUintOptions options, int32_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_int32(options, value); });
+        }
+        inline auto int64(PreparedUintOptions options, int64_t* value) {
+            return this->value(uint_max_bytes(options), [=](Deserializer* d) { return d->deserialize_int64(options, value); });
+        }
+        inline auto boolean(bool* value) {
+            return this->value(1, [=](Deserializer* d) { return d->deserialize_bool(value); });
+        }
+        inline auto float_quantized(PreparedFloatOptions options, float* value) {
+            return this->value(uint_max_bytes(options.uint_options), [=](Deserializer* d) { return d->deserialize_float_quantized(options, value); });
+        }
+        inline auto uint32_array(PreparedUintOptions options, uint32_t* values, size_t count) {
+            return this->value(uint_max_bytes(options) * count, [=](Deserializer* d) { return d->deserialize_uint32_array(options, values, count); });
+        }
+        inline auto bytes(uint8_t* bytes, size_t size) {
+            return this->value(size, [=](Deserializer* d) { return d->deserialize_bytes(bytes, size); });
+        }
+
+        // the bytes received but not consumed yet
+        inline size_t buffered() const { return m_window.length() - m_window_offset + m_chunk_size - m_chunk_offset; }
+        inline Allocator* allocator() const { return m_allocator; }
+    private:
+        template<typename F>
+        friend struct StreamValue;
+
+        static uint8_t* read_callback(void* ctx, size_t size);
+        // deserializes the value, false when its bytes were not received yet and nothing was consumed
+        bool try_value(StreamWait* wait);
+        void wait(StreamWait* wait, std::coroutine_handle<> awaiting);
+
+        Allocator* m_allocator;
+        Reader m_reader;
+        Deserializer m_deserializer;
+        // the bytes left over from earlier pushes, they are read before the current chunk
+        Vector<uint8_t> m_window;
+        size_t m_window_offset;
+        // the bytes of the push in progress
+        const uint8_t* m_chunk;
+        size_t m_chunk_size;
+        size_t m_chunk_offset;
+        StreamWait* m_waiting;
+        bool m_closed;
+};
+
+template<typename F>
+bool StreamValue<F>::await_ready() {
+    return stream->try_value(this);
+}
+
+template<typename F>
+void StreamValue<F>::await_suspend(std::coroutine_handle<> awaiting) {
+    stream->wait(this, awaiting);
+}
+
+#endif
@@ -0,0 +1,302 @@
+#pragma once
+
+#include "packet_master.h"
+
+// Describes the fields of a struct once, serialize_fields and deserialize_fields are generated from the description.
+// Every field has its options known at compile time so each field is a straight line of inlined code.
+//
+// struct Coordinate {
+//     static constexpr PreparedFloatOptions options = float_quantized_options(-1000.0f, 1000.0f, 0.01f);
+// };
+// struct Player {
+//     uint32_t id;
+//     int16_t speed;
+//     bool alive;
+//     float x;
+// };
+// PM_FIELDS(Player,
+//     PM_UINT(id, UintSpec<20>),
+//     PM_INT(speed, IntRangeSpec<-500, 500>),
+//     PM_BOOL(alive),
+//     PM_FLOAT(x, Coordinate)
+// )
+//
+// PM_FIELDS has to be used in the global scope. It is the same as specializing PacketFields by hand:
+// template<> struct PacketFields<Player> { typedef FieldList<UintField<&Player::id, UintSpec<20>>, ...> List; };
+
+// Specialized for every described struct, List is a FieldList of its fields
+template<typename T>
+struct PacketFields;
+
+#define PM_FIELDS(Type, ...) \
+    template<> \
+    struct PacketFields<Type> { \
+        typedef Type Self; \
+        typedef FieldList<__VA_ARGS__> List; \
+    };
+
+// the spec can have commas, e.g. PM_UINT(value, UintSpec<18, 1>)
+#define PM_UINT(member, ...) UintField<&Self::member, __VA_ARGS__>
+#define PM_INT(member, ...) IntField<&Self::member, __VA_ARGS__>
+#define PM_BOOL(member) BoolField<&Self::member>
+// the spec is a type with a `static constexpr PreparedFloatOptions options` member
+#define PM_FLOAT(member, ...) FloatField<&Self::member, __VA_ARGS__>
+// a member which is a described struct itself
+#define PM_STRUCT(member) StructField<&Self::member>
+
+// Serializes the described fields in order, stops at the first failure.
+// The serializer is a template so anything with the same methods as Serializer works.
+template<typename T, typename S>
+inline Result serialize_fields(S* serializer, const T& object) {
+    return PacketFields<T>::List::serialize(serializer, object);
+}
+template<typename T>
+inline Result deserialize_fields(Deserializer* deserializer, T* object) {
+    return PacketFields<T>::List::deserialize(deserializer, object);
+}
+
+// Delta encodes every field against the same field of the baseline, like serialize_xxx_delta
+template<typename T, typename S>
+inline Result serialize_fields_delta(S* serializer, const T& object, const T& baseline) {
+    return PacketFields<T>::List::serialize_delta(serializer, object, baseline);
+}
+template<typename T>
+inline Result deserialize_fields_delta(Deserializer* deserializer, const T& baseline, T* object) {
+    return PacketFields<T>::List::deserialize_delta(deserializer, baseline, object);
+}
+
+// Internal
+template<typename M>
+struct MemberPointer;
+template<typename C, typename M>
+struct MemberPointer<M C::*> {
+    typedef C Class;
+    typedef M Type;
+};
+
+template<typename... Fields>
+struct FieldList {
+    template<typename S, typename T>
+    static inline Result serialize(S* serializer, const T& object) {
+        Result result(ResultStatus::Success);
+        (void)(... && ((result = Fields::serialize(serializer, object)).status == ResultStatus::Success));
+        return result;
+    }
+    template<typename T>
+    static inline Result deserialize(Deserializer* deserializer, T* object) {
+        Result result(ResultStatus::Success);
+        (void)(... && ((result = Fields::deserialize(deserializer, object)).status == ResultStatus::Success));
+        return result;
+    }
+    template<typename S, typename T>
+    static inline Result serialize_delta(S* serializer, const T& object, const T& baseline) {
+        Result result(ResultStatus::Success);
+        (void)(... && ((result = Fields::serialize_delta(serializer, object, baseline)).status == ResultStatus::Success));
+        return result;
+    }
+    template<typename T>
+    static inline Result deserialize_delta(Deserializer* deserializer, const T& baseline, T* object) {
+        Result result(ResultStatus::Success);
+        (void)(... && ((result = Fields::deserialize_delta(deserializer, baseline, object)).status == ResultStatus::Success));
+        return result;
+    }
+};
+
+// The delta of a field is the same as serialize_xxx_delta, a changed bit and then the field only when it changed.
+// Field is the field type itself, besides serialize/deserialize it has changed() and copy() for its member.
+template<typename Field>
+struct DeltaField {
+    template<typename S, typename T>
+    static inline Result serialize_delta(S* serializer, const T& object, const T& baseline) {
+        bool changed = Field::changed(object, baseline);
+        Result result = serializer->serialize_bool(changed);
+        if (result.status != ResultStatus::Success || !changed) {
+            return result;
+        }
+        return Field::serialize(serializer, object);
+    }
+    template<typename T>
+    static inline Result deserialize_delta(Deserializer* deserializer, const T& baseline, T* object) {
+        bool changed;
+        Result result = deserializer->deserialize_bool(&changed);
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+        if (!changed) {
+            Field::copy(baseline, object);
+            return result;
+        }
+        return Field::deserialize(deserializer, object);
+    }
+};
+
+template<auto Member>
+struct ValueField {
+    typedef typename MemberPointer<decltype(Member)>::Class Class;
+    typedef typename MemberPointer<decltype(Member)>::Type Type;
+
+    static inline bool changed(const Class& object, const Class& baseline) {
+        return object.*Member != baseline.*Member;
+    }
+    static inline void copy(const Class& baseline, Class* object) {
+        object->*Member = baseline.*Member;
+    }
+};
+
+template<auto Member, typename Spec>
+struct UintField : ValueField<Member>, DeltaField<UintField<Member, Spec>> {
+    typedef typename ValueField<Member>::Class Class;
+    typedef typename ValueField<Member>::Type Type;
+
+    template<typename S>
+    static inline Result serialize(S* serializer, const Class& object) {
+        Type value = object.*Member;
+        if constexpr (sizeof(Type) == sizeof(uint8_t)) {
+            return serializer->template serialize_uint8<Spec>((uint8_t)value);
+        }
+        else if constexpr (sizeof(Type) == sizeof(uint16_t)) {
+            return serializer->template serialize_uint16<Spec>((uint16_t)value);
+        }
+        else if constexpr (sizeof(Type) == sizeof(uint32_t)) {
+            return serializer->template serialize_uint32<Spec>((uint32_t)value);
+        }
+        else {
+            return serializer->template serialize_uint64<Spec>((uint64_t)value);
+        }
+    }
+    static inline Result deserialize(Deserializer* deserializer, Class* object) {
+        Result result;
+        if constexpr (sizeof(Type) == sizeof(uint8_t)) {
+            uint8_t value;
+            result = deserializer->deserialize_uint8<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        else if constexpr (sizeof(Type) == sizeof(uint16_t)) {
+            uint16_t value;
+            result = deserializer->deserialize_uint16<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        else if constexpr (sizeof(Type) == sizeof(uint32_t)) {
+            uint32_t value;
+            result = deserializer->deserialize_uint32<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        else {
+            uint64_t value;
+            result = deserializer->deserialize_uint64<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        return result;
+    }
+};
+
+template<auto Member, typename Spec>
+struct IntField : ValueField<Member>, DeltaField<IntField<Member, Spec>> {
+    typedef typename ValueField<Member>::Class Class;
+    typedef typename ValueField<Member>::Type Type;
+
+    template<typename S>
+    static inline Result serialize(S* serializer, const Class& object) {
+        Type value = object.*Member;
+        if constexpr (sizeof(Type) == sizeof(int8_t)) {
+            return serializer->template serialize_int8<Spec>((int8_t)value);
+        }
+        else if constexpr (sizeof(Type) == sizeof(int16_t)) {
+            return serializer->template serialize_int16<Spec>((int16_t)value);
+        }
+        else if constexpr (sizeof(Type) == sizeof(int32_t)) {
+            return serializer->template serialize_int32<Spec>((int32_t)value);
+        }
+        else {
+            return serializer->template serialize_int64<Spec>((int64_t)value);
+        }
+    }
+    static inline Result deserialize(Deserializer* deserializer, Class* object) {
+        Result result;
+        if constexpr (sizeof(Type) == sizeof(int8_t)) {
+            int8_t value;
+            result = deserializer->deserialize_int8<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        else if constexpr (sizeof(Type) == sizeof(int16_t)) {
+            int16_t value;
+            result = deserializer->deserialize_int16<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        else if constexpr (sizeof(Type) == sizeof(int32_t)) {
+            int32_t value;
+            result = deserializer->deserialize_int32<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        else {
+            int64_t value;
+            result = deserializer->deserialize_int64<Spec>(&value);
+            object->*Member = (Type)value;
+        }
+        return result;
+    }
+};
+
+template<auto Member>
+struct BoolField : ValueField<Member>, DeltaField<BoolField<Member>> {
+    typedef typename ValueField<Member>::Class Class;
+
+    template<typename S>
+    static inline Result serialize(S* serializer, const Class& object) {
+        return serializer->serialize_bool(object.*Member);
+    }
+    static inline Result deserialize(Deserializer* deserializer, Class* object) {
+        return deserializer->deserialize_bool(&(object->*Member));
+    }
+};
+
+// the step of a quantized float as a uint spec
+template<typename FloatSpec>
+struct FloatStepSpec {
+    static constexpr PreparedUintOptions options = FloatSpec::options.uint_options;
+};
+
+template<auto Member, typename Spec>
+struct FloatField : ValueField<Member>, DeltaField<FloatField<Member, Spec>> {
+    typedef typename ValueField<Member>::Class Class;
+
+    // floats are compared after quantization like serialize_float_quantized_delta
+    static inline bool changed(const Class& object, const Class& baseline) {
+        return quantize_float(object.*Member, Spec::options) != quantize_float(baseline.*Member, Spec::options);
+    }
+    static inline void copy(const Class& baseline, Class* object) {
+        object->*Member = dequantize_float(quantize_float(baseline.*Member, Spec::options), Spec::options);
+    }
+    template<typename S>
+    static inline Result serialize(S* serializer, const Class& object) {
+        return serializer->template serialize_uint32<FloatStepSpec<Spec>>(quantize_float(object.*Member, Spec::options));
+    }
+    static inline Result deserialize(Deserializer* deserializer, Class* object) {
+        uint32_t step;
+        Result result = deserializer->deserialize_uint32<FloatStepSpec<Spec>>(&step);
+        object->*Member = result.status == ResultStatus::Success ? dequantize_float(step, Spec::options) : 0.0f;
+        return result;
+    }
+};
+
+// a described struct is delta encoded field by field against the same struct of the baseline
+template<auto Member>
+struct StructField {
+    typedef typename MemberPointer<decltype(Member)>::Class Class;
+    typedef typename MemberPointer<decltype(Member)>::Type Type;
+
+    template<typename S>
+    static inline Result serialize(S* serializer, const Class& object) {
+        return serialize_fields(serializer, object.*Member);
+    }
+    static inline Result deserialize(Deserializer* deserializer, Class* object) {
+        return deserialize_fields(deserializer, &(object->*Member));
+    }
+    template<typename S>
+    static inline Result serialize_delta(S* serializer, const Class& object, const Class& baseline) {
+        return serialize_fields_delta(serializer, object.*Member, baseline.*Member);
+    }
+    static inline Result deserialize_delta(Deserializer* deserializer, const Class& baseline, Class* object) {
+        return deserialize_fields_delta(deserializer, baseline.*Member, &(object->*Member));
+    }
+};
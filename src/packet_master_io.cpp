@@ -0,0 +1,535 @@
+#include "packet_master_io.h"
+
+#ifdef PACKET_MASTER_POSIX_IO
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// The segments converted to iovecs at once, IOV_MAX is at least 16
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define FD_WRITER_IOVECS IOV_MAX
+#else
+#define FD_WRITER_IOVECS 64
+#endif
+
+FdWriter::FdWriter(int fd) : m_fd(fd), m_syscalls(0) {}
+
+Writer FdWriter::writer() {
+    Writer writer{};
+    writer.write_callback = write_callback;
+    writer.writev_callback = writev_callback;
+    writer.ctx = this;
+    return writer;
+}
+
+int FdWriter::write_callback(void* ctx, uint8_t* data, size_t size) {
+    FdWriter* self = (FdWriter*)ctx;
+    while (size > 0) {
+        self->m_syscalls++;
+        ssize_t written = ::write(self->m_fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+int FdWriter::writev_callback(void* ctx, const WriterSegment* segments, size_t count) {
+    FdWriter* self = (FdWriter*)ctx;
+    struct iovec iovecs[FD_WRITER_IOVECS];
+    // the bytes of the first segment which were already written by a partial write
+    size_t skip = 0;
+    while (count > 0) {
+        size_t iovec_count = count < FD_WRITER_IOVECS ? count : FD_WRITER_IOVECS;
+        for (size_t i = 0; i < iovec_count; i++) {
+            iovecs[i].iov_base = (void*)segments[i].data;
+            iovecs[i].iov_len = segments[i].size;
+        }
+        iovecs[0].iov_base = (uint8_t*)iovecs[0].iov_base + skip;
+        iovecs[0].iov_len -= skip;
+
+        self->m_syscalls++;
+        ssize_t written = ::writev(self->m_fd, iovecs, (int)iovec_count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        // skipping the segments which were written completely
+        size_t remaining = (size_t)written + skip;
+        skip = 0;
+        while (count > 0 && remaining >= segments->size) {
+            remaining -= segments->size;
+            segments++;
+            count--;
+        }
+        skip = remaining;
+    }
+    return 0;
+}
+
+static size_t page_size() {
+    long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? (size_t)size : 4096;
+}
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+MappedFileWriter::MappedFileWriter(const char* path, size_t chunk_size)
+    : m_fd(-1), m_error(0), m_data(nullptr), m_size(0), m_capacity(0), m_chunk_size(round_up(chunk_size > 0 ? chunk_size : 1, page_size())) {
+    m_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0) {
+        m_error = errno;
+    }
+}
+
+MappedFileWriter::~MappedFileWriter() {
+    close();
+}
+
+Writer MappedFileWriter::writer() {
+    Writer writer{};
+    writer.write_callback = write_callback;
+    writer.ctx = this;
+    return writer;
+}
+
+int MappedFileWriter::grow(size_t capacity) {
+    capacity = round_up(capacity, m_chunk_size);
+    if (ftruncate(m_fd, (off_t)capacity) != 0) {
+        return errno;
+    }
+    void* data;
+    if (m_data == nullptr) {
+        data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    }
+    else {
+        #ifdef MREMAP_MAYMOVE
+        data = mremap(m_data, m_capacity, capacity, MREMAP_MAYMOVE);
+        #else
+        munmap(m_data, m_capacity);
+        m_data = nullptr;
+        data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        #endif
+    }
+    if (data == MAP_FAILED) {
+        int error = errno;
+        // the file keeps the written bytes, close truncates it back
+        if (m_data == nullptr) {
+            m_capacity = 0;
+        }
+        return error;
+    }
+    m_data = (uint8_t*)data;
+    m_capacity = capacity;
+    return 0;
+}
+
+int MappedFileWriter::write_callback(void* ctx, uint8_t* data, size_t size) {
+    MappedFileWriter* self = (MappedFileWriter*)ctx;
+    if (self->m_fd < 0) {
+        return self->m_error != 0 ? self->m_error : EBADF;
+    }
+    if (self->m_data == nullptr && self->m_size > 0) {
+        // the mapping was lost when mmap failed after munmap, the written bytes are only in the file now
+        return self->m_error;
+    }
+    if (size > self->m_capacity - self->m_size) {
+        // at least a whole chunk so growing stays rare
+        size_t capacity = self->m_size + size;
+        if (capacity < self->m_capacity + self->m_chunk_size) {
+            capacity = self->m_capacity + self->m_chunk_size;
+        }
+        int error = self->grow(capacity);
+        if (error != 0) {
+            self->m_error = error;
+            return error;
+        }
+    }
+    memcpy(self->m_data + self->m_size, data, size);
+    self->m_size += size;
+    return 0;
+}
+
+int MappedFileWriter::close() {
+    if (m_fd < 0) {
+        return m_error;
+    }
+    if (m_data != nullptr) {
+        munmap(m_data, m_capacity);
+        m_data = nullptr;
+    }
+    if (m_capacity != m_size && ftruncate(m_fd, (off_t)m_size) != 0 && m_error == 0) {
+        m_error = errno;
+    }
+    if (::close(m_fd) != 0 && m_error == 0) {
+        m_error = errno;
+    }
+    m_fd = -1;
+    m_capacity = 0;
+    return m_error;
+}
+
+MappedFileReader::MappedFileReader(const char* path) : m_error(0), m_data(nullptr), m_size(0), m_offset(0) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        m_error = errno;
+        return;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        m_error = errno;
+        ::close(fd);
+        return;
+    }
+    // an empty file can't be mapped and has nothing to read anyway
+    if (file_stat.st_size > 0) {
+        void* data = mmap(nullptr, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            m_error = errno;
+        }
+        else {
+            m_data = (uint8_t*)data;
+            m_size = (size_t)file_stat.st_size;
+            // the file is usually read from start to end
+            madvise(data, m_size, MADV_SEQUENTIAL);
+        }
+    }
+    // the mapping stays valid after closing the file
+    ::close(fd);
+}
+
+MappedFileReader::~MappedFileReader() {
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+    }
+}
+
+Reader MappedFileReader::reader() {
+    Reader reader{};
+    reader.read_callback = read_callback;
+    reader.ctx = this;
+    return reader;
+}
+
+void MappedFileReader::seek(size_t offset) {
+    m_offset = offset < m_size ? offset : m_size;
+}
+
+uint8_t* MappedFileReader::read_callback(void* ctx, size_t size) {
+    MappedFileReader* self = (MappedFileReader*)ctx;
+    if (size > self->m_size - self->m_offset) {
+        return nullptr;
+    }
+    uint8_t* data = self->m_data + self->m_offset;
+    self->m_offset += size;
+    return data;
+}
+
+// The most buffers the io thread writes with a single writev
+#define ASYNC_WRITER_MAX_BATCH 64
+
+static uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct AsyncWriterBuffer {
+    uint8_t* data;
+    size_t size;
+    uint64_t published_ns;
+};
+
+struct AsyncWriterState {
+    AsyncWriterState(int fd) : fd_writer(fd), fd(fd_writer.writer()) {}
+
+    FdWriter fd_writer;
+    Writer fd;
+    AsyncWriterBuffer* buffers = nullptr;
+    size_t buffer_count = 0;
+    size_t buffer_size = 0;
+    AsyncBackpressure backpressure = AsyncBackpressure::Block;
+
+    // the buffers handed to the io thread and the buffers it wrote, the buffer at head is filled by the writing thread
+    // as long as head - tail is less than buffer_count. On their own cache lines so the threads don't share them.
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<bool> io_sleeping{false};
+    std::atomic<bool> writer_waiting{false};
+    std::atomic<bool> stop{false};
+    std::atomic<int> error{0};
+    // only used to sleep and wake up
+    std::mutex mutex;
+    std::condition_variable io_wake;
+    std::condition_variable writer_wake;
+    std::thread thread;
+
+    // counters of the writing thread, atomic as stats() may read them from another thread
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> full{0};
+    std::atomic<uint64_t> blocked_ns{0};
+    std::atomic<uint64_t> dropped_bytes{0};
+    // counters of the io thread
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> syscalls{0};
+    std::atomic<uint64_t> latency_histogram[ASYNC_WRITER_HISTOGRAM_BUCKETS] = {};
+};
+
+AsyncFdWriter::AsyncFdWriter(int fd, Allocator* allocator, size_t buffer_count, size_t buffer_size, AsyncBackpressure backpressure)
+    : m_allocator(allocator), m_state(nullptr) {
+    if (buffer_count == 0 || buffer_size == 0) {
+        return;
+    }
+    void* state = allocator->alloc(sizeof(AsyncWriterState));
+    AsyncWriterBuffer* buffers = (AsyncWriterBuffer*)allocator->alloc(sizeof(AsyncWriterBuffer) * buffer_count);
+    uint8_t* memory = (uint8_t*)allocator->alloc(buffer_count * buffer_size);
+    if (state == nullptr || buffers == nullptr || memory == nullptr) {
+        if (state != nullptr) {
+            allocator->free(state, sizeof(AsyncWriterState));
+        }
+        if (buffers != nullptr) {
+            allocator->free(buffers, sizeof(AsyncWriterBuffer) * buffer_count);
+        }
+        if (memory != nullptr) {
+            allocator->free(memory, buffer_count * buffer_size);
+        }
+        return;
+    }
+    m_state = new (state) AsyncWriterState(fd);
+    for (size_t i = 0; i < buffer_count; i++) {
+        buffers[i].data = memory + i * buffer_size;
+        buffers[i].size = 0;
+        buffers[i].published_ns = 0;
+    }
+    m_state->buffers = buffers;
+    m_state->buffer_count = buffer_count;
+    m_state->buffer_size = buffer_size;
+    m_state->backpressure = backpressure;
+    m_state->thread = std::thread(&AsyncFdWriter::run_io, this);
+}
+
+AsyncFdWriter::~AsyncFdWriter() {
+    if (m_state == nullptr) {
+        return;
+    }
+    close();
+    size_t buffer_count = m_state->buffer_count;
+    size_t buffer_size = m_state->buffer_size;
+    uint8_t* memory = m_state->buffers[0].data;
+    m_allocator->free(memory, buffer_count * buffer_size);
+    m_allocator->free(m_state->buffers, sizeof(AsyncWriterBuffer) * buffer_count);
+    m_state->~AsyncWriterState();
+    m_allocator->free(m_state, sizeof(AsyncWriterState));
+}
+
+Writer AsyncFdWriter::writer() {
+    Writer writer{};
+    writer.write_callback = write_callback;
+    writer.ctx = this;
+    return writer;
+}
+
+int AsyncFdWriter::write_callback(void* ctx, uint8_t* data, size_t size) {
+    AsyncFdWriter* self = (AsyncFdWriter*)ctx;
+    AsyncWriterState* state = self->m_state;
+    if (state == nullptr || state->stop.load(std::memory_order_relaxed)) {
+        return EBADF;
+    }
+    if (state->backpressure == AsyncBackpressure::Fail) {
+        // a write is either copied whole or dropped whole, the io thread can only free more space meanwhile
+        uint64_t head = state->head.load(std::memory_order_relaxed);
+        uint64_t used = head - state->tail.load(std::memory_order_acquire);
+        size_t space = 0;
+        if (used < state->buffer_count) {
+            space = state->buffer_size - state->buffers[head % state->buffer_count].size;
+            space += (state->buffer_count - used - 1) * state->buffer_size;
+        }
+        if (size > space && state->error.load(std::memory_order_relaxed) == 0) {
+            state->full.fetch_add(1, std::memory_order_relaxed);
+            state->dropped_bytes.fetch_add(size, std::memory_order_relaxed);
+            return EAGAIN;
+        }
+    }
+    while (size > 0) {
+        int error = state->error.load(std::memory_order_relaxed);
+        if (error != 0) {
+            return error;
+        }
+        uint64_t head = state->head.load(std::memory_order_relaxed);
+        if (head - state->tail.load(std::memory_order_acquire) >= state->buffer_count) {
+            // every buffer is waiting for the io thread
+            state->full.fetch_add(1, std::memory_order_relaxed);
+            if (state->backpressure == AsyncBackpressure::Fail) {
+                state->dropped_bytes.fetch_add(size, std::memory_order_relaxed);
+                return EAGAIN;
+            }
+            uint64_t start = now_ns();
+            state->writer_waiting.store(true);
+            if (head - state->tail.load() >= state->buffer_count) {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->writer_wake.wait(lock, [&]() {
+                    return head - state->tail.load() < state->buffer_count || state->error.load() != 0;
+                });
+            }
+            state->writer_waiting.store(false);
+            state->blocked_ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+            continue;
+        }
+        AsyncWriterBuffer& buffer = state->buffers[head % state->buffer_count];
+        size_t space = state->buffer_size - buffer.size;
+        if (space == 0) {
+            self->publish();
+            continue;
+        }
+        size_t count = size < space ? size : space;
+        memcpy(buffer.data + buffer.size, data, count);
+        buffer.size += count;
+        data += count;
+        size -= count;
+    }
+    return 0;
+}
+
+int AsyncFdWriter::publish() {
+    AsyncWriterState* state = m_state;
+    uint64_t head = state->head.load(std::memory_order_relaxed);
+    if (head - state->tail.load(std::memory_order_acquire) >= state->buffer_count) {
+        // the buffer at head is still being written, so nothing was written into it
+        return 0;
+    }
+    AsyncWriterBuffer& buffer = state->buffers[head % state->buffer_count];
+    if (buffer.size == 0) {
+        return 0;
+    }
+    buffer.published_ns = now_ns();
+    state->published.fetch_add(1, std::memory_order_relaxed);
+    state->head.store(head + 1);
+    if (state->io_sleeping.load()) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->io_wake.notify_one();
+    }
+    return 0;
+}
+
+int AsyncFdWriter::flush() {
+    if (m_state == nullptr || m_state->stop.load(std::memory_order_relaxed)) {
+        return EBADF;
+    }
+    int error = m_state->error.load(std::memory_order_relaxed);
+    if (error != 0) {
+        return error;
+    }
+    return publish();
+}
+
+int AsyncFdWriter::close() {
+    if (m_state == nullptr) {
+        return EBADF;
+    }
+    if (m_state->thread.joinable()) {
+        publish();
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            m_state->stop.store(true);
+            m_state->io_wake.notify_one();
+        }
+        m_state->thread.join();
+    }
+    return m_state->error.load();
+}
+
+void AsyncFdWriter::run_io() {
+    AsyncWriterState* state = m_state;
+    WriterSegment segments[ASYNC_WRITER_MAX_BATCH];
+    while (true) {
+        uint64_t tail = state->tail.load(std::memory_order_relaxed);
+        uint64_t head = state->head.load(std::memory_order_acquire);
+        if (head == tail) {
+            // everything is published before stop, so an empty ring after stop is the end
+            if (state->stop.load(std::memory_order_acquire) && state->head.load(std::memory_order_acquire) == tail) {
+                return;
+            }
+            state->io_sleeping.store(true);
+            if (state->head.load() == tail) {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->io_wake.wait(lock, [&]() { return state->head.load() != tail || state->stop.load(); });
+            }
+            state->io_sleeping.store(false);
+            continue;
+        }
+
+        size_t count = head - tail < ASYNC_WRITER_MAX_BATCH ? (size_t)(head - tail) : ASYNC_WRITER_MAX_BATCH;
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < count; i++) {
+            AsyncWriterBuffer& buffer = state->buffers[(tail + i) % state->buffer_count];
+            segments[i].data = buffer.data;
+            segments[i].size = buffer.size;
+            bytes += buffer.size;
+        }
+        // after a failure the buffers are dropped so the writing thread never waits forever
+        if (state->error.load(std::memory_order_relaxed) == 0) {
+            int error = state->fd.writev(segments, count);
+            state->syscalls.store(state->fd_writer.syscalls(), std::memory_order_relaxed);
+            if (error != 0) {
+                state->error.store(error);
+            }
+            else {
+                state->bytes.fetch_add(bytes, std::memory_order_relaxed);
+            }
+        }
+        uint64_t now = now_ns();
+        for (size_t i = 0; i < count; i++) {
+            AsyncWriterBuffer& buffer = state->buffers[(tail + i) % state->buffer_count];
+            uint64_t latency = now - buffer.published_ns;
+            uint32_t bucket = latency > 0 ? count_used_bits_uint64(latency) - 1 : 0;
+            if (bucket >= ASYNC_WRITER_HISTOGRAM_BUCKETS) {
+                bucket = ASYNC_WRITER_HISTOGRAM_BUCKETS - 1;
+            }
+            state->latency_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+            buffer.size = 0;
+        }
+        state->tail.store(tail + count);
+        if (state->writer_waiting.load()) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->writer_wake.notify_one();
+        }
+    }
+}
+
+AsyncWriterStats AsyncFdWriter::stats() const {
+    AsyncWriterStats stats = {};
+    if (m_state == nullptr) {
+        return stats;
+    }
+    stats.buffers = m_state->published.load(std::memory_order_relaxed);
+    stats.bytes = m_state->bytes.load(std::memory_order_relaxed);
+    stats.syscalls = m_state->syscalls.load(std::memory_order_relaxed);
+    stats.full = m_state->full.load(std::memory_order_relaxed);
+    stats.blocked_ns = m_state->blocked_ns.load(std::memory_order_relaxed);
+    stats.dropped_bytes = m_state->dropped_bytes.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < ASYNC_WRITER_HISTOGRAM_BUCKETS; i++) {
+        stats.latency_histogram[i] = m_state->latency_histogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+#endif
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "packet_master.h"
+
+// Writers and readers on top of the operating system, they are optional and the core doesn't use them.
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__unix__)
+#define PACKET_MASTER_POSIX_IO
+#endif
+
+#ifdef PACKET_MASTER_POSIX_IO
+
+// The amount a MappedFileWriter grows the file by at once
+#ifndef MAPPED_FILE_DEFAULT_CHUNK_SIZE
+#define MAPPED_FILE_DEFAULT_CHUNK_SIZE ((size_t)64 << 20)
+#endif
+
+// Writes to a file descriptor, e.g. a file, a pipe or a socket.
+// The segments of Writer::writev are written with a single writev call, so a packet assembled from
+// a header, a payload of serialize_bytes and a trailer is usually a single syscall with FlushPolicy::Finalize.
+// Partial writes and interrupted calls are retried, a failed write returns the errno.
+// The file descriptor is not closed by the writer.
+class FdWriter {
+    public:
+        FdWriter(int fd);
+
+        // A writer which writes to this FdWriter, the FdWriter has to outlive it
+        Writer writer();
+
+        inline int fd() const { return m_fd; }
+        // the write and writev calls made so far
+        inline size_t syscalls() const { return m_syscalls; }
+    private:
+        static int write_callback(void* ctx, uint8_t* data, size_t size);
+        static int writev_callback(void* ctx, const WriterSegment* segments, size_t count);
+
+        int m_fd;
+        size_t m_syscalls;
+};
+
+// Writes into a file through a shared memory mapping, so writing is a copy into the page cache without a syscall.
+// The file grows chunk_size bytes at a time with ftruncate and the mapping with mremap (munmap and mmap without it),
+// close truncates it to the bytes that were written. Meant for long recordings, e.g. hours of packets.
+// Running out of disk space while writing into the mapping is a SIGBUS, like any shared file mapping.
+class MappedFileWriter {
+    public:
+        // Creates the file or truncates it when it exists, is_open() is false on failure and error() is the errno
+        MappedFileWriter(const char* path, size_t chunk_size = MAPPED_FILE_DEFAULT_CHUNK_SIZE);
+        // closes the file
+        ~MappedFileWriter();
+        MappedFileWriter(const MappedFileWriter&) = delete;
+
+        // A writer which writes to the end of the file, the MappedFileWriter has to outlive it.
+        // When the mapping can't be replaced after munmap every later write fails with error(), close still keeps the written bytes
+        Writer writer();
+
+        // Unmaps the file and truncates it to the written bytes, returns 0 or the errno of the first failure
+        int close();
+
+        inline bool is_open() const { return m_fd >= 0; }
+        inline int error() const { return m_error; }
+        // the bytes written so far
+        inline size_t size() const { return m_size; }
+        // the size of the file and the mapping
+        inline size_t capacity() const { return m_capacity; }
+    private:
+        static int write_callback(void* ctx, uint8_t* data, size_t size);
+        // grows the file and the mapping to at least the given capacity, returns 0 or the errno
+        int grow(size_t capacity);
+
+        int m_fd;
+        int m_error;
+        uint8_t* m_data;
+        size_t m_size;
+        size_t m_capacity;
+        size_t m_chunk_size;
+};
+
+// Reads a whole file through a read only memory mapping.
+// The reader returns pointers straight into the mapping, nothing is copied.
+// data() and size() can be passed to the Deserializer memory constructor as well.
+class MappedFileReader {
+    public:
+        // Maps the whole file, is_open() is false on failure and error() is the errno
+        MappedFileReader(const char* path);
+        ~MappedFileReader();
+        MappedFileReader(const MappedFileReader&) = delete;
+
+        // A reader which reads from the current offset, the MappedFileReader has to outlive it and
+        // the pointers it returns are valid as long as the MappedFileReader is
+        Reader reader();
+
+        // an empty file is open without any data
+        inline bool is_open() const { return m_error == 0; }
+        inline int error() const { return m_error; }
+        inline const uint8_t* data() const { return m_data; }
+        inline size_t size() const { return m_size; }
+        // the bytes read by the reader so far
+        inline size_t offset() const { return m_offset; }
+        // moves the reader, the offset is clamped to the size
+        void seek(size_t offset);
+    private:
+        static uint8_t* read_callback(void* ctx, size_t size);
+
+        int m_error;
+        uint8_t* m_data;
+        size_t m_size;
+        size_t m_offset;
+};
+
+// The default buffers of an AsyncFdWriter and their size
+#ifndef ASYNC_WRITER_DEFAULT_BUFFER_COUNT
+#define ASYNC_WRITER_DEFAULT_BUFFER_COUNT 16
+#endif
+#ifndef ASYNC_WRITER_DEFAULT_BUFFER_SIZE
+#define ASYNC_WRITER_DEFAULT_BUFFER_SIZE ((size_t)64 << 10)
+#endif
+// bucket i of the latency histogram counts latencies from 2^i up to 2^(i+1) nanoseconds, the last one everything above
+#define ASYNC_WRITER_HISTOGRAM_BUCKETS 40
+
+// What an AsyncFdWriter does when every buffer is waiting to be written
+enum class AsyncBackpressure {
+    // the writing thread waits for the io thread to write a buffer
+    Block = 0,
+    // a write which doesn't fit in the free space of the buffers fails with EAGAIN, none of its bytes are written
+    Fail
+};
+
+// Counters of an AsyncFdWriter
+struct AsyncWriterStats {
+    // buffers handed to the io thread
+    uint64_t buffers;
+    // bytes the io thread wrote to the file descriptor
+    uint64_t bytes;
+    // write and writev calls of the io thread
+    uint64_t syscalls;
+    // times a write found every buffer waiting to be written
+    uint64_t full;
+    // the time the writing thread waited for a buffer with AsyncBackpressure::Block
+    uint64_t blocked_ns;
+    // bytes dropped with AsyncBackpressure::Fail
+    uint64_t dropped_bytes;
+    // the time from handing a buffer to the io thread until it was written
+    uint64_t latency_histogram[ASYNC_WRITER_HISTOGRAM_BUCKETS];
+};
+
+// Internal
+struct AsyncWriterState;
+
+// Writes to a file descriptor on a thread of its own, so a slow file or pipe doesn't stall the thread which serializes.
+// The writer copies the bytes into a ring of reusable buffers, a full buffer (or flush) hands it to the io thread,
+// which writes every buffer that is ready with a single writev. The ring is a lock free single producer single consumer
+// queue, the writer has to be used by a single thread and the threads only lock to wake each other up when idle.
+class AsyncFdWriter {
+    public:
+        // is_open() is false when the buffers can't be allocated
+        AsyncFdWriter(int fd, Allocator* allocator, size_t buffer_count = ASYNC_WRITER_DEFAULT_BUFFER_COUNT,
+            size_t buffer_size = ASYNC_WRITER_DEFAULT_BUFFER_SIZE, AsyncBackpressure backpressure = AsyncBackpressure::Block);
+        // closes the writer, the file descriptor itself is not closed
+        ~AsyncFdWriter();
+        AsyncFdWriter(const AsyncFdWriter&) = delete;
+
+        // A writer which writes to this AsyncFdWriter, the AsyncFdWriter has to outlive it.
+        // A failure of the io thread is returned by the next write as its errno.
+        Writer writer();
+
+        // Hands the bytes written so far to the io thread, e.g. after every packet or tick. Returns 0 or an errno.
+        int flush();
+        // Flushes, waits until everything was written and stops the io thread. Returns 0 or the errno of the first failure.
+        int close();
+
+        inline bool is_open() const { return m_state != nullptr; }
+        // A copy of the counters, it can be called from any thread. The counters of the other thread may be behind until close
+        AsyncWriterStats stats() const;
+    private:
+        static int write_callback(void* ctx, uint8_t* data, size_t size);
+        // hands the current buffer to the io thread, the write waits for the next one to be free
+        int publish();
+        void run_io();
+
+        Allocator* m_allocator;
+        AsyncWriterState* m_state;
+};
+
+#endif
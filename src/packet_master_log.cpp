@@ -0,0 +1,351 @@
+#include "packet_master_log.h"
+
+#define LOG_HEADER_SIZE 5
+#define LOG_TRAILER_SIZE 24
+// a uint32 and a uint64 with the default options and their headers
+#define LOG_FRAME_HEADER_MAX_SIZE 16
+
+static const uint8_t log_magic[4] = { 'P', 'M', 'L', 'G' };
+static const uint8_t index_magic[4] = { 'P', 'M', 'I', 'X' };
+
+static void store_uint_le(uint8_t* bytes, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static uint64_t load_uint_le(const uint8_t* bytes, size_t size) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= (uint64_t)bytes[i] << (i * 8);
+    }
+    return value;
+}
+
+LogWriter::LogWriter(Writer* writer, Allocator* allocator, uint32_t index_interval)
+    : m_writer(writer), m_allocator(allocator), m_index(allocator), m_index_interval(index_interval > 0 ? index_interval : 1),
+    m_offset(0), m_packet_count(0), m_last_timestamp(0), m_finished(false) {}
+
+Result LogWriter::write(const uint8_t* data, size_t size) {
+    int write_result = m_writer->write((uint8_t*)data, size);
+    if (write_result != 0) {
+        Result result{};
+        result.status = ResultStatus::WriteFailed;
+        result.error_info.write_error = write_result;
+        return result;
+    }
+    m_offset += size;
+    return Result(ResultStatus::Success);
+}
+
+Result LogWriter::write_header() {
+    uint8_t header[LOG_HEADER_SIZE];
+    memcpy(header, log_magic, sizeof(log_magic));
+    header[4] = PACKET_MASTER_LOG_VERSION;
+    return write(header, sizeof(header));
+}
+
+// forwards the bytes of the index to the writer of the log and counts them
+int LogWriter::write_index(void* ctx, uint8_t* data, size_t size) {
+    LogWriter* self = (LogWriter*)ctx;
+    Result result = self->write(data, size);
+    return result.status == ResultStatus::Success ? 0 : result.error_info.write_error;
+}
+
+Result LogWriter::write_packet(const uint8_t* data, size_t size, uint64_t timestamp) {
+    if (m_finished || size > UINT32_MAX || timestamp < m_last_timestamp) {
+        return Result(ResultStatus::InvalidArgument);
+    }
+    if (m_offset == 0) {
+        Result result = write_header();
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+    }
+    if (m_packet_count % m_index_interval == 0) {
+        LogIndexEntry entry{};
+        entry.offset = m_offset;
+        entry.timestamp = timestamp;
+        if (m_index.push(entry) == nullptr) {
+            return Result(ResultStatus::MemoryAllocationFailed);
+        }
+    }
+
+    uint8_t frame_header[LOG_FRAME_HEADER_MAX_SIZE];
+    Serializer serializer(frame_header, sizeof(frame_header));
+    serializer.serialize_uint32((uint32_t)size, uint32_default_options());
+    serializer.serialize_uint64(timestamp - m_last_timestamp, uint64_default_options());
+    serializer.finalize();
+
+    // the frame header and the payload are written with a single call when the writer supports it
+    WriterSegment segments[2] = { { frame_header, serializer.size() }, { data, size } };
+    int write_result = m_writer->writev(segments, size > 0 ? 2 : 1);
+    if (write_result != 0) {
+        Result result{};
+        result.status = ResultStatus::WriteFailed;
+        result.error_info.write_error = write_result;
+        return result;
+    }
+    m_offset += serializer.size() + size;
+    m_last_timestamp = timestamp;
+    m_packet_count++;
+    return Result(ResultStatus::Success);
+}
+
+Result LogWriter::finish() {
+    if (m_finished) {
+        return Result(ResultStatus::InvalidArgument);
+    }
+    m_finished = true;
+    if (m_offset == 0) {
+        Result result = write_header();
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+    }
+
+    uint64_t index_offset = m_offset;
+    Writer index_writer{};
+    index_writer.write_callback = write_index;
+    index_writer.ctx = this;
+    Serializer serializer(&index_writer, m_allocator);
+    serializer.set_flush_policy(FlushPolicy::Threshold, 4096);
+    LogIndexEntry previous{};
+    for (size_t i = 0; i < m_index.length(); i++) {
+        Result result = serializer.serialize_uint64(m_index[i].offset - previous.offset, uint64_default_options());
+        if (result.status == ResultStatus::Success) {
+            result = serializer.serialize_uint64(m_index[i].timestamp - previous.timestamp, uint64_default_options());
+        }
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+        previous = m_index[i];
+    }
+    Result result = serializer.finalize();
+    if (result.status != ResultStatus::Success) {
+        return result;
+    }
+
+    uint8_t trailer[LOG_TRAILER_SIZE];
+    store_uint_le(trailer, index_offset, 8);
+    store_uint_le(trailer + 8, m_packet_count, 8);
+    store_uint_le(trailer + 16, m_index_interval, 4);
+    memcpy(trailer + 20, index_magic, sizeof(index_magic));
+    return write(trailer, sizeof(trailer));
+}
+
+LogReader::LogReader(const uint8_t* data, size_t size, Allocator* allocator)
+    : m_data(data), m_size(size), m_index(allocator), m_index_interval(PACKET_MASTER_LOG_DEFAULT_INDEX_INTERVAL), m_packet_count(0),
+    m_frames_end(0), m_recovered(false), m_cursor() {}
+
+Result LogReader::open() {
+    if (m_size < LOG_HEADER_SIZE || memcmp(m_data, log_magic, sizeof(log_magic)) != 0 || m_data[4] != PACKET_MASTER_LOG_VERSION) {
+        return Result(ResultStatus::InvalidFormat);
+    }
+    m_index.clear();
+    m_recovered = false;
+    m_cursor.offset = LOG_HEADER_SIZE;
+    m_cursor.packet = 0;
+    m_cursor.timestamp = 0;
+
+    if (m_size >= LOG_HEADER_SIZE + LOG_TRAILER_SIZE && memcmp(m_data + m_size - sizeof(index_magic), index_magic, sizeof(index_magic)) == 0) {
+        const uint8_t* trailer = m_data + m_size - LOG_TRAILER_SIZE;
+        uint64_t index_offset = load_uint_le(trailer, 8);
+        uint64_t packet_count = load_uint_le(trailer + 8, 8);
+        uint32_t index_interval = (uint32_t)load_uint_le(trailer + 16, 4);
+        uint64_t index_end = m_size - LOG_TRAILER_SIZE;
+        if (index_offset >= LOG_HEADER_SIZE && index_offset <= index_end && index_interval > 0) {
+            m_index_interval = index_interval;
+            m_packet_count = packet_count;
+            m_frames_end = index_offset;
+            if (read_index(index_offset, index_end).status == ResultStatus::Success) {
+                return Result(ResultStatus::Success);
+            }
+        }
+    }
+    // the payload of a truncated log may end with the magic by chance, so an invalid trailer is not an error either
+    return rebuild_index();
+}
+
+Result LogReader::read_index(uint64_t index_offset, uint64_t index_end) {
+    uint64_t entry_count = (m_packet_count + m_index_interval - 1) / m_index_interval;
+    Deserializer deserializer(m_data + index_offset, (size_t)(index_end - index_offset));
+    LogIndexEntry entry{};
+    for (uint64_t i = 0; i < entry_count; i++) {
+        uint64_t offset_delta;
+        uint64_t timestamp_delta;
+        Result result = deserializer.deserialize_uint64(uint64_default_options(), &offset_delta);
+        if (result.status == ResultStatus::Success) {
+            result = deserializer.deserialize_uint64(uint64_default_options(), &timestamp_delta);
+        }
+        if (result.status != ResultStatus::Success) {
+            return Result(ResultStatus::InvalidFormat);
+        }
+        entry.offset += offset_delta;
+        entry.timestamp += timestamp_delta;
+        if (entry.offset < LOG_HEADER_SIZE || entry.offset >= m_frames_end) {
+            return Result(ResultStatus::InvalidFormat);
+        }
+        if (m_index.push(entry) == nullptr) {
+            return Result(ResultStatus::MemoryAllocationFailed);
+        }
+    }
+    return Result(ResultStatus::Success);
+}
+
+Result LogReader::rebuild_index() {
+    m_index.clear();
+    m_index_interval = PACKET_MASTER_LOG_DEFAULT_INDEX_INTERVAL;
+    m_packet_count = 0;
+    m_frames_end = m_size;
+    m_recovered = true;
+    uint64_t offset = LOG_HEADER_SIZE;
+    uint64_t timestamp = 0;
+    while (offset < m_size) {
+        uint64_t payload_offset;
+        uint32_t size;
+        uint64_t timestamp_delta;
+        // the frames end at the first frame which is not complete
+        if (read_frame_header(offset, &payload_offset, &size, &timestamp_delta).status != ResultStatus::Success) {
+            break;
+        }
+        timestamp += timestamp_delta;
+        if (m_packet_count % m_index_interval == 0) {
+            LogIndexEntry entry{};
+            entry.offset = offset;
+            entry.timestamp = timestamp;
+            if (m_index.push(entry) == nullptr) {
+                return Result(ResultStatus::MemoryAllocationFailed);
+            }
+        }
+        offset = payload_offset + size;
+        m_packet_count++;
+    }
+    m_frames_end = offset;
+    return Result(ResultStatus::Success);
+}
+
+Result LogReader::read_frame_header(uint64_t offset, uint64_t* payload_offset, uint32_t* size, uint64_t* timestamp_delta) const {
+    if (offset >= m_frames_end) {
+        return Result(ResultStatus::EndOfInput);
+    }
+    size_t available = (size_t)(m_frames_end - offset);
+    Deserializer deserializer(m_data + offset, available < LOG_FRAME_HEADER_MAX_SIZE ? available : LOG_FRAME_HEADER_MAX_SIZE);
+    Result result = deserializer.deserialize_uint32(uint32_default_options(), size);
+    if (result.status == ResultStatus::Success) {
+        result = deserializer.deserialize_uint64(uint64_default_options(), timestamp_delta);
+    }
+    if (result.status != ResultStatus::Success || *size > available - deserializer.offset()) {
+        return Result(ResultStatus::InvalidFormat);
+    }
+    *payload_offset = offset + deserializer.offset();
+    return Result(ResultStatus::Success);
+}
+
+Result LogReader::next(LogPacket* packet) {
+    return next(&m_cursor, packet);
+}
+
+Result LogReader::next(LogCursor* cursor, LogPacket* packet) const {
+    if (cursor->packet >= m_packet_count) {
+        return Result(ResultStatus::EndOfInput);
+    }
+    uint64_t payload_offset;
+    uint32_t size;
+    uint64_t timestamp_delta;
+    Result result = read_frame_header(cursor->offset, &payload_offset, &size, &timestamp_delta);
+    if (result.status != ResultStatus::Success) {
+        return result;
+    }
+    cursor->timestamp += timestamp_delta;
+    packet->data = m_data + payload_offset;
+    packet->size = size;
+    packet->timestamp = cursor->timestamp;
+    packet->number = cursor->packet;
+    cursor->offset = payload_offset + size;
+    cursor->packet++;
+    return Result(ResultStatus::Success);
+}
+
+Result LogReader::skip_frame() {
+    uint64_t payload_offset;
+    uint32_t size;
+    uint64_t timestamp_delta;
+    Result result = read_frame_header(m_cursor.offset, &payload_offset, &size, &timestamp_delta);
+    if (result.status != ResultStatus::Success) {
+        return result;
+    }
+    m_cursor.timestamp += timestamp_delta;
+    m_cursor.offset = payload_offset + size;
+    m_cursor.packet++;
+    return Result(ResultStatus::Success);
+}
+
+Result LogReader::cursor_at_entry(size_t entry, LogCursor* cursor) const {
+    if (entry >= m_index.length()) {
+        return Result(ResultStatus::InvalidArgument);
+    }
+    const LogIndexEntry& index_entry = m_index.ptr()[entry];
+    uint64_t payload_offset;
+    uint32_t size;
+    uint64_t timestamp_delta;
+    // the entry has the timestamp of its packet, the cursor keeps the one before it
+    Result result = read_frame_header(index_entry.offset, &payload_offset, &size, &timestamp_delta);
+    if (result.status != ResultStatus::Success) {
+        return result;
+    }
+    cursor->offset = index_entry.offset;
+    cursor->packet = (uint64_t)entry * m_index_interval;
+    cursor->timestamp = index_entry.timestamp - timestamp_delta;
+    return Result(ResultStatus::Success);
+}
+
+Result LogReader::seek_packet(uint64_t number) {
+    if (number >= m_packet_count) {
+        return Result(ResultStatus::InvalidArgument);
+    }
+    Result result = cursor_at_entry((size_t)(number / m_index_interval), &m_cursor);
+    while (result.status == ResultStatus::Success && m_cursor.packet < number) {
+        result = skip_frame();
+    }
+    return result;
+}
+
+Result LogReader::seek_timestamp(uint64_t timestamp) {
+    if (m_index.length() == 0) {
+        return Result(ResultStatus::EndOfInput);
+    }
+    // the last entry with a lower timestamp, the packet is after it and before the next entry
+    size_t low = 0;
+    size_t high = m_index.length();
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (m_index[middle].timestamp < timestamp) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    Result result = cursor_at_entry(low, &m_cursor);
+    if (result.status != ResultStatus::Success) {
+        return result;
+    }
+    // reading the headers until the packet, the reader stays before it
+    while (m_cursor.packet < m_packet_count) {
+        uint64_t payload_offset;
+        uint32_t size;
+        uint64_t timestamp_delta;
+        result = read_frame_header(m_cursor.offset, &payload_offset, &size, &timestamp_delta);
+        if (result.status != ResultStatus::Success) {
+            return result;
+        }
+        if (m_cursor.timestamp + timestamp_delta >= timestamp) {
+            return Result(ResultStatus::Success);
+        }
+        m_cursor.timestamp += timestamp_delta;
+        m_cursor.offset = payload_offset + size;
+        m_cursor.packet++;
+    }
+    return Result(ResultStatus::EndOfInput);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "packet_master.h"
+
+// A container for a stream of packets, e.g. a recording of hours of traffic.
+// Every packet is a frame with its size and timestamp in front of it, and a sparse index of every
+// index_interval-th frame is written at the end. A reader jumps to a packet or a timestamp with a binary search
+// over the index and then reads at most index_interval frame headers, the payloads before it are never decoded.
+//
+// header   "PMLG" and the version (1 byte)
+// frame    the payload size (uint32) and the timestamp delta from the previous frame (uint64), serialized with the
+//          default options and finalized, then the payload itself
+// index    the offset and the timestamp of every index_interval-th frame, as deltas from the previous entry (uint64)
+// trailer  the index offset and the packet count (8 bytes each), the index interval (4 bytes), little endian, then "PMIX"
+//
+// A log without a trailer (e.g. the writer crashed) can still be read, the index is rebuilt from the frame headers
+// and a truncated last frame is ignored.
+
+#define PACKET_MASTER_LOG_VERSION 1
+#define PACKET_MASTER_LOG_DEFAULT_INDEX_INTERVAL 256
+
+// Internal
+struct LogIndexEntry {
+    uint64_t offset;
+    uint64_t timestamp;
+};
+
+// A packet in a log, the data points into the memory of the log
+struct LogPacket {
+    const uint8_t* data;
+    size_t size;
+    uint64_t timestamp;
+    // the number of the packet in the log, starting at 0
+    uint64_t number;
+};
+
+// A position in a log, the offset and the number of the next packet and the timestamp of the one before it.
+// Every cursor reads on its own, so a log can be read from several threads with a cursor for each.
+struct LogCursor {
+    uint64_t offset;
+    uint64_t packet;
+    uint64_t timestamp;
+};
+
+class LogWriter {
+    public:
+        // The log is written in order to the writer, a writev_callback writes every frame with a single call
+        LogWriter(Writer* writer, Allocator* allocator, uint32_t index_interval = PACKET_MASTER_LOG_DEFAULT_INDEX_INTERVAL);
+        LogWriter(const LogWriter&) = delete;
+
+        // Writes a packet, usually the output of a serializer. The timestamp is in any unit, e.g. microseconds,
+        // and can't be lower than the timestamp of the previous packet (ResultStatus::InvalidArgument).
+        Result write_packet(const uint8_t* data, size_t size, uint64_t timestamp);
+        // Writes the index and the trailer, nothing can be written after it
+        Result finish();
+
+        inline uint64_t packet_count() const { return m_packet_count; }
+        // the bytes written so far
+        inline uint64_t size() const { return m_offset; }
+    private:
+        Result write(const uint8_t* data, size_t size);
+        Result write_header();
+        static int write_index(void* ctx, uint8_t* data, size_t size);
+
+        Writer* m_writer;
+        Allocator* m_allocator;
+        Vector<LogIndexEntry> m_index;
+        uint32_t m_index_interval;
+        uint64_t m_offset;
+        uint64_t m_packet_count;
+        uint64_t m_last_timestamp;
+        bool m_finished;
+};
+
+class LogReader {
+    public:
+        // Reads a log from memory, e.g. MappedFileReader::data(), the memory has to outlive the reader
+        // and the packets it returns point into it
+        LogReader(const uint8_t* data, size_t size, Allocator* allocator);
+        LogReader(const LogReader&) = delete;
+
+        // Reads the header and the index, or rebuilds the index when the log has no trailer
+        // fails with ResultStatus::InvalidFormat when the memory is not a log
+        Result open();
+
+        // Reads the next packet, fails with ResultStatus::EndOfInput after the last one
+        Result next(LogPacket* packet);
+        // The next packet is the given one, fails with ResultStatus::InvalidArgument when there is no such packet
+        Result seek_packet(uint64_t number);
+        // The next packet is the first one with a timestamp at least the given one,
+        // fails with ResultStatus::EndOfInput when there is none
+        Result seek_timestamp(uint64_t timestamp);
+
+        // The index splits the log into ranges of index_interval packets, starting at the packet of every entry
+        inline size_t index_entry_count() const { return m_index.length(); }
+        inline uint32_t index_interval() const { return m_index_interval; }
+        // A cursor at the first packet of an index entry
+        Result cursor_at_entry(size_t entry, LogCursor* cursor) const;
+        // Reads the packet at the cursor and moves it to the next one, the reader itself doesn't move
+        Result next(LogCursor* cursor, LogPacket* packet) const;
+
+        inline uint64_t packet_count() const { return m_packet_count; }
+        // true when the log had no trailer and the index was rebuilt by open
+        inline bool recovered() const { return m_recovered; }
+    private:
+        // reads the header of the frame at the offset, the payload starts at payload_offset
+        Result read_frame_header(uint64_t offset, uint64_t* payload_offset, uint32_t* size, uint64_t* timestamp_delta) const;
+        // skips the next frame without looking at its payload
+        Result skip_frame();
+        Result read_index(uint64_t index_offset, uint64_t index_end);
+        Result rebuild_index();
+
+        const uint8_t* m_data;
+        size_t m_size;
+        Vector<LogIndexEntry> m_index;
+        uint32_t m_index_interval;
+        uint64_t m_packet_count;
+        // the end of the last frame
+        uint64_t m_frames_end;
+        bool m_recovered;
+        LogCursor m_cursor;
+};
@@ -0,0 +1,339 @@
+#include "packet_master_parallel.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+// The packets a thread of a BatchEncoder takes from its own range at once
+#define BATCH_CHUNK_SIZE 8
+
+struct PoolWorker {
+    // the jobs left for this thread, other threads steal from the end
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+    size_t steals = 0;
+    std::thread thread;
+};
+
+struct PoolState {
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    bool stop = false;
+    // the threads still running the tasks of the run, without the calling thread
+    size_t running = 0;
+    size_t chunk_size = 1;
+    PoolTask task = nullptr;
+    void* ctx = nullptr;
+};
+
+static size_t thread_count_or_cores(size_t threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return threads > 0 ? threads : 1;
+}
+
+WorkStealingPool::WorkStealingPool(Allocator* allocator, size_t threads)
+    : m_allocator(allocator), m_thread_count(thread_count_or_cores(threads)), m_workers(nullptr), m_state(nullptr) {
+    void* state = allocator->alloc(sizeof(PoolState));
+    m_workers = (PoolWorker*)allocator->alloc(sizeof(PoolWorker) * m_thread_count);
+    if (state == nullptr || m_workers == nullptr) {
+        // run fails without any threads
+        if (state != nullptr) {
+            allocator->free(state, sizeof(PoolState));
+        }
+        if (m_workers != nullptr) {
+            allocator->free(m_workers, sizeof(PoolWorker) * m_thread_count);
+            m_workers = nullptr;
+        }
+        m_thread_count = 0;
+        return;
+    }
+    m_state = new (state) PoolState();
+    for (size_t i = 0; i < m_thread_count; i++) {
+        new (&m_workers[i]) PoolWorker();
+    }
+    // the calling thread is the first worker
+    for (size_t i = 1; i < m_thread_count; i++) {
+        m_workers[i].thread = std::thread(&WorkStealingPool::run_worker, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    if (m_state == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->stop = true;
+    }
+    m_state->start.notify_all();
+    for (size_t i = 0; i < m_thread_count; i++) {
+        if (m_workers[i].thread.joinable()) {
+            m_workers[i].thread.join();
+        }
+        m_workers[i].~PoolWorker();
+    }
+    m_allocator->free(m_workers, sizeof(PoolWorker) * m_thread_count);
+    m_state->~PoolState();
+    m_allocator->free(m_state, sizeof(PoolState));
+}
+
+Result WorkStealingPool::run(size_t count, size_t chunk_size, PoolTask task, void* ctx) {
+    if (m_state == nullptr) {
+        return Result(ResultStatus::MemoryAllocationFailed);
+    }
+    if (count == 0) {
+        return Result(ResultStatus::Success);
+    }
+    for (size_t i = 0; i < m_thread_count; i++) {
+        PoolWorker& worker = m_workers[i];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.begin = count * i / m_thread_count;
+        worker.end = count * (i + 1) / m_thread_count;
+        worker.steals = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->task = task;
+        m_state->ctx = ctx;
+        m_state->chunk_size = chunk_size > 0 ? chunk_size : 1;
+        m_state->running = m_thread_count - 1;
+        m_state->generation++;
+    }
+    m_state->start.notify_all();
+    run_tasks(0);
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    m_state->done.wait(lock, [this]() { return m_state->running == 0; });
+    return Result(ResultStatus::Success);
+}
+
+size_t WorkStealingPool::steals() const {
+    size_t steals = 0;
+    for (size_t i = 0; i < m_thread_count; i++) {
+        steals += m_workers[i].steals;
+    }
+    return steals;
+}
+
+void WorkStealingPool::run_worker(size_t worker) {
+    uint64_t generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_state->mutex);
+            m_state->start.wait(lock, [&]() { return m_state->stop || m_state->generation != generation; });
+            if (m_state->stop) {
+                return;
+            }
+            generation = m_state->generation;
+        }
+        run_tasks(worker);
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            m_state->running--;
+            if (m_state->running == 0) {
+                m_state->done.notify_one();
+            }
+        }
+    }
+}
+
+void WorkStealingPool::run_tasks(size_t worker) {
+    size_t begin;
+    size_t end;
+    while (take_jobs(worker, &begin, &end)) {
+        m_state->task(worker, begin, end, m_state->ctx);
+    }
+}
+
+bool WorkStealingPool::take_jobs(size_t worker, size_t* begin, size_t* end) {
+    PoolWorker& self = m_workers[worker];
+    size_t chunk_size = m_state->chunk_size;
+    {
+        std::lock_guard<std::mutex> lock(self.mutex);
+        if (self.begin < self.end) {
+            *begin = self.begin;
+            *end = self.end - self.begin > chunk_size ? self.begin + chunk_size : self.end;
+            self.begin = *end;
+            return true;
+        }
+    }
+    // stealing half of the jobs another thread has left, from the end of its range
+    for (size_t i = 1; i < m_thread_count; i++) {
+        PoolWorker& victim = m_workers[(worker + i) % m_thread_count];
+        size_t stolen_begin;
+        size_t stolen_end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            size_t remaining = victim.end - victim.begin;
+            if (remaining == 0) {
+                continue;
+            }
+            stolen_end = victim.end;
+            stolen_begin = victim.end - (remaining + 1) / 2;
+            victim.end = stolen_begin;
+        }
+        std::lock_guard<std::mutex> lock(self.mutex);
+        self.steals++;
+        *begin = stolen_begin;
+        *end = stolen_end - stolen_begin > chunk_size ? stolen_begin + chunk_size : stolen_end;
+        // the rest can be stolen from this thread again
+        self.begin = *end;
+        self.end = stolen_end;
+        return true;
+    }
+    return false;
+}
+
+static int write_output(void* ctx, uint8_t* data, size_t size) {
+    return ((Vector<uint8_t>*)ctx)->push_many(data, size) == nullptr ? 1 : 0;
+}
+
+struct BatchWorker {
+    BatchWorker(size_t arena_size)
+        : arena(arena_size, true), output((uint8_t*)arena.alloc(arena.capacity()), arena.capacity()),
+        buffer_arena(arena_size, true), buffer_allocator(buffer_arena.allocator()), writer(), serializer(&writer, &buffer_allocator) {
+        writer.write_callback = write_output;
+        writer.ctx = &output;
+        serializer.set_flush_policy(FlushPolicy::Finalize);
+    }
+
+    // the whole arena is the output of the thread, so packets never move
+    ArenaAllocator arena;
+    Vector<uint8_t> output;
+    // the buffer of the serializer is its only block, so it grows in place without going through the shared allocator.
+    // A packet has to fit in the output as well, the pages it never reaches are not touched.
+    ArenaAllocator buffer_arena;
+    Allocator buffer_allocator;
+    Writer writer;
+    Serializer serializer;
+};
+
+BatchEncoder::BatchEncoder(Allocator* allocator, size_t threads, size_t arena_size)
+    : m_allocator(allocator), m_pool(allocator, threads), m_workers(nullptr), m_worker_count(m_pool.threads()), m_outputs(allocator),
+    m_job(nullptr), m_ctx(nullptr) {
+    if (m_worker_count == 0) {
+        return;
+    }
+    m_workers = (BatchWorker*)allocator->alloc(sizeof(BatchWorker) * m_worker_count);
+    if (m_workers == nullptr) {
+        m_worker_count = 0;
+        return;
+    }
+    for (size_t i = 0; i < m_worker_count; i++) {
+        new (&m_workers[i]) BatchWorker(arena_size);
+    }
+}
+
+BatchEncoder::~BatchEncoder() {
+    for (size_t i = 0; i < m_worker_count; i++) {
+        m_workers[i].~BatchWorker();
+    }
+    if (m_workers != nullptr) {
+        m_allocator->free(m_workers, sizeof(BatchWorker) * m_worker_count);
+    }
+}
+
+Result BatchEncoder::encode(size_t count, BatchJob job, void* ctx) {
+    m_outputs.clear();
+    if (m_workers == nullptr) {
+        return Result(ResultStatus::MemoryAllocationFailed);
+    }
+    if (count == 0) {
+        return Result(ResultStatus::Success);
+    }
+    if (m_outputs.extend(count) == nullptr) {
+        return Result(ResultStatus::MemoryAllocationFailed);
+    }
+    for (size_t i = 0; i < m_worker_count; i++) {
+        m_workers[i].output.clear();
+    }
+    m_job = job;
+    m_ctx = ctx;
+    Result result = m_pool.run(count, BATCH_CHUNK_SIZE, run_jobs, this);
+    if (result.status != ResultStatus::Success) {
+        return result;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (m_outputs[i].result.status != ResultStatus::Success) {
+            return m_outputs[i].result;
+        }
+    }
+    return Result(ResultStatus::Success);
+}
+
+void BatchEncoder::run_jobs(size_t worker, size_t begin, size_t end, void* ctx) {
+    BatchEncoder* self = (BatchEncoder*)ctx;
+    BatchWorker& state = self->m_workers[worker];
+    for (size_t i = begin; i < end; i++) {
+        size_t offset = state.output.length();
+        Result result = self->m_job(&state.serializer, i, self->m_ctx);
+        if (result.status == ResultStatus::Success) {
+            result = state.serializer.finalize();
+        }
+        if (result.status != ResultStatus::Success) {
+            // a failed packet leaves nothing behind
+            state.serializer.reset();
+            if (state.output.length() > offset) {
+                state.output.remove_many(offset, state.output.length() - offset);
+            }
+        }
+        BatchOutput& output = self->m_outputs[i];
+        output.data = state.output.ptr() + offset;
+        output.size = state.output.length() - offset;
+        output.result = result;
+    }
+}
+
+LogDecoder::LogDecoder(Allocator* allocator, size_t threads)
+    : m_pool(allocator, threads), m_results(allocator), m_log(nullptr), m_job(nullptr), m_ctx(nullptr) {}
+
+Result LogDecoder::decode(const LogReader* log, LogDecodeJob job, void* ctx) {
+    size_t range_count = log->index_entry_count();
+    m_results.clear();
+    if (m_results.extend(range_count) == nullptr) {
+        return Result(ResultStatus::MemoryAllocationFailed);
+    }
+    m_log = log;
+    m_job = job;
+    m_ctx = ctx;
+    // a range is already index_interval packets, so a thread takes a single range at once
+    Result result = m_pool.run(range_count, 1, run_ranges, this);
+    if (result.status != ResultStatus::Success) {
+        return result;
+    }
+    // the ranges are in packet order
+    for (size_t i = 0; i < range_count; i++) {
+        if (m_results[i].status != ResultStatus::Success) {
+            return m_results[i];
+        }
+    }
+    return Result(ResultStatus::Success);
+}
+
+void LogDecoder::run_ranges(size_t worker, size_t begin, size_t end, void* ctx) {
+    LogDecoder* self = (LogDecoder*)ctx;
+    for (size_t range = begin; range < end; range++) {
+        LogCursor cursor;
+        Result result = self->m_log->cursor_at_entry(range, &cursor);
+        uint64_t range_end = cursor.packet + self->m_log->index_interval();
+        LogPacket packet{};
+        while (result.status == ResultStatus::Success && cursor.packet < range_end) {
+            result = self->m_log->next(&cursor, &packet);
+            if (result.status == ResultStatus::EndOfInput) {
+                // the last range is shorter
+                result = Result(ResultStatus::Success);
+                break;
+            }
+            if (result.status == ResultStatus::Success) {
+                Deserializer deserializer(packet.data, packet.size);
+                result = self->m_job(&deserializer, packet, worker, self->m_ctx);
+            }
+        }
+        self->m_results[range] = result;
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "packet_master.h"
+#include "packet_master_log.h"
+
+// Encoding and decoding of many independent packets on a pool of threads.
+// The jobs are split between the threads evenly and a thread which runs out of jobs steals half of the jobs
+// another thread has left, so a few expensive packets don't keep the other threads waiting.
+
+// Runs ranges of jobs on one of the threads of a pool, the worker is the index of the thread.
+// task(worker, begin, end, ctx)
+typedef void (*PoolTask)(size_t, size_t, size_t, void*);
+
+// Internal
+struct PoolWorker;
+struct PoolState;
+
+// A pool of threads with work stealing, the thread which calls run is one of them
+class WorkStealingPool {
+    public:
+        // threads is the amount of threads including the calling one, 0 is a thread per core
+        WorkStealingPool(Allocator* allocator, size_t threads = 0);
+        ~WorkStealingPool();
+        WorkStealingPool(const WorkStealingPool&) = delete;
+
+        // Runs the jobs from 0 to count, a thread takes chunk_size jobs of its own at once.
+        // Returns once all of them are done, fails when the pool has no threads because it failed to allocate.
+        Result run(size_t count, size_t chunk_size, PoolTask task, void* ctx);
+
+        // 0 when the pool failed to allocate
+        inline size_t threads() const { return m_thread_count; }
+        // the times a thread took jobs from another thread in the last run
+        size_t steals() const;
+    private:
+        void run_worker(size_t worker);
+        void run_tasks(size_t worker);
+        // takes a range of jobs from the thread itself, or steals it from another thread
+        bool take_jobs(size_t worker, size_t* begin, size_t* end);
+
+        Allocator* m_allocator;
+        size_t m_thread_count;
+        PoolWorker* m_workers;
+        PoolState* m_state;
+};
+
+// The output memory of a thread for a single batch, packets which don't fit fail with ResultStatus::WriteFailed
+#ifndef PACKET_MASTER_BATCH_ARENA_SIZE
+#define PACKET_MASTER_BATCH_ARENA_SIZE ((size_t)16 << 20)
+#endif
+
+// Serializes the packet of a job, it is called on one of the threads of the encoder.
+// The serializer is finalized after it returns. Anything it uses besides the serializer has to be thread safe.
+// job(serializer, index, ctx)
+typedef Result (*BatchJob)(Serializer*, size_t, void*);
+
+// The output of a job, the data stays valid until the next batch
+struct BatchOutput {
+    const uint8_t* data;
+    size_t size;
+    Result result;
+};
+
+// Internal
+struct BatchWorker;
+
+// Encodes a batch of independent packets, e.g. a packet for every client on every tick.
+// Every thread keeps its Serializer between batches and writes the packets into its own arena,
+// the buffer of the serializer grows in an arena of the thread as well, so the threads never share a heap.
+class BatchEncoder {
+    public:
+        // threads is the amount of threads including the calling one, 0 is a thread per core.
+        // The allocator is only used by the calling thread, for the threads and the outputs of a batch.
+        BatchEncoder(Allocator* allocator, size_t threads = 0, size_t arena_size = PACKET_MASTER_BATCH_ARENA_SIZE);
+        ~BatchEncoder();
+        BatchEncoder(const BatchEncoder&) = delete;
+
+        // Runs count jobs, job is called once for every index from 0 to count.
+        // The calling thread runs jobs as well and returns once all of them are done.
+        // Returns the result of the first job that failed (by index) or a failure of the encoder itself.
+        Result encode(size_t count, BatchJob job, void* ctx);
+
+        // The outputs of the last batch in job order
+        inline size_t output_count() const { return m_outputs.length(); }
+        inline const BatchOutput& output(size_t index) { return m_outputs[index]; }
+
+        inline size_t threads() const { return m_pool.threads(); }
+        // the times a thread took jobs from another thread in the last batch
+        inline size_t steals() const { return m_pool.steals(); }
+    private:
+        static void run_jobs(size_t worker, size_t begin, size_t end, void* ctx);
+
+        Allocator* m_allocator;
+        WorkStealingPool m_pool;
+        BatchWorker* m_workers;
+        size_t m_worker_count;
+        Vector<BatchOutput> m_outputs;
+        BatchJob m_job;
+        void* m_ctx;
+};
+
+// Deserializes the packet of a log, it is called on one of the threads of the decoder with a deserializer of the packet.
+// The worker is the index of the thread, for results which are collected per thread.
+// Anything it uses besides the deserializer has to be thread safe, e.g. storing a result by packet.number.
+// job(deserializer, packet, worker, ctx)
+typedef Result (*LogDecodeJob)(Deserializer*, const LogPacket&, size_t, void*);
+
+// Decodes the packets of a log on a pool of threads.
+// The packets are split into the ranges of the index of the log, every range is decoded in order by a single thread
+// from the offset in its index entry, so the frames are never scanned on a single thread first.
+class LogDecoder {
+    public:
+        // threads is the amount of threads including the calling one, 0 is a thread per core
+        LogDecoder(Allocator* allocator, size_t threads = 0);
+        LogDecoder(const LogDecoder&) = delete;
+
+        // Decodes every packet of an opened log, the calling thread decodes as well.
+        // A range stops at its first failure, the failure of the first range that failed is returned.
+        Result decode(const LogReader* log, LogDecodeJob job, void* ctx);
+
+        inline size_t threads() const { return m_pool.threads(); }
+        inline size_t steals() const { return m_pool.steals(); }
+    private:
+        static void run_ranges(size_t worker, size_t begin, size_t end, void* ctx);
+
+        WorkStealingPool m_pool;
+        // the first failure of every range
+        Vector<Result> m_results;
+        const LogReader* m_log;
+        LogDecodeJob m_job;
+        void* m_ctx;
+};
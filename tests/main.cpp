@@ -1,8 +1,20 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <packet_master.h>
+#include <packet_master_fields.h>
+#include <packet_master_coro.h>
+#include <packet_master_io.h>
+#include <packet_master_log.h>
+#include <packet_master_parallel.h>
 #include <string.h>
+#include <new>
+#include <type_traits>
 #include "test/test.h"
+#ifdef PACKET_MASTER_POSIX_IO
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#endif
 
 
 void* my_malloc(size_t size, void* ctx) {
@@ -41,6 +53,17 @@ int write_data(void* data, uint8_t* incoming_data, size_t size) {
     return ((Vector<uint8_t>*)data)->push_many(incoming_data, size) == nullptr ? 1 : 0;
 }
 
+typedef struct {
+    Vector<uint8_t>* buffer;
+    size_t writes;
+} CountingWriter;
+
+int write_data_counting(void* data, uint8_t* incoming_data, size_t size) {
+    CountingWriter* writer = (CountingWriter*)data;
+    writer->writes++;
+    return write_data(writer->buffer, incoming_data, size);
+}
+
 uint8_t* read_data(void* data, size_t data_size) {
     BufferReader* reader = (BufferReader*)data;
     if (data_size > reader->buffer->length() - reader->index) {
@@ -68,6 +91,18 @@ void test_count_bits() {
     ts_expect_int_eq(count_leading_zeros_uint_fallback(0b1110000), 25);
     ts_expect_int_eq(count_leading_zeros_uint_fallback(0b111001100), 23);
     ts_expect_int_eq(count_leading_zeros_uint_fallback(0), 32);
+
+    ts_expect_int_eq(count_leading_zeros_uint64(0b1), 63);
+    ts_expect_int_eq(count_leading_zeros_uint64(0b111001100), 55);
+    ts_expect_int_eq(count_leading_zeros_uint64((uint64_t)1 << 40), 23);
+    ts_expect_int_eq(count_leading_zeros_uint64(UINT64_MAX), 0);
+    ts_expect_int_eq(count_leading_zeros_uint64(0), 64);
+
+    ts_expect_int_eq(count_leading_zeros_uint64_fallback(0b1), 63);
+    ts_expect_int_eq(count_leading_zeros_uint64_fallback(0b111001100), 55);
+    ts_expect_int_eq(count_leading_zeros_uint64_fallback((uint64_t)1 << 40), 23);
+    ts_expect_int_eq(count_leading_zeros_uint64_fallback(UINT64_MAX), 0);
+    ts_expect_int_eq(count_leading_zeros_uint64_fallback(0), 64);
 }
 
 void test_serializer_bool(Serializer* serializer) {
@@ -301,6 +336,1637 @@ void test_deserializer(Deserializer* deserializer) {
     }
 }
 
+// more bytes with free bits than the queue can hold, the oldest ones are closed as padding
+#define FREE_BYTES_TEST_COUNT (PACKET_MASTER_MAX_FREE_BYTES + 6)
+void test_serializer_free_bytes_overflow(Serializer* serializer) {
+    for (uint8_t i = 0; i < FREE_BYTES_TEST_COUNT; i++) {
+        ts_expect_success(serializer->serialize_uint8(i, uint8_max_bits(7)));
+    }
+    for (size_t i = 0; i < FREE_BYTES_TEST_COUNT; i++) {
+        ts_expect_success(serializer->serialize_bool(i % 3 == 0));
+    }
+    ts_expect_success(serializer->finalize());
+}
+void validate_serialized_data_free_bytes_overflow(Vector<uint8_t>& buffer) {
+    // the first 6 bytes are closed, the next bytes hold one bool each and the last 6 bools need a new byte
+    ts_expect_uint8_eq(buffer[0], 0);
+    ts_expect_uint8_eq(buffer[6], 0b10000110);
+    ts_expect_uint8_eq(buffer[7], 0b00000111);
+    ts_expect_uint8_eq(buffer[FREE_BYTES_TEST_COUNT], 0b00100100);
+    ts_expect_size_eq(buffer.length(), FREE_BYTES_TEST_COUNT + 1);
+}
+void test_deserializer_free_bytes_overflow(Deserializer* deserializer) {
+    for (uint8_t i = 0; i < FREE_BYTES_TEST_COUNT; i++) {
+        uint8_t value;
+        ts_expect_success(deserializer->deserialize_uint8(uint8_max_bits(7), &value));
+        ts_expect_uint8_eq(value, i);
+    }
+    for (size_t i = 0; i < FREE_BYTES_TEST_COUNT; i++) {
+        bool value;
+        ts_expect_success(deserializer->deserialize_bool(&value));
+        ts_expect_bool_eq(value, i % 3 == 0);
+    }
+    {
+        uint8_t value;
+        ts_expect_status(deserializer->deserialize_uint8(uint8_default_options(), &value), ResultStatus::ReadFailed);
+    }
+}
+
+// serializes 200 fields and returns the amount of writer calls
+size_t serialize_with_flush_policy(Vector<uint8_t>* buffer, FlushPolicy policy, size_t threshold) {
+    CountingWriter counting{};
+    counting.buffer = buffer;
+    Writer writer{};
+    writer.write_callback = write_data_counting;
+    writer.ctx = &counting;
+    Serializer serializer(&writer, &allocator);
+    serializer.set_flush_policy(policy, threshold);
+    for (uint32_t i = 0; i < 50; i++) {
+        ts_expect_success(serializer.serialize_uint32(i * 1000, uint32_default_options()));
+        ts_expect_success(serializer.serialize_uint8((uint8_t)i, uint8_max_bits(6)));
+        ts_expect_success(serializer.serialize_bool(i % 2 == 0));
+        ts_expect_success(serializer.serialize_uint16((uint16_t)(i * 3), uint16_max_bits(9)));
+    }
+    ts_expect_success(serializer.finalize());
+    return counting.writes;
+}
+
+void test_flush_policy() {
+    Vector<uint8_t> per_value(&allocator);
+    Vector<uint8_t> threshold(&allocator);
+    Vector<uint8_t> on_finalize(&allocator);
+    size_t per_value_writes = serialize_with_flush_policy(&per_value, FlushPolicy::PerValue, 0);
+    size_t threshold_writes = serialize_with_flush_policy(&threshold, FlushPolicy::Threshold, 256);
+    size_t finalize_writes = serialize_with_flush_policy(&on_finalize, FlushPolicy::Finalize, 0);
+    ts_expect(per_value_writes > 20);
+    ts_expect(threshold_writes <= 3);
+    ts_expect_size_eq(finalize_writes, 1);
+
+    ts_assert(per_value.length() == threshold.length());
+    ts_assert(per_value.length() == on_finalize.length());
+    ts_expect(memcmp(per_value.ptr(), threshold.ptr(), per_value.length()) == 0);
+    ts_expect(memcmp(per_value.ptr(), on_finalize.ptr(), per_value.length()) == 0);
+}
+
+void test_fixed_buffer_serializer() {
+    uint8_t data[16] = {};
+    Serializer serializer(data, sizeof(data));
+    test_serializer(&serializer);
+    ts_expect_size_eq(serializer.size(), 16);
+    ts_expect_uint8_eq(data[2], 0b10000011);
+    ts_expect_uint8_eq(data[3], 0b01110110);
+    ts_expect_uint8_eq(data[4], 0b00000101);
+    ts_expect_uint8_eq(data[13], 0b00001111);
+
+    serializer.reset();
+    ts_expect_size_eq(serializer.size(), 0);
+    for (uint8_t i = 0; i < 16; i++) {
+        ts_expect_success(serializer.serialize_uint8(i, uint8_default_options()));
+    }
+    ts_expect_status(serializer.serialize_uint8(16, uint8_default_options()), ResultStatus::BufferFull);
+    ts_expect_status(serializer.serialize_bool(true), ResultStatus::BufferFull);
+    ts_expect_size_eq(serializer.size(), 16);
+}
+
+void test_memory_deserializer() {
+    uint8_t data[16] = {};
+    Serializer serializer(data, sizeof(data));
+    test_serializer(&serializer);
+
+    Deserializer deserializer(data, serializer.size());
+    test_deserializer(&deserializer);
+    ts_expect_size_eq(deserializer.offset(), 16);
+
+    deserializer.reset();
+    test_deserializer(&deserializer);
+}
+
+// the free bits of a value are in its last byte, the deserializer used to queue the first one
+void test_last_byte_free_bits() {
+    // single segments so the values take all their max_bits
+    PreparedUintOptions options16 = prepare_uint_options(UintOptions{ 12, 1 });
+    PreparedUintOptions options32 = prepare_uint_options(UintOptions{ 20, 1 });
+    uint8_t data[8] = {};
+    Serializer serializer(data, sizeof(data));
+    ts_expect_success(serializer.serialize_uint16(0x0ABC, options16));
+    ts_expect_success(serializer.serialize_uint32(0x5DEF0, options32));
+    bool flags[] = { true, false, false, true, false, true, true, false };
+    for (bool flag : flags) {
+        ts_expect_success(serializer.serialize_bool(flag));
+    }
+    ts_expect_success(serializer.finalize());
+    ts_assert(serializer.size() == 5);
+    ts_expect_uint8_eq(data[1], 0b10011010);
+    ts_expect_uint8_eq(data[4], 0b01100101);
+
+    Deserializer deserializer(data, serializer.size());
+    uint16_t value16;
+    ts_expect_success(deserializer.deserialize_uint16(options16, &value16));
+    ts_expect_uint16_eq(value16, 0x0ABC);
+    uint32_t value32;
+    ts_expect_success(deserializer.deserialize_uint32(options32, &value32));
+    ts_expect_uint32_eq(value32, 0x5DEF0);
+    bool same = true;
+    for (bool flag : flags) {
+        bool value = !flag;
+        same = same && deserializer.deserialize_bool(&value).status == ResultStatus::Success && value == flag;
+    }
+    ts_expect(same);
+}
+
+void test_zero_uint8_free_bits() {
+    uint8_t data[4] = {};
+    Serializer serializer(data, sizeof(data));
+    // zero uses the single 7 bit segment so the bool fills its last bit
+    ts_expect_success(serializer.serialize_uint8(0, uint8_max_bits(7)));
+    ts_expect_success(serializer.serialize_bool(true));
+    ts_expect_success(serializer.finalize());
+    ts_expect_size_eq(serializer.size(), 1);
+    ts_expect_uint8_eq(data[0], 0b10000000);
+
+    Deserializer deserializer(data, serializer.size());
+    uint8_t value;
+    ts_expect_success(deserializer.deserialize_uint8(uint8_max_bits(7), &value));
+    ts_expect_uint8_eq(value, 0);
+    bool flag;
+    ts_expect_success(deserializer.deserialize_bool(&flag));
+    ts_expect_bool_eq(flag, true);
+}
+
+// zero takes the first segment like in the wider types. Before it wrote an all-ones header and no free bits while the
+// deserializer kept the free bits of the byte, so the values after it were misread whenever max_bits was below 8
+void test_zero_uint8_segments() {
+    PreparedUintOptions options[] = {
+        uint8_default_options(), uint8_max_bits(3), prepare_uint_options(UintOptions{ 8, 4 }), prepare_uint_options(UintOptions{ 8, 8 })
+    };
+    for (PreparedUintOptions option : options) {
+        uint8_t narrow_data[8] = {};
+        uint8_t wide_data[8] = {};
+        Serializer narrow(narrow_data, sizeof(narrow_data));
+        Serializer wide(wide_data, sizeof(wide_data));
+        for (int i = 0; i < 3; i++) {
+            ts_expect_success(narrow.serialize_uint8(0, option));
+            ts_expect_success(narrow.serialize_bool(true));
+            ts_expect_success(narrow.serialize_int8(0, option));
+            ts_expect_success(wide.serialize_uint32(0, option));
+            ts_expect_success(wide.serialize_bool(true));
+            ts_expect_success(wide.serialize_int32(0, option));
+        }
+        ts_expect_success(narrow.serialize_uint8(5, option));
+        ts_expect_success(wide.serialize_uint32(5, option));
+        ts_expect_success(narrow.finalize());
+        ts_expect_success(wide.finalize());
+        ts_assert(narrow.size() == wide.size());
+        ts_expect(memcmp(narrow_data, wide_data, narrow.size()) == 0);
+
+        Deserializer deserializer(narrow_data, narrow.size());
+        bool same = true;
+        for (int i = 0; i < 3; i++) {
+            uint8_t value = 1;
+            int8_t signed_value = 1;
+            bool flag = false;
+            same = same && deserializer.deserialize_uint8(option, &value).status == ResultStatus::Success && value == 0;
+            same = same && deserializer.deserialize_bool(&flag).status == ResultStatus::Success && flag;
+            same = same && deserializer.deserialize_int8(option, &signed_value).status == ResultStatus::Success && signed_value == 0;
+        }
+        uint8_t last = 0;
+        same = same && deserializer.deserialize_uint8(option, &last).status == ResultStatus::Success && last == 5;
+        ts_expect(same);
+        ts_expect_size_eq(deserializer.offset(), narrow.size());
+    }
+}
+
+#define ARRAY_TEST_COUNT 1000
+
+// serializing as an array must give the same output as one value at a time, including the free bits left for the bools
+void check_uint32_array(PreparedUintOptions options) {
+    uint32_t values[ARRAY_TEST_COUNT];
+    uint32_t mask = options.max_bits >= 32 ? 0xFFFFFFFF : (1u << options.max_bits) - 1;
+    for (uint32_t i = 0; i < ARRAY_TEST_COUNT; i++) {
+        values[i] = ((i * 2654435761u) >> (i % 32)) & mask;
+    }
+    static uint8_t one_by_one_data[ARRAY_TEST_COUNT * 5];
+    static uint8_t array_data[ARRAY_TEST_COUNT * 5];
+    Serializer one_by_one(one_by_one_data, sizeof(one_by_one_data));
+    Serializer array(array_data, sizeof(array_data));
+    for (size_t i = 0; i < ARRAY_TEST_COUNT; i++) {
+        ts_expect_success(one_by_one.serialize_uint32(values[i], options));
+    }
+    ts_expect_success(array.serialize_uint32_array(values, ARRAY_TEST_COUNT, options));
+    for (size_t i = 0; i < 3; i++) {
+        ts_expect_success(one_by_one.serialize_bool(true));
+        ts_expect_success(array.serialize_bool(true));
+    }
+    ts_expect_success(one_by_one.finalize());
+    ts_expect_success(array.finalize());
+    ts_assert(one_by_one.size() == array.size());
+    ts_expect(memcmp(one_by_one_data, array_data, array.size()) == 0);
+
+    uint32_t decoded[ARRAY_TEST_COUNT];
+    Deserializer deserializer(array_data, array.size());
+    ts_expect_success(deserializer.deserialize_uint32_array(options, decoded, ARRAY_TEST_COUNT));
+    ts_expect(memcmp(values, decoded, sizeof(values)) == 0);
+    for (size_t i = 0; i < 3; i++) {
+        bool value;
+        ts_expect_success(deserializer.deserialize_bool(&value));
+        ts_expect_bool_eq(value, true);
+    }
+}
+
+void check_uint16_array(PreparedUintOptions options) {
+    uint16_t values[ARRAY_TEST_COUNT];
+    uint16_t mask = (uint16_t)((1u << options.max_bits) - 1);
+    for (uint32_t i = 0; i < ARRAY_TEST_COUNT; i++) {
+        values[i] = (uint16_t)(i * 40503u) & mask;
+    }
+    static uint8_t one_by_one_data[ARRAY_TEST_COUNT * 3];
+    static uint8_t array_data[ARRAY_TEST_COUNT * 3];
+    Serializer one_by_one(one_by_one_data, sizeof(one_by_one_data));
+    Serializer array(array_data, sizeof(array_data));
+    for (size_t i = 0; i < ARRAY_TEST_COUNT; i++) {
+        ts_expect_success(one_by_one.serialize_uint16(values[i], options));
+    }
+    ts_expect_success(array.serialize_uint16_array(values, ARRAY_TEST_COUNT, options));
+    ts_expect_success(one_by_one.serialize_bool(true));
+    ts_expect_success(array.serialize_bool(true));
+    ts_expect_success(one_by_one.finalize());
+    ts_expect_success(array.finalize());
+    ts_assert(one_by_one.size() == array.size());
+    ts_expect(memcmp(one_by_one_data, array_data, array.size()) == 0);
+
+    uint16_t decoded[ARRAY_TEST_COUNT];
+    Deserializer deserializer(array_data, array.size());
+    ts_expect_success(deserializer.deserialize_uint16_array(options, decoded, ARRAY_TEST_COUNT));
+    ts_expect(memcmp(values, decoded, sizeof(values)) == 0);
+    bool value;
+    ts_expect_success(deserializer.deserialize_bool(&value));
+    ts_expect_bool_eq(value, true);
+}
+
+void check_uint8_array(PreparedUintOptions options) {
+    uint8_t values[ARRAY_TEST_COUNT];
+    uint8_t mask = (uint8_t)((1u << options.max_bits) - 1);
+    for (uint32_t i = 0; i < ARRAY_TEST_COUNT; i++) {
+        values[i] = (uint8_t)(i * 157u) & mask;
+    }
+    static uint8_t one_by_one_data[ARRAY_TEST_COUNT * 2];
+    static uint8_t array_data[ARRAY_TEST_COUNT * 2];
+    Serializer one_by_one(one_by_one_data, sizeof(one_by_one_data));
+    Serializer array(array_data, sizeof(array_data));
+    for (size_t i = 0; i < ARRAY_TEST_COUNT; i++) {
+        ts_expect_success(one_by_one.serialize_uint8(values[i], options));
+    }
+    ts_expect_success(array.serialize_uint8_array(values, ARRAY_TEST_COUNT, options));
+    ts_expect_success(one_by_one.finalize());
+    ts_expect_success(array.finalize());
+    ts_assert(one_by_one.size() == array.size());
+    ts_expect(memcmp(one_by_one_data, array_data, array.size()) == 0);
+
+    uint8_t decoded[ARRAY_TEST_COUNT];
+    Deserializer deserializer(array_data, array.size());
+    ts_expect_success(deserializer.deserialize_uint8_array(options, decoded, ARRAY_TEST_COUNT));
+    ts_expect(memcmp(values, decoded, sizeof(values)) == 0);
+}
+
+void test_uint_arrays() {
+    UintOptions single_segment;
+    single_segment.segments_hint = 1;
+    uint32_t uint32_widths[] = {5, 8, 12, 16, 20, 24, 29, 32};
+    for (uint32_t width : uint32_widths) {
+        single_segment.max_bits = width;
+        check_uint32_array(prepare_uint_options(single_segment));
+    }
+    check_uint32_array(uint32_default_options());
+    check_uint32_array(uint32_max_bits(20));
+
+    uint32_t uint16_widths[] = {3, 8, 9, 16};
+    for (uint32_t width : uint16_widths) {
+        single_segment.max_bits = width;
+        check_uint16_array(prepare_uint_options(single_segment));
+    }
+    check_uint16_array(uint16_default_options());
+
+    check_uint8_array(uint8_max_bits(3));
+    check_uint8_array(uint8_default_options());
+    UintOptions segmented;
+    segmented.max_bits = 8;
+    segmented.segments_hint = 2;
+    check_uint8_array(prepare_uint_options(segmented));
+}
+
+void test_constexpr_options() {
+    for (uint32_t max_bits = 1; max_bits <= 32; max_bits++) {
+        for (uint32_t hint = 0; hint <= max_bits; hint++) {
+            UintOptions options;
+            options.max_bits = max_bits;
+            options.segments_hint = hint;
+            PreparedUintOptions runtime = prepare_uint_options(options);
+            PreparedUintOptions compile_time = prepare_uint_options_constexpr(max_bits, hint);
+            ts_expect(memcmp(&runtime, &compile_time, sizeof(runtime)) == 0);
+        }
+    }
+    static_assert(UintSpec<16>::options.segment_count == 2, "");
+    static_assert(UintMaxSpec<1000>::options.max_bits == 10, "");
+}
+
+// the compile time options produce the same output as the runtime ones
+typedef UintSpec<18, 1> SingleSegment18;
+void test_spec_serialization() {
+    uint8_t runtime_data[64] = {};
+    uint8_t spec_data[64] = {};
+    Serializer runtime(runtime_data, sizeof(runtime_data));
+    Serializer spec(spec_data, sizeof(spec_data));
+
+    ts_expect_success(runtime.serialize_uint8(5, uint8_max_bits(4)));
+    ts_expect_success(spec.serialize_uint8<UintSpec<4>>(5));
+    ts_expect_success(runtime.serialize_bool(true));
+    ts_expect_success(spec.serialize_bool(true));
+    ts_expect_success(runtime.serialize_uint16(1023, uint16_default_options()));
+    ts_expect_success(spec.serialize_uint16<UintSpec<16>>(1023));
+    ts_expect_success(runtime.serialize_uint16(0, uint16_max(1000)));
+    ts_expect_success(spec.serialize_uint16<UintMaxSpec<1000>>(0));
+    ts_expect_success(runtime.serialize_uint32(70000, uint32_default_options()));
+    ts_expect_success(spec.serialize_uint32<UintSpec<32>>(70000));
+    UintOptions single_segment;
+    single_segment.max_bits = 18;
+    single_segment.segments_hint = 1;
+    ts_expect_success(runtime.serialize_uint32(12345, prepare_uint_options(single_segment)));
+    ts_expect_success(spec.serialize_uint32<SingleSegment18>(12345));
+    ts_expect_success(runtime.finalize());
+    ts_expect_success(spec.finalize());
+    ts_assert(runtime.size() == spec.size());
+    ts_expect(memcmp(runtime_data, spec_data, spec.size()) == 0);
+
+    Deserializer deserializer(spec_data, spec.size());
+    uint8_t value8;
+    uint16_t value16;
+    uint32_t value32;
+    bool flag;
+    ts_expect_success(deserializer.deserialize_uint8<UintSpec<4>>(&value8));
+    ts_expect_uint8_eq(value8, 5);
+    ts_expect_success(deserializer.deserialize_bool(&flag));
+    ts_expect_bool_eq(flag, true);
+    ts_expect_success(deserializer.deserialize_uint16<UintSpec<16>>(&value16));
+    ts_expect_uint16_eq(value16, 1023);
+    ts_expect_success(deserializer.deserialize_uint16<UintMaxSpec<1000>>(&value16));
+    ts_expect_uint16_eq(value16, 0);
+    ts_expect_success(deserializer.deserialize_uint32<UintSpec<32>>(&value32));
+    ts_expect_uint32_eq(value32, 70000);
+    ts_expect_success(deserializer.deserialize_uint32<SingleSegment18>(&value32));
+    ts_expect_uint32_eq(value32, 12345);
+    ts_expect_status(deserializer.deserialize_uint32<UintSpec<32>>(&value32), ResultStatus::ReadFailed);
+    ts_expect_uint32_eq(value32, 0);
+}
+
+void test_uint64() {
+    uint8_t data[128] = {};
+    Serializer serializer(data, sizeof(data));
+    // 13 bits, 2 out of 8 segments
+    ts_expect_success(serializer.serialize_uint64(0x1234, uint64_default_options()));
+    ts_expect_success(serializer.serialize_uint64(0, uint64_default_options()));
+    ts_expect_success(serializer.serialize_uint64(UINT64_MAX, uint64_default_options()));
+    ts_expect_success(serializer.serialize_uint64(0x123456789a, uint64_max_bits(40)));
+    ts_expect_success(serializer.serialize_uint64((uint64_t)1 << 50, uint64_max((uint64_t)1 << 50)));
+    ts_expect_success(serializer.serialize_uint64<UintSpec<64>>(0xfedcba9876543210));
+    ts_expect_success(serializer.serialize_uint64<UintMaxSpec<1000000000000>>(999999999999));
+    ts_expect_success(serializer.finalize());
+
+    // the headers 001, 000 and the start of 111 share the first byte
+    ts_expect_uint8_eq(data[0], 0b11000001);
+    ts_expect_uint8_eq(data[1], 0x34);
+    ts_expect_uint8_eq(data[2], 0x12);
+
+    Deserializer deserializer(data, serializer.size());
+    uint64_t value;
+    ts_expect_success(deserializer.deserialize_uint64(uint64_default_options(), &value));
+    ts_expect_uint64_eq(value, 0x1234);
+    ts_expect_success(deserializer.deserialize_uint64(uint64_default_options(), &value));
+    ts_expect_uint64_eq(value, 0);
+    ts_expect_success(deserializer.deserialize_uint64(uint64_default_options(), &value));
+    ts_expect_uint64_eq(value, UINT64_MAX);
+    ts_expect_success(deserializer.deserialize_uint64(uint64_max_bits(40), &value));
+    ts_expect_uint64_eq(value, 0x123456789a);
+    ts_expect_success(deserializer.deserialize_uint64(uint64_max((uint64_t)1 << 50), &value));
+    ts_expect_uint64_eq(value, (uint64_t)1 << 50);
+    ts_expect_success(deserializer.deserialize_uint64<UintSpec<64>>(&value));
+    ts_expect_uint64_eq(value, 0xfedcba9876543210);
+    ts_expect_success(deserializer.deserialize_uint64<UintMaxSpec<1000000000000>>(&value));
+    ts_expect_uint64_eq(value, 999999999999);
+    ts_expect_size_eq(deserializer.offset(), serializer.size());
+}
+
+typedef IntRangeSpec<-500, 500> Range500;
+typedef IntRangeSpec<-1000000000000, 0> NegativeRange;
+void test_signed() {
+    ts_expect_uint32_eq(zigzag_encode_int32(0), 0);
+    ts_expect_uint32_eq(zigzag_encode_int32(-1), 1);
+    ts_expect_uint32_eq(zigzag_encode_int32(1), 2);
+    ts_expect_uint32_eq(zigzag_encode_int32(INT32_MIN), UINT32_MAX);
+    ts_expect_uint8_eq(zigzag_encode_int8(INT8_MAX), 254);
+    ts_expect_int_eq(zigzag_decode_int32(UINT32_MAX), INT32_MIN);
+    ts_expect_int_eq(zigzag_decode_int16(3), -2);
+    ts_expect_uint32_eq(int32_range(-100, 100).max_bits, 8);
+    ts_expect_uint32_eq(int32_range(-129, 0).max_bits, 9);
+    ts_expect_uint32_eq(int8_range(0, 0).max_bits, 1);
+    ts_expect_uint32_eq(int64_range(INT64_MIN, INT64_MAX).max_bits, 64);
+
+    uint8_t data[128] = {};
+    Serializer serializer(data, sizeof(data));
+    ts_expect_success(serializer.serialize_int32(-1, int32_default_options()));
+    ts_expect_success(serializer.finalize());
+    // -1 takes as much space as 1 does
+    ts_expect_size_eq(serializer.size(), 2);
+    serializer.reset();
+
+    ts_expect_success(serializer.serialize_int8(-128, int8_default_options()));
+    ts_expect_success(serializer.serialize_int8(-3, int8_range(-4, 3)));
+    ts_expect_success(serializer.serialize_int16(-300, int16_default_options()));
+    ts_expect_success(serializer.serialize_int32(INT32_MIN, int32_default_options()));
+    ts_expect_success(serializer.serialize_int32(-100, int32_range(-100, 100)));
+    ts_expect_success(serializer.serialize_int64(-5000000000, int64_default_options()));
+    ts_expect_success(serializer.serialize_int64(INT64_MAX, int64_default_options()));
+    ts_expect_success(serializer.serialize_int16<Range500>(499));
+    ts_expect_success(serializer.serialize_int64<NegativeRange>(-999999999999));
+    ts_expect_success(serializer.finalize());
+
+    Deserializer deserializer(data, serializer.size());
+    int8_t value8;
+    int16_t value16;
+    int32_t value32;
+    int64_t value64;
+    ts_expect_success(deserializer.deserialize_int8(int8_default_options(), &value8));
+    ts_expect_int_eq(value8, -128);
+    ts_expect_success(deserializer.deserialize_int8(int8_range(-4, 3), &value8));
+    ts_expect_int_eq(value8, -3);
+    ts_expect_success(deserializer.deserialize_int16(int16_default_options(), &value16));
+    ts_expect_int_eq(value16, -300);
+    ts_expect_success(deserializer.deserialize_int32(int32_default_options(), &value32));
+    ts_expect_int_eq(value32, INT32_MIN);
+    ts_expect_success(deserializer.deserialize_int32(int32_range(-100, 100), &value32));
+    ts_expect_int_eq(value32, -100);
+    ts_expect_success(deserializer.deserialize_int64(int64_default_options(), &value64));
+    ts_expect(value64 == -5000000000);
+    ts_expect_success(deserializer.deserialize_int64(int64_default_options(), &value64));
+    ts_expect(value64 == INT64_MAX);
+    ts_expect_success(deserializer.deserialize_int16<Range500>(&value16));
+    ts_expect_int_eq(value16, 499);
+    ts_expect_success(deserializer.deserialize_int64<NegativeRange>(&value64));
+    ts_expect(value64 == -999999999999);
+    ts_expect_size_eq(deserializer.offset(), serializer.size());
+}
+
+#define FLOAT_TEST_COUNT 1000
+void test_quantized_floats() {
+    constexpr PreparedFloatOptions coordinate = float_quantized_options(-1000.0f, 1000.0f, 0.01f);
+    static_assert(coordinate.uint_options.max_bits == 18, "a coordinate takes 18 bits");
+    static_assert(coordinate.uint_options.segments_storage_size == 0, "quantized floats have a single segment");
+
+    static uint8_t single_data[FLOAT_TEST_COUNT * 3 + 64];
+    static uint8_t array_data[FLOAT_TEST_COUNT * 3 + 64];
+    static float values[FLOAT_TEST_COUNT];
+    static float results[FLOAT_TEST_COUNT];
+    for (size_t i = 0; i < FLOAT_TEST_COUNT; i++) {
+        values[i] = -1000.0f + (float)i * 2.0013f;
+    }
+    // out of range values are clamped
+    values[3] = 5000.0f;
+    values[4] = -5000.0f;
+
+    Serializer single(single_data, sizeof(single_data));
+    Serializer array(array_data, sizeof(array_data));
+    for (size_t i = 0; i < FLOAT_TEST_COUNT; i++) {
+        ts_expect_success(single.serialize_float_quantized(values[i], coordinate));
+    }
+    ts_expect_success(array.serialize_float_quantized_array(values, FLOAT_TEST_COUNT, coordinate));
+    ts_expect_success(single.finalize());
+    ts_expect_success(array.finalize());
+    ts_expect_size_eq(array.size(), FLOAT_TEST_COUNT * 3);
+    ts_assert(single.size() == array.size());
+    ts_expect(memcmp(single_data, array_data, array.size()) == 0);
+
+    Deserializer deserializer(array_data, array.size());
+    ts_expect_success(deserializer.deserialize_float_quantized_array(coordinate, results, FLOAT_TEST_COUNT));
+    values[3] = 1000.0f;
+    values[4] = -1000.0f;
+    for (size_t i = 0; i < FLOAT_TEST_COUNT; i++) {
+        float error = results[i] - values[i];
+        ts_expect(error <= 0.0051f && error >= -0.0051f);
+    }
+
+    deserializer.reset();
+    float value;
+    ts_expect_success(deserializer.deserialize_float_quantized(coordinate, &value));
+    ts_expect(value == results[0]);
+
+    uint8_t data[8] = {};
+    Serializer serializer(data, sizeof(data));
+    ts_expect_success(serializer.serialize_float_quantized(0.5f, 0.0f, 1.0f, 0.1f));
+    ts_expect_success(serializer.finalize());
+    ts_expect_uint8_eq(data[0], 5);
+    Deserializer small_deserializer(data, serializer.size());
+    ts_expect_success(small_deserializer.deserialize_float_quantized(0.0f, 1.0f, 0.1f, &value));
+    ts_expect(value > 0.49f && value < 0.51f);
+    ts_expect_status(small_deserializer.deserialize_float_quantized(0.0f, 1.0f, 0.1f, &value), ResultStatus::ReadFailed);
+}
+
+struct DeltaState {
+    uint32_t id;
+    uint16_t health;
+    int32_t velocity;
+    int64_t position;
+    float angle;
+};
+
+static void serialize_delta_state(Serializer* serializer, const DeltaState& state, const DeltaState& baseline) {
+    ts_expect_success(serializer->serialize_uint32_delta(state.id, baseline.id, uint32_default_options()));
+    ts_expect_success(serializer->serialize_uint16_delta(state.health, baseline.health, uint16_max(1000)));
+    ts_expect_success(serializer->serialize_int32_delta(state.velocity, baseline.velocity, int32_range(-5000, 5000)));
+    ts_expect_success(serializer->serialize_int64_delta(state.position, baseline.position, int64_default_options()));
+    ts_expect_success(serializer->serialize_float_quantized_delta(state.angle, baseline.angle, float_quantized_options(0.0f, 360.0f, 0.1f)));
+}
+
+static void deserialize_delta_state(Deserializer* deserializer, DeltaState* state, const DeltaState& baseline) {
+    ts_expect_success(deserializer->deserialize_uint32_delta(uint32_default_options(), baseline.id, &state->id));
+    ts_expect_success(deserializer->deserialize_uint16_delta(uint16_max(1000), baseline.health, &state->health));
+    ts_expect_success(deserializer->deserialize_int32_delta(int32_range(-5000, 5000), baseline.velocity, &state->velocity));
+    ts_expect_success(deserializer->deserialize_int64_delta(int64_default_options(), baseline.position, &state->position));
+    ts_expect_success(deserializer->deserialize_float_quantized_delta(float_quantized_options(0.0f, 360.0f, 0.1f), baseline.angle, &state->angle));
+}
+
+void test_delta() {
+    DeltaState baseline = { 70000, 1000, -20, -5000000000, 90.0f };
+    uint8_t data[64] = {};
+    Serializer serializer(data, sizeof(data));
+
+    // nothing changed, a bit per field
+    serialize_delta_state(&serializer, baseline, baseline);
+    ts_expect_success(serializer.finalize());
+    ts_expect_size_eq(serializer.size(), 1);
+    ts_expect_uint8_eq(data[0], 0);
+
+    Deserializer deserializer(data, serializer.size());
+    DeltaState state;
+    deserialize_delta_state(&deserializer, &state, baseline);
+    ts_expect_uint32_eq(state.id, 70000);
+    ts_expect_uint16_eq(state.health, 1000);
+    ts_expect_int_eq(state.velocity, -20);
+    ts_expect(state.position == -5000000000);
+    ts_expect(state.angle > 89.99f && state.angle < 90.01f);
+
+    // only health and angle changed
+    DeltaState changed = baseline;
+    changed.health = 3;
+    changed.angle = 180.0f;
+    serializer.reset();
+    memset(data, 0, sizeof(data));
+    serialize_delta_state(&serializer, changed, baseline);
+    ts_expect_success(serializer.finalize());
+    ts_expect_size_eq(serializer.size(), 4);
+
+    Deserializer changed_deserializer(data, serializer.size());
+    deserialize_delta_state(&changed_deserializer, &state, baseline);
+    ts_expect_uint32_eq(state.id, 70000);
+    ts_expect_uint16_eq(state.health, 3);
+    ts_expect_int_eq(state.velocity, -20);
+    ts_expect(state.position == -5000000000);
+    ts_expect(state.angle > 179.99f && state.angle < 180.01f);
+    ts_expect_size_eq(changed_deserializer.offset(), serializer.size());
+}
+
+struct FieldsAngle {
+    static constexpr PreparedFloatOptions options = float_quantized_options(0.0f, 360.0f, 0.1f);
+};
+
+struct FieldsVector {
+    int32_t x;
+    int32_t y;
+};
+PM_FIELDS(FieldsVector,
+    PM_INT(x, IntRangeSpec<-5000, 5000>),
+    PM_INT(y, IntRangeSpec<-5000, 5000>)
+)
+
+struct FieldsPlayer {
+    uint32_t id;
+    uint16_t health;
+    bool alive;
+    uint64_t score;
+    FieldsVector velocity;
+    float angle;
+    uint8_t team;
+};
+PM_FIELDS(FieldsPlayer,
+    PM_UINT(id, UintSpec<32>),
+    PM_UINT(health, UintMaxSpec<1000>),
+    PM_BOOL(alive),
+    PM_UINT(score, UintSpec<64>),
+    PM_STRUCT(velocity),
+    PM_FLOAT(angle, FieldsAngle),
+    PM_UINT(team, UintSpec<3, 1>)
+)
+
+// the same fields written by hand with runtime options
+static void serialize_player_by_hand(Serializer* serializer, const FieldsPlayer& player) {
+    ts_expect_success(serializer->serialize_uint32(player.id, uint32_default_options()));
+    ts_expect_success(serializer->serialize_uint16(player.health, uint16_max(1000)));
+    ts_expect_success(serializer->serialize_bool(player.alive));
+    ts_expect_success(serializer->serialize_uint64(player.score, uint64_default_options()));
+    ts_expect_success(serializer->serialize_int32(player.velocity.x, int32_range(-5000, 5000)));
+    ts_expect_success(serializer->serialize_int32(player.velocity.y, int32_range(-5000, 5000)));
+    ts_expect_success(serializer->serialize_float_quantized(player.angle, FieldsAngle::options));
+    ts_expect_success(serializer->serialize_uint8(player.team, uint8_max_bits(3)));
+}
+
+void test_fields() {
+    FieldsPlayer player = { 70000, 999, true, 123456789012, { -4000, 17 }, 45.5f, 5 };
+    uint8_t fields_data[64] = {};
+    uint8_t hand_data[64] = {};
+    Serializer fields(fields_data, sizeof(fields_data));
+    Serializer hand(hand_data, sizeof(hand_data));
+    ts_expect_success(serialize_fields(&fields, player));
+    serialize_player_by_hand(&hand, player);
+    ts_expect_success(fields.finalize());
+    ts_expect_success(hand.finalize());
+    ts_assert(fields.size() == hand.size());
+    ts_expect(memcmp(fields_data, hand_data, hand.size()) == 0);
+
+    Deserializer deserializer(fields_data, fields.size());
+    FieldsPlayer result = {};
+    ts_expect_success(deserialize_fields(&deserializer, &result));
+    ts_expect_uint32_eq(result.id, 70000);
+    ts_expect_uint16_eq(result.health, 999);
+    ts_expect_bool_eq(result.alive, true);
+    ts_expect_uint64_eq(result.score, 123456789012);
+    ts_expect_int_eq(result.velocity.x, -4000);
+    ts_expect_int_eq(result.velocity.y, 17);
+    ts_expect(result.angle > 45.49f && result.angle < 45.51f);
+    ts_expect_uint8_eq(result.team, 5);
+    ts_expect_status(deserialize_fields(&deserializer, &result), ResultStatus::ReadFailed);
+
+    // only velocity.y changed, a bit for every other field
+    FieldsPlayer changed = player;
+    changed.velocity.y = -1;
+    fields.reset();
+    memset(fields_data, 0, sizeof(fields_data));
+    ts_expect_success(serialize_fields_delta(&fields, changed, player));
+    ts_expect_success(fields.finalize());
+    ts_expect_size_eq(fields.size(), 2);
+
+    Deserializer delta_deserializer(fields_data, fields.size());
+    ts_expect_success(deserialize_fields_delta(&delta_deserializer, player, &result));
+    ts_expect_uint32_eq(result.id, 70000);
+    ts_expect_uint64_eq(result.score, 123456789012);
+    ts_expect_int_eq(result.velocity.x, -4000);
+    ts_expect_int_eq(result.velocity.y, -1);
+    ts_expect(result.angle > 45.49f && result.angle < 45.51f);
+    ts_expect_uint8_eq(result.team, 5);
+}
+
+// every kind of value, the same calls on a Serializer and a SizeCounter
+template<typename S>
+void serialize_measured_packet(S* serializer, uint32_t seed) {
+    constexpr PreparedFloatOptions angle = float_quantized_options(0.0f, 360.0f, 0.1f);
+    PreparedUintOptions bits_5 = prepare_uint_options({ 5, 1 });
+    PreparedUintOptions bits_20 = prepare_uint_options({ 20, 4 });
+    serializer->serialize_uint8((uint8_t)seed, uint8_default_options());
+    serializer->serialize_bool(seed & 1);
+    serializer->serialize_uint16((uint16_t)(seed * 3), uint16_default_options());
+    serializer->serialize_uint32(seed * 2654435761u, uint32_default_options());
+    serializer->serialize_uint32(seed & 0xFFFFF, bits_20);
+    serializer->serialize_uint64((uint64_t)seed << (seed % 32), uint64_default_options());
+    serializer->template serialize_uint16<UintSpec<10>>((uint16_t)(seed % 1024));
+    serializer->template serialize_uint32<UintSpec<18, 2>>(seed % 200000);
+    serializer->serialize_int32(-(int32_t)seed, int32_default_options());
+    serializer->template serialize_int16<IntRangeSpec<-500, 500>>((int16_t)(seed % 1000) - 500);
+    serializer->serialize_float_quantized((float)(seed % 3600) * 0.1f, angle);
+    serializer->serialize_float_quantized((float)seed, -10.0f, 10.0f, 0.5f);
+    serializer->serialize_uint32_delta(seed, seed % 3 == 0 ? seed : seed + 1, uint32_default_options());
+    serializer->serialize_int8_delta((int8_t)seed, 0, int8_default_options());
+    serializer->serialize_float_quantized_delta(1.0f, (float)(seed % 2), angle);
+
+    // more bytes with free bits than the queue holds, the oldest ones are closed
+    uint8_t small[100];
+    uint32_t wide[40];
+    float angles[70];
+    for (uint32_t i = 0; i < 100; i++) {
+        small[i] = (uint8_t)((seed + i) % 32);
+    }
+    for (uint32_t i = 0; i < 40; i++) {
+        wide[i] = (seed * i) >> (i % 20);
+    }
+    for (uint32_t i = 0; i < 70; i++) {
+        angles[i] = (float)((seed + i * 7) % 360);
+    }
+    serializer->serialize_uint8_array(small, seed % 100, bits_5);
+    serializer->serialize_uint32_array(wide, 40, uint32_default_options());
+    serializer->serialize_uint32_array(wide, 40, prepare_uint_options({ 32, 1 }));
+    serializer->serialize_float_quantized_array(angles, 70, angle);
+    for (uint32_t i = 0; i < seed % 11; i++) {
+        serializer->serialize_bool(i & 1);
+    }
+    serializer->serialize_bytes(small, seed % 90);
+    serializer->serialize_uint8(3, bits_5);
+}
+
+void test_size_counter() {
+    uint8_t data[2048];
+    SizeCounter counter;
+    size_t total = 0;
+    bool same = true;
+    for (uint32_t seed = 0; seed < 500; seed++) {
+        Serializer serializer(data, sizeof(data));
+        counter.reset();
+        serialize_measured_packet(&serializer, seed * 7919);
+        serialize_measured_packet(&counter, seed * 7919);
+        ts_expect_success(serializer.finalize());
+        ts_expect_success(counter.finalize());
+        same = same && counter.bytes() == serializer.size() && counter.bits() <= counter.bytes() * 8;
+        total += serializer.size();
+    }
+    ts_expect(same);
+
+    // packets of a batch are counted together
+    counter.reset();
+    for (uint32_t seed = 0; seed < 500; seed++) {
+        serialize_measured_packet(&counter, seed * 7919);
+        counter.finalize();
+    }
+    ts_expect_size_eq(counter.bytes(), total);
+
+    // described structs are measured as well
+    FieldsPlayer player = { 70000, 999, true, 123456789012, { -4000, 17 }, 45.5f, 5 };
+    Serializer fields(data, sizeof(data));
+    ts_expect_success(serialize_fields(&fields, player));
+    ts_expect_success(fields.finalize());
+    counter.reset();
+    ts_expect_success(serialize_fields(&counter, player));
+    ts_expect_size_eq(counter.bytes(), fields.size());
+    FieldsPlayer baseline = player;
+    baseline.velocity.y = -1;
+    fields.reset();
+    serialize_fields_delta(&fields, player, baseline);
+    fields.finalize();
+    counter.reset();
+    serialize_fields_delta(&counter, player, baseline);
+    ts_expect_size_eq(counter.bytes(), fields.size());
+}
+
+void test_stats() {
+    Vector<uint8_t> output(&allocator);
+    Writer writer{};
+    writer.write_callback = write_data;
+    writer.ctx = &output;
+    Serializer serializer(&writer, &allocator);
+    ts_expect_success(serializer.serialize_uint8(5, uint8_max_bits(4)));
+    for (int i = 0; i < 4; i++) {
+        ts_expect_success(serializer.serialize_bool(true));
+    }
+    // 17 bits, 3 segments of 8 bits and a 2 bit header
+    ts_expect_success(serializer.serialize_uint32(70000, uint32_default_options()));
+    ts_expect_success(serializer.finalize());
+    ts_expect_size_eq(output.length(), 5);
+
+    SerializerStats stats = serializer.stats();
+    Deserializer deserializer(output.ptr(), output.length());
+    uint8_t value8;
+    uint32_t value32;
+    bool flag;
+    ts_expect_success(deserializer.deserialize_uint8(uint8_max_bits(4), &value8));
+    for (int i = 0; i < 4; i++) {
+        ts_expect_success(deserializer.deserialize_bool(&flag));
+    }
+    ts_expect_success(deserializer.deserialize_uint32(uint32_default_options(), &value32));
+    DeserializerStats deserializer_stats = deserializer.stats();
+
+#ifdef PACKET_MASTER_STATS
+    ts_expect(stats.values == 6);
+    ts_expect(stats.bits == 34);
+    ts_expect(stats.bytes == 5);
+    ts_expect(stats.writes == 2);
+    ts_expect(stats.flushes >= stats.writes);
+    ts_expect(stats.padding_bits == 6);
+    ts_expect(stats.free_bits_high_water == 1);
+    // the packet fits in the inline buffer
+    ts_expect(stats.reallocations == 0);
+
+    ts_expect(deserializer_stats.values == 6);
+    ts_expect(deserializer_stats.bits == 34);
+    ts_expect(deserializer_stats.bytes == 5);
+    ts_expect(deserializer_stats.reads == 0);
+    ts_expect(deserializer_stats.free_bits_high_water == 1);
+#else
+    ts_expect(stats.values == 0 && stats.bytes == 0);
+    ts_expect(deserializer_stats.values == 0 && deserializer_stats.bytes == 0);
+#endif
+
+    serializer.reset_stats();
+    deserializer.reset_stats();
+    stats = serializer.stats();
+    deserializer_stats = deserializer.stats();
+    ts_expect(stats.values == 0 && stats.bits == 0 && stats.writes == 0 && stats.reallocations == 0);
+    ts_expect(deserializer_stats.values == 0 && deserializer_stats.bytes == 0);
+
+    // a value deserialized again after a rewind is counted once
+    Deserializer retry(output.ptr(), output.length());
+    DeserializerCheckpoint checkpoint = retry.checkpoint();
+    ts_expect_success(retry.deserialize_uint8(uint8_max_bits(4), &value8));
+    retry.rewind(checkpoint);
+    ts_expect_success(retry.deserialize_uint8(uint8_max_bits(4), &value8));
+    ts_expect_int_eq(value8, 5);
+    deserializer_stats = retry.stats();
+#ifdef PACKET_MASTER_STATS
+    ts_expect(deserializer_stats.values == 1);
+    ts_expect(deserializer_stats.bytes == 1);
+#else
+    ts_expect(deserializer_stats.values == 0);
+#endif
+}
+
+void test_arena_allocator() {
+    alignas(16) static uint8_t memory[1024];
+    ArenaAllocator arena(memory, sizeof(memory));
+    ts_expect_size_eq(arena.capacity(), sizeof(memory));
+    Allocator arena_allocator = arena.allocator();
+
+    {
+        // the last block grows in place
+        Vector<uint8_t> vector(&arena_allocator);
+        ts_assert(vector.push(1) != nullptr);
+        uint8_t* data = vector.ptr();
+        for (int i = 0; i < 499; i++) {
+            ts_assert(vector.push((uint8_t)i) != nullptr);
+        }
+        ts_expect(vector.ptr() == data);
+        ts_expect_size_eq(arena.used(), vector.capacity());
+    }
+    // the vector was the last block so freeing it gives the memory back
+    ts_expect_size_eq(arena.used(), 0);
+
+    {
+        // growing a block which is not the last one copies it
+        Vector<uint32_t> first(&arena_allocator);
+        Vector<uint32_t> second(&arena_allocator);
+        for (uint32_t i = 0; i < 20; i++) {
+            ts_assert(first.push(i) != nullptr);
+            ts_assert(second.push(i * 2) != nullptr);
+        }
+        for (uint32_t i = 0; i < 20; i++) {
+            ts_expect_uint32_eq(first[i], i);
+            ts_expect_uint32_eq(second[i], i * 2);
+        }
+        ts_expect((size_t)first.ptr() % 16 == 0);
+        ts_expect((size_t)second.ptr() % 16 == 0);
+    }
+    ts_expect(arena.alloc(sizeof(memory)) == nullptr);
+    arena.reset();
+    ts_expect_size_eq(arena.used(), 0);
+    ts_expect(arena.alloc(sizeof(memory)) != nullptr);
+    ts_expect_size_eq(arena.peak(), sizeof(memory));
+    arena.reset();
+
+    // a full arena fails like any other allocator
+    Vector<uint8_t> output(&allocator);
+    Writer writer{};
+    writer.write_callback = write_data;
+    writer.ctx = &output;
+    Serializer serializer(&writer, &arena_allocator);
+    serializer.set_flush_policy(FlushPolicy::Finalize);
+    Result result = Result(ResultStatus::Success);
+    for (int i = 0; i < 2000 && result.status == ResultStatus::Success; i++) {
+        result = serializer.serialize_uint8((uint8_t)i, uint8_default_options());
+    }
+    ts_expect_status(result, ResultStatus::MemoryAllocationFailed);
+
+    ArenaAllocator mapped(1 << 20, true);
+    ts_assert(mapped.capacity() >= (1 << 20));
+    Allocator mapped_allocator = mapped.allocator();
+    Serializer mapped_serializer(&writer, &mapped_allocator);
+    output.clear();
+    for (int i = 0; i < 10000; i++) {
+        ts_expect_success(mapped_serializer.serialize_uint32((uint32_t)i, uint32_default_options()));
+    }
+    ts_expect_success(mapped_serializer.finalize());
+    Deserializer deserializer(output.ptr(), output.length());
+    uint32_t value = 0;
+    for (int i = 0; i < 10000; i++) {
+        ts_expect_success(deserializer.deserialize_uint32(uint32_default_options(), &value));
+    }
+    ts_expect_uint32_eq(value, 9999);
+}
+
+// counts the calls into the heap, ctx is a size_t
+void* counting_malloc(size_t size, void* ctx) {
+    (*(size_t*)ctx)++;
+    return malloc(size);
+}
+void* counting_realloc(void* ptr, size_t old_size, size_t new_size, void* ctx) {
+    (void)old_size;
+    (*(size_t*)ctx)++;
+    return realloc(ptr, new_size);
+}
+
+// the data of a vector with inline elements points into the vector itself, so neither it nor a serializer can be copied
+static_assert(!std::is_copy_constructible<Vector<uint8_t, 16>>::value && !std::is_copy_assignable<Vector<uint8_t, 16>>::value);
+static_assert(!std::is_copy_constructible<Serializer>::value && !std::is_copy_assignable<Serializer>::value);
+
+// remove_many used to skip the move when a single element was left after the range, and asserted on a range at the end
+void test_vector_remove_many() {
+    Vector<uint8_t> vector(&allocator);
+    for (uint8_t i = 0; i < 6; i++) {
+        ts_expect(vector.push(i) != nullptr);
+    }
+    ts_expect(vector.remove_many(1, 4));
+    ts_assert(vector.length() == 2);
+    ts_expect_uint8_eq(vector[0], 0);
+    ts_expect_uint8_eq(vector[1], 5);
+
+    ts_expect(vector.remove_many(1, 1));
+    ts_assert(vector.length() == 1);
+    ts_expect_uint8_eq(vector[0], 0);
+    ts_expect(vector.remove_many(0, 1));
+    ts_expect_size_eq(vector.length(), 0);
+}
+
+void test_inline_vector() {
+    size_t allocations = 0;
+    Allocator counting_allocator = { counting_malloc, counting_realloc, my_free, &allocations };
+
+    {
+        Vector<uint8_t, 16> vector(&counting_allocator);
+        ts_expect_size_eq(vector.capacity(), 16);
+        for (int i = 0; i < 16; i++) {
+            ts_expect(vector.push((uint8_t)i) != nullptr);
+        }
+        ts_expect(vector.is_inline());
+        ts_expect_size_eq(allocations, 0);
+
+        // spills to the allocator past the inline capacity and keeps the contents
+        ts_expect(vector.push(16) != nullptr);
+        ts_expect(!vector.is_inline());
+        ts_expect_size_eq(allocations, 1);
+        ts_expect_size_eq(vector.capacity(), 32);
+        uint8_t more[40];
+        for (int i = 0; i < 40; i++) {
+            more[i] = (uint8_t)(17 + i);
+        }
+        ts_expect(vector.push_many(more, 40) != nullptr);
+        ts_expect_size_eq(allocations, 2);
+        ts_expect_size_eq(vector.length(), 57);
+        bool same = true;
+        for (int i = 0; i < 57; i++) {
+            same = same && vector[i] == (uint8_t)i;
+        }
+        ts_expect(same);
+    }
+
+    // a small packet never allocates
+    allocations = 0;
+    Vector<uint8_t> output(&allocator);
+    Writer writer{};
+    writer.write_callback = write_data;
+    writer.ctx = &output;
+    Serializer serializer(&writer, &counting_allocator);
+    serializer.set_flush_policy(FlushPolicy::Finalize);
+    for (int i = 0; i < 20; i++) {
+        ts_expect_success(serializer.serialize_uint16((uint16_t)(i * 300), uint16_default_options()));
+    }
+    ts_expect_success(serializer.finalize());
+    ts_expect_size_eq(allocations, 0);
+    ts_expect(output.length() > 20 && output.length() <= PACKET_MASTER_INLINE_BUFFER_SIZE);
+}
+
+// appends every segment to a vector and counts the calls
+struct SegmentsOutput {
+    Vector<uint8_t>* buffer;
+    size_t calls;
+    size_t segments;
+};
+int write_segments(void* ctx, const WriterSegment* segments, size_t count) {
+    SegmentsOutput* output = (SegmentsOutput*)ctx;
+    output->calls++;
+    output->segments += count;
+    for (size_t i = 0; i < count; i++) {
+        if (output->buffer->push_many(segments[i].data, segments[i].size) == nullptr) {
+            return 1;
+        }
+    }
+    return 0;
+}
+int write_segments_data(void* ctx, uint8_t* data, size_t size) {
+    SegmentsOutput* output = (SegmentsOutput*)ctx;
+    output->calls++;
+    return output->buffer->push_many(data, size) == nullptr ? 1 : 0;
+}
+
+// fails the first call without writing anything
+int write_segments_failing_once(void* ctx, const WriterSegment* segments, size_t count) {
+    SegmentsOutput* output = (SegmentsOutput*)ctx;
+    if (output->calls++ == 0) {
+        return 7;
+    }
+    output->calls--;
+    return write_segments(ctx, segments, count);
+}
+
+// a header, a payload and a trailer
+void serialize_segmented_packet(Serializer* serializer, const uint8_t* payload, size_t size) {
+    ts_expect_success(serializer->serialize_uint32((uint32_t)size, uint32_default_options()));
+    ts_expect_success(serializer->serialize_bool(true));
+    ts_expect_success(serializer->serialize_bytes(payload, size));
+    ts_expect_success(serializer->serialize_bool(false));
+    ts_expect_success(serializer->serialize_uint16(0xbeef, uint16_default_options()));
+    ts_expect_success(serializer->finalize());
+}
+
+void validate_segmented_packet(const uint8_t* data, size_t length, const uint8_t* payload, size_t size) {
+    Deserializer deserializer(data, length);
+    uint32_t payload_size;
+    bool first;
+    bool second;
+    uint16_t trailer;
+    uint8_t result[256];
+    ts_expect_success(deserializer.deserialize_uint32(uint32_default_options(), &payload_size));
+    ts_expect_uint32_eq(payload_size, (uint32_t)size);
+    ts_expect_success(deserializer.deserialize_bool(&first));
+    ts_expect_success(deserializer.deserialize_bytes(result, size));
+    ts_expect_success(deserializer.deserialize_bool(&second));
+    ts_expect_success(deserializer.deserialize_uint16(uint16_default_options(), &trailer));
+    ts_expect(first && !second);
+    ts_expect(memcmp(result, payload, size) == 0);
+    ts_expect_uint16_eq(trailer, 0xbeef);
+    ts_expect_size_eq(deserializer.offset(), length);
+}
+
+void test_writev() {
+    uint8_t payload[200];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 7);
+    }
+
+    // the payload is handed to the writer without a copy, in the same call as the rest of the packet
+    Vector<uint8_t> output(&allocator);
+    SegmentsOutput segments_output = { &output, 0, 0 };
+    Writer writer{};
+    writer.write_callback = write_segments_data;
+    writer.writev_callback = write_segments;
+    writer.ctx = &segments_output;
+    Serializer serializer(&writer, &allocator);
+    serializer.set_flush_policy(FlushPolicy::Finalize);
+    serialize_segmented_packet(&serializer, payload, sizeof(payload));
+    ts_expect_size_eq(segments_output.calls, 1);
+    ts_expect_size_eq(segments_output.segments, 3);
+    validate_segmented_packet(output.ptr(), output.length(), payload, sizeof(payload));
+
+    // a default initialized Writer has no writev_callback, even over memory that held something else
+    alignas(Writer) uint8_t writer_memory[sizeof(Writer)];
+    memset(writer_memory, 0xff, sizeof(writer_memory));
+    Writer* default_writer = new (writer_memory) Writer;
+    ts_expect(default_writer->writev_callback == nullptr);
+
+    // the same bytes when the payload is copied, without a writev_callback or into a fixed buffer
+    Vector<uint8_t> copied(&allocator);
+    SegmentsOutput copied_output = { &copied, 0, 0 };
+    Writer copy_writer{};
+    copy_writer.write_callback = write_segments_data;
+    copy_writer.ctx = &copied_output;
+    Serializer copy_serializer(&copy_writer, &allocator);
+    copy_serializer.set_flush_policy(FlushPolicy::Finalize);
+    serialize_segmented_packet(&copy_serializer, payload, sizeof(payload));
+    ts_expect_size_eq(copied_output.calls, 1);
+    ts_expect_size_eq(copied.length(), output.length());
+    ts_expect(memcmp(copied.ptr(), output.ptr(), output.length()) == 0);
+
+    uint8_t fixed_data[256];
+    Serializer fixed(fixed_data, sizeof(fixed_data));
+    serialize_segmented_packet(&fixed, payload, sizeof(payload));
+    ts_expect_size_eq(fixed.size(), output.length());
+    ts_expect(memcmp(fixed_data, output.ptr(), output.length()) == 0);
+
+    // a payload behind a byte with free bits waits for it with FlushPolicy::PerValue
+    output.clear();
+    segments_output.calls = 0;
+    Serializer per_value(&writer, &allocator);
+    serialize_segmented_packet(&per_value, payload, sizeof(payload));
+    validate_segmented_packet(output.ptr(), output.length(), payload, sizeof(payload));
+
+    // the payload is still queued after a failed write, so finalize can be called again
+    output.clear();
+    segments_output.calls = 0;
+    Writer failing_writer{};
+    failing_writer.write_callback = write_segments_data;
+    failing_writer.writev_callback = write_segments_failing_once;
+    failing_writer.ctx = &segments_output;
+    Serializer retried(&failing_writer, &allocator);
+    retried.set_flush_policy(FlushPolicy::Finalize);
+    ts_expect_success(retried.serialize_uint32((uint32_t)sizeof(payload), uint32_default_options()));
+    ts_expect_success(retried.serialize_bool(true));
+    ts_expect_success(retried.serialize_bytes(payload, sizeof(payload)));
+    ts_expect_success(retried.serialize_bool(false));
+    ts_expect_success(retried.serialize_uint16(0xbeef, uint16_default_options()));
+    Result failed = retried.finalize();
+    ts_expect_status(failed, ResultStatus::WriteFailed);
+    ts_expect(failed.error_info.write_error == 7);
+    ts_expect_size_eq(output.length(), 0);
+    ts_expect_success(retried.finalize());
+    validate_segmented_packet(output.ptr(), output.length(), payload, sizeof(payload));
+
+    // reading past the end fails
+    Deserializer deserializer(output.ptr(), 4);
+    ts_expect_status(deserializer.deserialize_bytes(fixed_data, 8), ResultStatus::ReadFailed);
+
+#ifdef PACKET_MASTER_POSIX_IO
+    int pipe_fds[2];
+    ts_assert(pipe(pipe_fds) == 0);
+    FdWriter fd_writer(pipe_fds[1]);
+    Writer fd_writer_writer = fd_writer.writer();
+    Serializer fd_serializer(&fd_writer_writer, &allocator);
+    fd_serializer.set_flush_policy(FlushPolicy::Finalize);
+    serialize_segmented_packet(&fd_serializer, payload, sizeof(payload));
+    ts_expect_size_eq(fd_writer.syscalls(), 1);
+    uint8_t piped[256];
+    ssize_t piped_size = read(pipe_fds[0], piped, sizeof(piped));
+    ts_expect(piped_size == (ssize_t)output.length());
+    validate_segmented_packet(piped, (size_t)piped_size, payload, sizeof(payload));
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+#endif
+}
+
+void test_mapped_file() {
+#ifdef PACKET_MASTER_POSIX_IO
+    const char* path = "packet_master_mapped_test.bin";
+    const uint32_t count = 20000;
+    {
+        // a small chunk so the file grows several times
+        MappedFileWriter file(path, 4096);
+        ts_assert(file.is_open());
+        Writer writer = file.writer();
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(FlushPolicy::Threshold, 256);
+        for (uint32_t i = 0; i < count; i++) {
+            ts_expect_success(serializer.serialize_uint32(i * 37, uint32_default_options()));
+        }
+        ts_expect_success(serializer.finalize());
+        ts_expect(file.capacity() >= file.size() && file.capacity() > 4096);
+        ts_expect_int_eq(file.close(), 0);
+    }
+
+    MappedFileReader file(path);
+    ts_assert(file.is_open());
+    ts_expect(file.size() > count);
+    Reader reader = file.reader();
+    Deserializer deserializer(&reader, &allocator);
+    uint32_t value = 0;
+    bool same = true;
+    for (uint32_t i = 0; i < count; i++) {
+        ts_expect_success(deserializer.deserialize_uint32(uint32_default_options(), &value));
+        same = same && value == i * 37;
+    }
+    ts_expect(same);
+    // the file was truncated to the written bytes
+    ts_expect_size_eq(file.offset(), file.size());
+    ts_expect_status(deserializer.deserialize_uint32(uint32_default_options(), &value), ResultStatus::ReadFailed);
+
+    // the mapping can be deserialized from memory as well
+    Deserializer memory(file.data(), file.size());
+    ts_expect_success(memory.deserialize_uint32(uint32_default_options(), &value));
+    ts_expect_uint32_eq(value, 0);
+    unlink(path);
+
+    MappedFileReader missing("packet_master_missing_file.bin");
+    ts_expect(!missing.is_open());
+    ts_expect(missing.error() != 0);
+#endif
+}
+
+// a packet with its number and a few bytes depending on it
+size_t serialize_log_packet(uint32_t number, uint8_t* data, size_t capacity) {
+    Serializer serializer(data, capacity);
+    serializer.serialize_uint32(number, uint32_default_options());
+    for (uint32_t i = 0; i < number % 5; i++) {
+        serializer.serialize_uint8((uint8_t)i, uint8_default_options());
+    }
+    serializer.finalize();
+    return serializer.size();
+}
+
+uint32_t deserialize_log_packet(const LogPacket& packet) {
+    Deserializer deserializer(packet.data, packet.size);
+    uint32_t number = UINT32_MAX;
+    deserializer.deserialize_uint32(uint32_default_options(), &number);
+    return number;
+}
+
+void test_log() {
+    const uint32_t count = 5000;
+    Vector<uint8_t> output(&allocator);
+    Writer writer{};
+    writer.write_callback = write_data;
+    writer.ctx = &output;
+    LogWriter log_writer(&writer, &allocator, 64);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t packet[16];
+        size_t size = serialize_log_packet(i, packet, sizeof(packet));
+        ts_expect_success(log_writer.write_packet(packet, size, (uint64_t)i * 10 + i % 3));
+    }
+    ts_expect_status(log_writer.write_packet(nullptr, 0, 0), ResultStatus::InvalidArgument);
+    ts_expect_success(log_writer.finish());
+    ts_expect(log_writer.size() == output.length());
+
+    LogReader reader(output.ptr(), output.length(), &allocator);
+    ts_assert(reader.open().status == ResultStatus::Success);
+    ts_expect(!reader.recovered());
+    ts_expect(reader.packet_count() == count);
+
+    LogPacket packet;
+    ts_expect_success(reader.next(&packet));
+    ts_expect_uint32_eq(deserialize_log_packet(packet), 0);
+    ts_expect_success(reader.next(&packet));
+    ts_expect_uint32_eq(deserialize_log_packet(packet), 1);
+    ts_expect_uint64_eq(packet.timestamp, 11);
+
+    ts_expect_success(reader.seek_packet(4321));
+    ts_expect_success(reader.next(&packet));
+    ts_expect_uint32_eq(deserialize_log_packet(packet), 4321);
+    ts_expect_uint64_eq(packet.number, 4321);
+    ts_expect_uint64_eq(packet.timestamp, 43211);
+    ts_expect_status(reader.seek_packet(count), ResultStatus::InvalidArgument);
+
+    // the first packet at or after the timestamp
+    ts_expect_success(reader.seek_timestamp(12345));
+    ts_expect_success(reader.next(&packet));
+    ts_expect_uint64_eq(packet.number, 1235);
+    ts_expect_success(reader.seek_timestamp(0));
+    ts_expect_success(reader.next(&packet));
+    ts_expect_uint64_eq(packet.number, 0);
+    ts_expect_status(reader.seek_timestamp(1000000), ResultStatus::EndOfInput);
+
+    ts_expect_success(reader.seek_packet(count - 1));
+    ts_expect_success(reader.next(&packet));
+    ts_expect_uint32_eq(deserialize_log_packet(packet), count - 1);
+    ts_expect_status(reader.next(&packet), ResultStatus::EndOfInput);
+
+    // a log which was never finished and has half of its last frame, the index is rebuilt
+    Vector<uint8_t> crashed(&allocator);
+    writer.ctx = &crashed;
+    LogWriter crashed_writer(&writer, &allocator);
+    for (uint32_t i = 0; i < 3000; i++) {
+        uint8_t data[16];
+        size_t size = serialize_log_packet(i, data, sizeof(data));
+        ts_expect_success(crashed_writer.write_packet(data, size, (uint64_t)i * 10));
+    }
+    LogReader truncated(crashed.ptr(), crashed.length() - 2, &allocator);
+    ts_assert(truncated.open().status == ResultStatus::Success);
+    ts_expect(truncated.recovered());
+    ts_expect(truncated.packet_count() == 2999);
+    ts_expect_success(truncated.seek_packet(2998));
+    ts_expect_success(truncated.next(&packet));
+    ts_expect_uint32_eq(deserialize_log_packet(packet), 2998);
+    ts_expect_status(truncated.next(&packet), ResultStatus::EndOfInput);
+    ts_expect_success(truncated.seek_timestamp(20001));
+    ts_expect_success(truncated.next(&packet));
+    ts_expect_uint64_eq(packet.number, 2001);
+
+    uint8_t not_a_log[8] = { 'P', 'M', 'X', 'X', 1, 0, 0, 0 };
+    LogReader invalid(not_a_log, sizeof(not_a_log), &allocator);
+    ts_expect_status(invalid.open(), ResultStatus::InvalidFormat);
+}
+
+// a packet of the index and index % 7 values, fails for the index in ctx
+Result encode_batch_job(Serializer* serializer, size_t index, void* ctx) {
+    if (ctx != nullptr && *(size_t*)ctx == index) {
+        serializer->serialize_uint32(1, uint32_default_options());
+        return Result(ResultStatus::InvalidArgument);
+    }
+    Result result = serializer->serialize_uint32((uint32_t)index, uint32_default_options());
+    for (size_t i = 0; i < index % 7 && result.status == ResultStatus::Success; i++) {
+        result = serializer->serialize_uint16((uint16_t)(index * i), uint16_default_options());
+    }
+    return result;
+}
+
+// a packet that doesn't fit in the inline buffer of the serializer
+Result encode_large_batch_job(Serializer* serializer, size_t index, void* ctx) {
+    (void)ctx;
+    Result result = Result(ResultStatus::Success);
+    for (uint32_t i = 0; i < 100 && result.status == ResultStatus::Success; i++) {
+        result = serializer->serialize_uint32((uint32_t)index * 100000 + i, uint32_default_options());
+    }
+    return result;
+}
+
+void test_batch_encoder() {
+    const size_t count = 3000;
+    for (size_t threads = 1; threads <= 4; threads += 3) {
+        BatchEncoder encoder(&allocator, threads, 1 << 20);
+        ts_expect_size_eq(encoder.threads(), threads);
+        // the second batch reuses the serializers and the memory of the first one
+        for (int batch = 0; batch < 2; batch++) {
+            ts_expect_success(encoder.encode(count, encode_batch_job, nullptr));
+            ts_assert(encoder.output_count() == count);
+            bool same = true;
+            for (size_t i = 0; i < count; i++) {
+                const BatchOutput& output = encoder.output(i);
+                Deserializer deserializer(output.data, output.size);
+                uint32_t index = 0;
+                same = same && deserializer.deserialize_uint32(uint32_default_options(), &index).status == ResultStatus::Success && index == i;
+                for (size_t j = 0; j < i % 7; j++) {
+                    uint16_t value = 0;
+                    same = same && deserializer.deserialize_uint16(uint16_default_options(), &value).status == ResultStatus::Success;
+                    same = same && value == (uint16_t)(i * j);
+                }
+                same = same && deserializer.offset() == output.size;
+            }
+            ts_expect(same);
+        }
+
+        size_t failing = 1234;
+        ts_expect_status(encoder.encode(count, encode_batch_job, &failing), ResultStatus::InvalidArgument);
+        ts_expect_size_eq(encoder.output(failing).size, 0);
+        ts_expect_success(encoder.output(failing + 1).result);
+    }
+
+    // the threads grow their buffers without the allocator of the encoder, only the outputs of a batch come from it
+    size_t allocations = 0;
+    Allocator counting_allocator = { counting_malloc, counting_realloc, my_free, &allocations };
+    BatchEncoder encoder(&counting_allocator, 4, 1 << 20);
+    ts_expect_success(encoder.encode(count, encode_batch_job, nullptr));
+    size_t before = allocations;
+    ts_expect_success(encoder.encode(count, encode_large_batch_job, nullptr));
+    ts_expect_size_eq(allocations, before);
+    Deserializer deserializer(encoder.output(count - 1).data, encoder.output(count - 1).size);
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < 100; i++) {
+        ts_expect_success(deserializer.deserialize_uint32(uint32_default_options(), &value));
+    }
+    ts_expect_uint32_eq(value, (uint32_t)(count - 1) * 100000 + 99);
+}
+
+struct DecodedPackets {
+    uint32_t* numbers;
+    uint64_t* timestamps;
+    // fails at this packet
+    uint64_t failing;
+};
+
+Result decode_log_job(Deserializer* deserializer, const LogPacket& packet, size_t worker, void* ctx) {
+    (void)worker;
+    DecodedPackets* decoded = (DecodedPackets*)ctx;
+    if (packet.number == decoded->failing) {
+        return Result(ResultStatus::InvalidFormat);
+    }
+    decoded->timestamps[packet.number] = packet.timestamp;
+    return deserializer->deserialize_uint32(uint32_default_options(), &decoded->numbers[packet.number]);
+}
+
+void test_log_decoder() {
+    const uint32_t count = 5000;
+    Vector<uint8_t> output(&allocator);
+    Writer writer{};
+    writer.write_callback = write_data;
+    writer.ctx = &output;
+    LogWriter log_writer(&writer, &allocator, 64);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t packet[16];
+        size_t size = serialize_log_packet(i, packet, sizeof(packet));
+        ts_expect_success(log_writer.write_packet(packet, size, (uint64_t)i * 3));
+    }
+    ts_expect_success(log_writer.finish());
+    LogReader log(output.ptr(), output.length(), &allocator);
+    ts_assert(log.open().status == ResultStatus::Success);
+
+    static uint32_t numbers[count];
+    static uint64_t timestamps[count];
+    DecodedPackets decoded = { numbers, timestamps, UINT64_MAX };
+    LogDecoder decoder(&allocator, 4);
+    ts_expect_success(decoder.decode(&log, decode_log_job, &decoded));
+    bool same = true;
+    for (uint32_t i = 0; i < count; i++) {
+        same = same && numbers[i] == i && timestamps[i] == (uint64_t)i * 3;
+    }
+    ts_expect(same);
+
+    decoded.failing = 4000;
+    ts_expect_status(decoder.decode(&log, decode_log_job, &decoded), ResultStatus::InvalidFormat);
+}
+
+void test_async_writer() {
+#ifdef PACKET_MASTER_POSIX_IO
+    const char* path = "packet_master_async_test.bin";
+    const uint32_t count = 20000;
+    FILE* file = fopen(path, "wb");
+    ts_assert(file != nullptr);
+    {
+        // small buffers so the ring wraps around many times
+        AsyncFdWriter async_writer(fileno(file), &allocator, 4, 1024);
+        ts_assert(async_writer.is_open());
+        Writer writer = async_writer.writer();
+        Serializer serializer(&writer, &allocator);
+        serializer.set_flush_policy(FlushPolicy::Threshold, 256);
+        // the counters can be read from another thread while writing
+        std::atomic<bool> writing{true};
+        bool monotonic = true;
+        std::thread monitor([&]() {
+            uint64_t buffers = 0;
+            while (writing.load()) {
+                AsyncWriterStats polled = async_writer.stats();
+                monotonic = monotonic && polled.buffers >= buffers;
+                buffers = polled.buffers;
+            }
+        });
+        for (uint32_t i = 0; i < count; i++) {
+            ts_expect_success(serializer.serialize_uint32(i * 37, uint32_default_options()));
+            if (i % 1000 == 0) {
+                ts_expect_int_eq(async_writer.flush(), 0);
+            }
+        }
+        ts_expect_success(serializer.finalize());
+        writing.store(false);
+        monitor.join();
+        ts_expect(monotonic);
+        ts_expect_int_eq(async_writer.close(), 0);
+        AsyncWriterStats stats = async_writer.stats();
+        ts_expect(stats.buffers > count / 1024);
+        ts_expect(stats.syscalls > 0 && stats.syscalls <= stats.buffers);
+        ts_expect_size_eq(stats.dropped_bytes, 0);
+        uint64_t latencies = 0;
+        for (size_t i = 0; i < ASYNC_WRITER_HISTOGRAM_BUCKETS; i++) {
+            latencies += stats.latency_histogram[i];
+        }
+        ts_expect(latencies == stats.buffers);
+        // nothing can be written after close
+        ts_expect_int_eq(writer.write_callback(writer.ctx, (uint8_t*)path, 1), EBADF);
+    }
+    fclose(file);
+
+    MappedFileReader reader(path);
+    ts_assert(reader.is_open());
+    Deserializer deserializer(reader.data(), reader.size());
+    uint32_t value = 0;
+    bool same = true;
+    for (uint32_t i = 0; i < count; i++) {
+        ts_expect_success(deserializer.deserialize_uint32(uint32_default_options(), &value));
+        same = same && value == i * 37;
+    }
+    ts_expect(same);
+    ts_expect_size_eq(deserializer.offset(), reader.size());
+    unlink(path);
+
+    // a pipe nobody reads from fills up and the writes fail instead of waiting
+    int pipe_fds[2];
+    ts_assert(pipe(pipe_fds) == 0);
+    uint64_t written = 0;
+    {
+        AsyncFdWriter async_writer(pipe_fds[1], &allocator, 2, 4096, AsyncBackpressure::Fail);
+        Writer writer = async_writer.writer();
+        uint8_t data[1000];
+        memset(data, 0x5a, sizeof(data));
+        int error = 0;
+        for (int i = 0; i < 1000 && error == 0; i++) {
+            error = writer.write_callback(writer.ctx, data, sizeof(data));
+            written += sizeof(data);
+        }
+        ts_expect_int_eq(error, EAGAIN);
+        AsyncWriterStats stats = async_writer.stats();
+        ts_expect(stats.full > 0);
+        // only the write that didn't fit is dropped, and none of it was copied
+        ts_expect_size_eq(stats.dropped_bytes, sizeof(data));
+
+        uint64_t drained = 0;
+        std::thread drain([&]() {
+            uint8_t buffer[4096];
+            ssize_t size;
+            while ((size = read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+                drained += (uint64_t)size;
+            }
+        });
+        ts_expect_int_eq(async_writer.close(), 0);
+        close(pipe_fds[1]);
+        drain.join();
+        stats = async_writer.stats();
+        ts_expect(drained == stats.bytes);
+        ts_expect(stats.bytes + stats.dropped_bytes == written);
+    }
+    close(pipe_fds[0]);
+#endif
+}
+
+#ifdef PACKET_MASTER_COROUTINES
+struct StreamMove {
+    uint32_t tick;
+    bool jumping;
+    int16_t turn;
+    float x;
+    uint8_t name[5];
+    uint32_t items[3];
+};
+
+static constexpr PreparedFloatOptions stream_position_options = float_quantized_options(-100.0f, 100.0f, 0.01f);
+
+void serialize_stream_move(Serializer* serializer, const StreamMove& move) {
+    serializer->serialize_uint32(move.tick, uint32_default_options());
+    serializer->serialize_bool(move.jumping);
+    serializer->serialize_int16(move.turn, int16_default_options());
+    serializer->serialize_float_quantized(move.x, stream_position_options);
+    serializer->serialize_bytes(move.name, sizeof(move.name));
+    serializer->serialize_uint32_array(move.items, 3, uint32_default_options());
+    serializer->finalize();
+}
+
+// GCC without optimizations warns about a mismatched delete for the frames, see DecodeTask::promise_type
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+DecodeTask decode_stream_position(StreamDeserializer* stream, float* x) {
+    co_return co_await stream->float_quantized(stream_position_options, x);
+}
+
+DecodeTask decode_stream_move(StreamDeserializer* stream, StreamMove* move) {
+    Result result = co_await stream->uint32(uint32_default_options(), &move->tick);
+    if (result.status != ResultStatus::Success) {
+        co_return result;
+    }
+    result = co_await stream->boolean(&move->jumping);
+    if (result.status != ResultStatus::Success) {
+        co_return result;
+    }
+    result = co_await stream->int16(int16_default_options(), &move->turn);
+    if (result.status != ResultStatus::Success) {
+        co_return result;
+    }
+    // a task awaiting another one
+    result = co_await decode_stream_position(stream, &move->x);
+    if (result.status != ResultStatus::Success) {
+        co_return result;
+    }
+    result = co_await stream->bytes(move->name, sizeof(move->name));
+    if (result.status != ResultStatus::Success) {
+        co_return result;
+    }
+    co_return co_await stream->uint32_array(uint32_default_options(), move->items, 3);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+void test_stream_deserializer() {
+#ifdef PACKET_MASTER_COROUTINES
+    const uint32_t count = 200;
+    Vector<uint8_t> output(&allocator);
+    Writer writer{};
+    writer.write_callback = write_data;
+    writer.ctx = &output;
+    Serializer serializer(&writer, &allocator);
+    for (uint32_t i = 0; i < count; i++) {
+        StreamMove move = { i * 7919, i % 3 == 0, (int16_t)(i * 13 - 1000), (float)i * 0.5f - 50.0f, { 1, 2, 3, 4, (uint8_t)i }, { i, i << 8, i << 20 } };
+        serialize_stream_move(&serializer, move);
+    }
+
+    // every packet is decoded while it arrives in pieces, a value across two pieces waits for the second one
+    const size_t chunk_sizes[] = { 1, 3, 7, 64, output.length() };
+    for (size_t chunk_size : chunk_sizes) {
+        StreamDeserializer stream(&allocator);
+        size_t offset = 0;
+        bool same = true;
+        for (uint32_t i = 0; i < count; i++) {
+            StreamMove move = {};
+            DecodeTask task = decode_stream_move(&stream, &move);
+            task.start();
+            while (!task.done() && offset < output.length()) {
+                size_t size = output.length() - offset < chunk_size ? output.length() - offset : chunk_size;
+                ts_expect_success(stream.push(output.ptr() + offset, size));
+                offset += size;
+            }
+            ts_assert(task.done());
+            ts_expect_success(task.result());
+            same = same && move.tick == i * 7919 && move.jumping == (i % 3 == 0) && move.turn == (int16_t)(i * 13 - 1000);
+            same = same && move.x > (float)i * 0.5f - 50.01f && move.x < (float)i * 0.5f - 49.99f;
+            same = same && move.name[4] == (uint8_t)i && move.items[0] == i && move.items[1] == i << 8 && move.items[2] == i << 20;
+            stream.end_packet();
+        }
+        ts_expect(same);
+        ts_expect_size_eq(offset, output.length());
+        ts_expect_size_eq(stream.buffered(), 0);
+    }
+
+    // a stream that ends in the middle of a packet fails the waiting value
+    StreamDeserializer stream(&allocator);
+    StreamMove move = {};
+    DecodeTask task = decode_stream_move(&stream, &move);
+    task.start();
+    ts_expect(!task.done());
+    ts_expect_success(stream.push(output.ptr(), 6));
+    ts_expect(!task.done());
+    stream.close();
+    ts_assert(task.done());
+    ts_expect_status(task.result(), ResultStatus::ReadFailed);
+    ts_expect_uint32_eq(move.tick, 0);
+    ts_expect_status(stream.push(output.ptr(), 1), ResultStatus::InvalidArgument);
+#endif
+}
+
 int main() {
     ts_start_testing();
 
@@ -339,7 +2005,42 @@ int main() {
     TS_RUN_TEST(validate_serialized_data, buffer);
     TS_RUN_TEST(test_deserializer, &deserializer);
 
+    buffer.clear();
+    serializer.reset();
+    deserializer.reset();
+    buf_reader.index = 0;
+
+    TS_RUN_TEST(test_serializer_free_bytes_overflow, &serializer);
+    TS_RUN_TEST(validate_serialized_data_free_bytes_overflow, buffer);
+    TS_RUN_TEST(test_deserializer_free_bytes_overflow, &deserializer);
+
     TS_RUN_TEST(test_count_bits);
+    TS_RUN_TEST(test_flush_policy);
+    TS_RUN_TEST(test_fixed_buffer_serializer);
+    TS_RUN_TEST(test_memory_deserializer);
+    TS_RUN_TEST(test_last_byte_free_bits);
+    TS_RUN_TEST(test_zero_uint8_free_bits);
+    TS_RUN_TEST(test_zero_uint8_segments);
+    TS_RUN_TEST(test_uint_arrays);
+    TS_RUN_TEST(test_constexpr_options);
+    TS_RUN_TEST(test_spec_serialization);
+    TS_RUN_TEST(test_uint64);
+    TS_RUN_TEST(test_signed);
+    TS_RUN_TEST(test_quantized_floats);
+    TS_RUN_TEST(test_delta);
+    TS_RUN_TEST(test_fields);
+    TS_RUN_TEST(test_size_counter);
+    TS_RUN_TEST(test_stats);
+    TS_RUN_TEST(test_arena_allocator);
+    TS_RUN_TEST(test_vector_remove_many);
+    TS_RUN_TEST(test_inline_vector);
+    TS_RUN_TEST(test_writev);
+    TS_RUN_TEST(test_mapped_file);
+    TS_RUN_TEST(test_log);
+    TS_RUN_TEST(test_batch_encoder);
+    TS_RUN_TEST(test_log_decoder);
+    TS_RUN_TEST(test_async_writer);
+    TS_RUN_TEST(test_stream_deserializer);
 
     return ts_finish_testing();
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "test_core.h"
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <time.h>
 
 #define TAB_CHARS "    "
@@ -61,6 +62,7 @@ expect_eq_impl(int, int, "%i")
 expect_eq_impl(uint8_t, uint8, "%hhu")
 expect_eq_impl(uint16_t, uint16, "%hu")
 expect_eq_impl(uint32_t, uint32, "%u")
+expect_eq_impl(uint64_t, uint64, "%" PRIu64)
 
 const char* bool_to_str(bool value) {
     if (value) {
@@ -12,6 +12,7 @@
 #define ts_expect_uint8_eq(left, right) (void)_ts_expect_uint8_eq_impl((left), (right), #left, #right, __FILE__, __LINE__)
 #define ts_expect_uint16_eq(left, right) (void)_ts_expect_uint16_eq_impl((left), (right), #left, #right, __FILE__, __LINE__)
 #define ts_expect_uint32_eq(left, right) (void)_ts_expect_uint32_eq_impl((left), (right), #left, #right, __FILE__, __LINE__)
+#define ts_expect_uint64_eq(left, right) (void)_ts_expect_uint64_eq_impl((left), (right), #left, #right, __FILE__, __LINE__)
 #define ts_expect_bool_eq(left, right) (void)_ts_expect_bool_eq_impl((left), (right), #left, #right, __FILE__, __LINE__)
 #define ts_expect_size_eq(left, right) (void)_ts_expect_size_eq_impl((left), (right), #left, #right, __FILE__, __LINE__)
 